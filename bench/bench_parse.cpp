@@ -0,0 +1,154 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+// Compare the message dispatch (aoo_parse_pattern() + parse_msg_type())
+// with the old sscanf()/strcmp() implementation (see parse_old.hpp).
+// Every packet of the corpus is dispatched in a loop, like the network
+// thread does in transport::handle_packet() and the handle_message() methods.
+//
+// The corpus (see corpus/) has been captured from a PCM stream between
+// a source and a sink: /aoo/... messages in both directions, compact data
+// messages (/d) and binary data messages (single frame and fragmented).
+// Binary data messages did not exist before, so the old implementation
+// just rejects them.
+
+#include "aoo/aoo.h"
+#include "common.hpp"
+#include "parse_old.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+struct packet {
+    std::string name;
+    std::vector<char> data;
+};
+
+static bool read_packet(const std::string& path, packet& p){
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp){
+        return false;
+    }
+    char buf[AOO_MAXPACKETSIZE];
+    auto n = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    if (n == 0){
+        return false;
+    }
+    p.name = path.substr(path.find_last_of('/') + 1);
+    p.data.assign(buf, buf + n);
+    return true;
+}
+
+static bool read_corpus(const char *dir, std::vector<packet>& corpus){
+    auto d = opendir(dir);
+    if (!d){
+        return false;
+    }
+    while (auto entry = readdir(d)){
+        if (entry->d_name[0] != '.'){
+            packet p;
+            if (read_packet(std::string(dir) + "/" + entry->d_name, p)){
+                corpus.push_back(std::move(p));
+            }
+        }
+    }
+    closedir(d);
+    std::sort(corpus.begin(), corpus.end(),
+              [](auto& a, auto& b){ return a.name < b.name; });
+    return !corpus.empty();
+}
+
+static int dispatch_new(const char *data, int32_t n){
+    int32_t type, id;
+    auto onset = aoo_parse_pattern(data, n, &type, &id);
+    if (onset <= 0){
+        return -1;
+    }
+    // binary data messages return 1, compact data messages have no ID
+    if (onset == 1 || id == AOO_ID_NONE){
+        return 0; // no message type
+    }
+    return (int)aoo::parse_msg_type(data, n, onset);
+}
+
+static int dispatch_old(const char *data, int32_t n){
+    int32_t type, id;
+    auto onset = aoo::old::parse_pattern(data, n, &type, &id);
+    if (onset <= 0){
+        return -1;
+    }
+    if (id == AOO_ID_NONE){
+        return 0; // compact data message
+    }
+    return aoo::old::dispatch(type, data + onset);
+}
+
+using dispatch_fn = int (*)(const char *, int32_t);
+
+static double measure(const packet& p, int32_t count, dispatch_fn f){
+    // call through a volatile function pointer, so that the compiler
+    // can't inline the old (header-only) implementation and hoist
+    // the work out of the loop.
+    volatile dispatch_fn fn = f;
+    auto data = p.data.data();
+    auto n = (int32_t)p.data.size();
+    int sum = 0;
+    auto start = clock_type::now();
+    for (int32_t i = 0; i < count; ++i){
+        sum += fn(data, n);
+    }
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    if (sum == 12345){
+        printf("bad sum\n"); // never happens, but keeps the loop alive
+    }
+    return elapsed.count();
+}
+
+int main(int argc, const char *argv[]){
+    const char *dir = argc > 1 ? argv[1] : "corpus";
+    int32_t count = argc > 2 ? atoi(argv[2]) : 2000000;
+    std::vector<packet> corpus;
+    if (count <= 0 || !read_corpus(dir, corpus)){
+        fprintf(stderr, "usage: %s [<corpus directory>] [<iterations>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("message dispatch: %d packets from '%s', %d iterations each\n\n",
+           (int)corpus.size(), dir, count);
+
+    double total_old = 0, total_new = 0;
+    for (auto& p : corpus){
+        auto data = p.data.data();
+        auto n = (int32_t)p.data.size();
+        auto r_old = dispatch_old(data, n);
+        auto r_new = dispatch_new(data, n);
+        if (r_old != r_new && !aoo::is_binary_data(data, n)){
+            fprintf(stderr, "%s: result mismatch (old: %d, new: %d)\n",
+                    p.name.c_str(), r_old, r_new);
+            return EXIT_FAILURE;
+        }
+
+        auto t_old = measure(p, count, dispatch_old);
+        auto t_new = measure(p, count, dispatch_new);
+        total_old += t_old;
+        total_new += t_new;
+        printf("%-24s old: %7.1f ns/packet   new: %7.1f ns/packet   speedup: %.2fx%s\n",
+               p.name.c_str(), t_old * 1e9 / count, t_new * 1e9 / count,
+               t_old / t_new, r_old < 0 ? " (old: rejected)" : "");
+    }
+    printf("\n%-24s old: %7.1f ns/packet   new: %7.1f ns/packet   speedup: %.2fx\n",
+           "average", total_old * 1e9 / (count * corpus.size()),
+           total_new * 1e9 / (count * corpus.size()), total_old / total_new);
+
+    return EXIT_SUCCESS;
+}
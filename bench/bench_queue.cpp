@@ -0,0 +1,152 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+// Compare the SPSC lockfree::queue with the old implementation
+// (see queue_old.hpp). A producer and a consumer thread pass
+// a fixed number of blocks through the queue, like the audio thread
+// and the network thread do with the audio and info queues.
+
+#include "lockfree.hpp"
+#include "queue_old.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+using clock_type = std::chrono::steady_clock;
+
+struct block_info {
+    double samplerate;
+    uint64_t time;
+};
+
+// audio queue: blocks of interleaved samples
+template<typename Q>
+double bench_audio(int32_t nblocks, int32_t blocksize, int32_t nbuffers){
+    Q queue;
+    queue.resize(blocksize * nbuffers, blocksize);
+
+    auto start = clock_type::now();
+
+    std::thread consumer([&](){
+        float sum = 0;
+        for (int32_t i = 0; i < nblocks; ){
+            if (queue.read_available()){
+                auto data = queue.read_data();
+                for (int32_t j = 0; j < blocksize; ++j){
+                    sum += data[j];
+                }
+                queue.read_commit();
+                i++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        if (sum < 0){
+            printf("bad sum\n"); // never happens, but keeps the loop alive
+        }
+    });
+
+    for (int32_t i = 0; i < nblocks; ){
+        if (queue.write_available()){
+            auto data = queue.write_data();
+            for (int32_t j = 0; j < blocksize; ++j){
+                data[j] = (float)j;
+            }
+            queue.write_commit();
+            i++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    consumer.join();
+
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    return elapsed.count();
+}
+
+// info queue: single elements
+template<typename Q>
+double bench_info(int32_t nblocks, int32_t nbuffers){
+    Q queue;
+    queue.resize(nbuffers, 1);
+
+    auto start = clock_type::now();
+
+    std::thread consumer([&](){
+        uint64_t sum = 0;
+        for (int32_t i = 0; i < nblocks; ){
+            if (queue.read_available()){
+                block_info info;
+                queue.read(info);
+                sum += info.time;
+                i++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        if (sum == 1){
+            printf("bad sum\n"); // see above
+        }
+    });
+
+    for (int32_t i = 0; i < nblocks; ){
+        if (queue.write_available()){
+            block_info info;
+            info.samplerate = 48000;
+            info.time = i;
+            queue.write(info);
+            i++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    consumer.join();
+
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    return elapsed.count();
+}
+
+static void print_result(const char *name, int32_t nblocks, double t_old, double t_new){
+    printf("%-28s old: %8.1f ns/block   new: %8.1f ns/block   speedup: %.2fx\n",
+           name, t_old * 1e9 / nblocks, t_new * 1e9 / nblocks, t_old / t_new);
+}
+
+int main(int argc, const char *argv[]){
+    int32_t nblocks = argc > 1 ? atoi(argv[1]) : 2000000;
+    if (nblocks <= 0){
+        fprintf(stderr, "usage: %s [<num blocks>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("lockfree::queue: %d blocks, producer + consumer thread\n\n", nblocks);
+
+    // (blocksize, number of buffers)
+    const int32_t audio[][2] = {
+        { 64 * 2, 4 }, // 64 samples, stereo, small buffer
+        { 64 * 2, 32 },
+        { 256 * 16, 8 } // 256 samples, 16 channels
+    };
+    for (auto& a : audio){
+        char name[64];
+        snprintf(name, sizeof(name), "audio (%d x %d)", a[0], a[1]);
+        auto t_old = bench_audio<aoo::old::queue<float>>(nblocks, a[0], a[1]);
+        auto t_new = bench_audio<aoo::lockfree::queue<float>>(nblocks, a[0], a[1]);
+        print_result(name, nblocks, t_old, t_new);
+    }
+
+    const int32_t info[] = { 4, 64 };
+    for (auto n : info){
+        char name[64];
+        snprintf(name, sizeof(name), "info (%d)", n);
+        auto t_old = bench_info<aoo::old::queue<block_info>>(nblocks, n);
+        auto t_new = bench_info<aoo::lockfree::queue<block_info>>(nblocks, n);
+        print_result(name, nblocks, t_old, t_new);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,424 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+// Compare the network backends of aoo::transport. The Makefile builds
+// this file twice: bench_transport_epoll (epoll + sendmmsg/recvmmsg)
+// and bench_transport_uring (AOO_USE_IO_URING=1).
+//
+// Several sources on transport A stream to a sink on transport B over
+// the loopback interface. The "audio thread" runs in real time, like
+// in Pd, and each source sends one data packet per block. For each
+// thread we count the system calls and measure the CPU time, so we get
+// the syscalls per packet and the max. throughput (packets per CPU second).
+//
+// The system calls are counted with the linker's --wrap option,
+// so the library itself does not need any instrumentation.
+
+#include "aoo/aoo.h"
+#include "aoo/aoo_pcm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/*//////////////////////// syscall counters //////////////////////////*/
+
+enum syscall_type {
+    SYS_EPOLL_WAIT,
+    SYS_POLL,
+    SYS_READ,
+    SYS_WRITE,
+    SYS_RECVFROM,
+    SYS_RECVMMSG,
+    SYS_SENDTO,
+    SYS_SENDMMSG,
+    SYS_URING_ENTER,
+    SYS_OTHER,
+    SYS_COUNT
+};
+
+static const char *syscall_names[SYS_COUNT] = {
+    "epoll_wait", "poll", "read", "write", "recvfrom", "recvmmsg",
+    "sendto", "sendmmsg", "io_uring_enter", "other"
+};
+
+struct thread_stats {
+    std::atomic<uint64_t> calls[SYS_COUNT];
+    clockid_t clock;
+
+    thread_stats(){
+        reset();
+    }
+
+    void reset(){
+        for (auto& c : calls){
+            c.store(0);
+        }
+    }
+
+    double cputime() const {
+        timespec ts;
+        clock_gettime(clock, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+};
+
+// the counters of the calling thread (null = don't count)
+static thread_local thread_stats *current_stats = nullptr;
+
+static inline void count_syscall(syscall_type type){
+    if (current_stats){
+        current_stats->calls[type].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+extern "C" {
+
+int __real_epoll_wait(int, epoll_event *, int, int);
+int __real_poll(pollfd *, nfds_t, int);
+ssize_t __real_read(int, void *, size_t);
+ssize_t __real_write(int, const void *, size_t);
+ssize_t __real_recvfrom(int, void *, size_t, int, sockaddr *, socklen_t *);
+int __real_recvmmsg(int, mmsghdr *, unsigned int, int, timespec *);
+ssize_t __real_sendto(int, const void *, size_t, int, const sockaddr *, socklen_t);
+int __real_sendmmsg(int, mmsghdr *, unsigned int, int);
+long __real_syscall(long, ...);
+
+int __wrap_epoll_wait(int fd, epoll_event *events, int n, int timeout){
+    count_syscall(SYS_EPOLL_WAIT);
+    return __real_epoll_wait(fd, events, n, timeout);
+}
+
+int __wrap_poll(pollfd *fds, nfds_t n, int timeout){
+    count_syscall(SYS_POLL);
+    return __real_poll(fds, n, timeout);
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t n){
+    count_syscall(SYS_READ);
+    return __real_read(fd, buf, n);
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t n){
+    count_syscall(SYS_WRITE);
+    return __real_write(fd, buf, n);
+}
+
+ssize_t __wrap_recvfrom(int fd, void *buf, size_t n, int flags,
+                        sockaddr *addr, socklen_t *len){
+    count_syscall(SYS_RECVFROM);
+    return __real_recvfrom(fd, buf, n, flags, addr, len);
+}
+
+int __wrap_recvmmsg(int fd, mmsghdr *msgs, unsigned int n, int flags, timespec *ts){
+    count_syscall(SYS_RECVMMSG);
+    return __real_recvmmsg(fd, msgs, n, flags, ts);
+}
+
+ssize_t __wrap_sendto(int fd, const void *buf, size_t n, int flags,
+                      const sockaddr *addr, socklen_t len){
+    count_syscall(SYS_SENDTO);
+    return __real_sendto(fd, buf, n, flags, addr, len);
+}
+
+int __wrap_sendmmsg(int fd, mmsghdr *msgs, unsigned int n, int flags){
+    count_syscall(SYS_SENDMMSG);
+    return __real_sendmmsg(fd, msgs, n, flags);
+}
+
+// used for io_uring_setup(), io_uring_enter() and io_uring_register()
+long __wrap_syscall(long number, ...){
+    va_list ap;
+    va_start(ap, number);
+    long a[6];
+    for (auto& arg : a){
+        arg = va_arg(ap, long);
+    }
+    va_end(ap);
+#ifdef __NR_io_uring_enter
+    count_syscall(number == __NR_io_uring_enter ? SYS_URING_ENTER : SYS_OTHER);
+#else
+    count_syscall(SYS_OTHER);
+#endif
+    return __real_syscall(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+} // extern "C"
+
+/*//////////////////////// benchmark //////////////////////////*/
+
+#define SAMPLERATE 48000
+#define NCHANNELS 2
+#define SINK_ID 1
+
+using clock_type = std::chrono::steady_clock;
+
+struct transport_thread {
+    aoo_transport *transport = nullptr;
+    std::thread thread;
+    thread_stats stats;
+
+    bool start(int port){
+        int32_t err;
+        transport = aoo_transport_new(port, &err);
+        if (!transport){
+            fprintf(stderr, "couldn't create transport on port %d (%d)\n", port, err);
+            return false;
+        }
+        std::atomic<bool> ready{false};
+        thread = std::thread([this, &ready](){
+            pthread_getcpuclockid(pthread_self(), &stats.clock);
+            current_stats = &stats;
+            ready.store(true);
+            aoo_transport_run(transport);
+            current_stats = nullptr;
+        });
+        while (!ready.load()){
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    void stop(){
+        if (transport){
+            aoo_transport_quit(transport);
+            thread.join();
+            aoo_transport_free(transport);
+            transport = nullptr;
+        }
+    }
+};
+
+static int32_t handle_sink_events(void *user, const aoo_event **events, int32_t n){
+    auto lost = (int64_t *)user;
+    for (int i = 0; i < n; ++i){
+        if (events[i]->type == AOO_BLOCK_LOST_EVENT){
+            *lost += ((const aoo_block_lost_event *)events[i])->count;
+        }
+    }
+    return 1;
+}
+
+static int32_t handle_source_events(void *user, const aoo_event **events, int32_t n){
+    return 1; // ignore
+}
+
+struct result {
+    int64_t packets;
+    int64_t lost;
+    double elapsed;
+    double cpu_send;
+    double cpu_receive;
+    uint64_t calls_send[SYS_COUNT];
+    uint64_t calls_receive[SYS_COUNT];
+    uint64_t calls_audio[SYS_COUNT];
+};
+
+static bool run(int32_t nsources, int32_t blocksize, double seconds,
+                int port, result& r)
+{
+    transport_thread sender, receiver;
+    if (!sender.start(port) || !receiver.start(port + 1)){
+        sender.stop();
+        return false;
+    }
+
+    auto sink = aoo_sink_new(SINK_ID);
+    aoo_sink_setup(sink, SAMPLERATE, blocksize, NCHANNELS); // sources are summed
+    aoo_transport_add_sink(receiver.transport, sink);
+
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port = htons(port + 1);
+    auto endpoint = aoo_transport_get_endpoint(sender.transport, &sa, sizeof(sa));
+
+    std::vector<aoo_source *> sources;
+    for (int i = 0; i < nsources; ++i){
+        auto src = aoo_source_new(i + 1);
+        aoo_format_pcm fmt;
+        fmt.header.codec = AOO_CODEC_PCM;
+        fmt.header.blocksize = blocksize;
+        fmt.header.samplerate = SAMPLERATE;
+        fmt.header.nchannels = NCHANNELS;
+        fmt.bitdepth = AOO_PCM_FLOAT32;
+        aoo_source_set_format(src, &fmt.header);
+        aoo_source_setup(src, SAMPLERATE, blocksize, NCHANNELS);
+        aoo_source_add_sink(src, endpoint, SINK_ID, aoo_transport_send);
+        aoo_source_start(src);
+        aoo_transport_add_source(sender.transport, src);
+        sources.push_back(src);
+    }
+
+    // audio buffers
+    std::vector<aoo_sample> inbuf(blocksize, 0.5);
+    const aoo_sample *invec[NCHANNELS];
+    for (auto& v : invec){
+        v = inbuf.data();
+    }
+    std::vector<aoo_sample> outbuf(blocksize * NCHANNELS);
+    aoo_sample *outvec[NCHANNELS];
+    for (int i = 0; i < NCHANNELS; ++i){
+        outvec[i] = outbuf.data() + i * blocksize;
+    }
+
+    thread_stats audio;
+    pthread_getcpuclockid(pthread_self(), &audio.clock);
+    current_stats = &audio;
+
+    auto period = std::chrono::duration<double>((double)blocksize / SAMPLERATE);
+    int64_t warmup = 0.5 / period.count(); // let the streams start
+    int64_t nblocks = seconds / period.count();
+    int64_t lost = 0;
+    double cpu_send = 0, cpu_receive = 0;
+    auto start = clock_type::now();
+    auto next = start;
+
+    for (int64_t i = 0; i < warmup + nblocks; ++i){
+        if (i == warmup){
+            sender.stats.reset();
+            receiver.stats.reset();
+            audio.reset();
+            cpu_send = sender.stats.cputime();
+            cpu_receive = receiver.stats.cputime();
+            lost = 0;
+            start = clock_type::now();
+        }
+        auto t = aoo_osctime_get();
+        bool notify = false;
+        for (auto& src : sources){
+            if (aoo_source_process(src, invec, blocksize, t) > 0){
+                notify = true;
+            }
+            aoo_source_handle_events(src, handle_source_events, nullptr);
+        }
+        if (notify){
+            aoo_transport_notify(sender.transport);
+        }
+        aoo_sink_process(sink, outvec, blocksize, t);
+        aoo_sink_handle_events(sink, handle_sink_events, &lost);
+
+        next += std::chrono::duration_cast<clock_type::duration>(period);
+        std::this_thread::sleep_until(next);
+    }
+
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+    r.elapsed = elapsed.count();
+    r.cpu_send = sender.stats.cputime() - cpu_send;
+    r.cpu_receive = receiver.stats.cputime() - cpu_receive;
+    for (int i = 0; i < SYS_COUNT; ++i){
+        r.calls_send[i] = sender.stats.calls[i].load();
+        r.calls_receive[i] = receiver.stats.calls[i].load();
+        r.calls_audio[i] = audio.calls[i].load();
+    }
+    r.packets = nblocks * nsources;
+    r.lost = lost;
+
+    current_stats = nullptr;
+
+    sender.stop();
+    receiver.stop();
+    for (auto& src : sources){
+        aoo_source_free(src);
+    }
+    aoo_sink_free(sink);
+    return true;
+}
+
+static void print_calls(const char *name, const uint64_t *calls, int64_t packets){
+    uint64_t total = 0;
+    for (int i = 0; i < SYS_COUNT; ++i){
+        total += calls[i];
+    }
+    printf("    %-8s %6.3f syscalls/packet  (", name, (double)total / packets);
+    bool first = true;
+    for (int i = 0; i < SYS_COUNT; ++i){
+        if (calls[i] > 0){
+            printf("%s%s: %llu", first ? "" : ", ", syscall_names[i],
+                   (unsigned long long)calls[i]);
+            first = false;
+        }
+    }
+    printf(")\n");
+}
+
+int main(int argc, const char *argv[]){
+    double seconds = argc > 1 ? atof(argv[1]) : 5;
+    int port = argc > 2 ? atoi(argv[2]) : 19000;
+    if (seconds <= 0 || port <= 0){
+        fprintf(stderr, "usage: %s [<seconds>] [<port>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    aoo_initialize();
+
+#if AOO_USE_IO_URING
+    printf("aoo::transport (io_uring): %g seconds per run\n\n", seconds);
+#else
+    printf("aoo::transport (epoll): %g seconds per run\n\n", seconds);
+#endif
+
+    // (number of sources, blocksize)
+    const int32_t loads[][2] = {
+        { 1, 64 },
+        { 16, 64 },
+        { 64, 64 },
+        { 16, 256 }
+    };
+#if AOO_USE_IO_URING
+    bool uring_used = false;
+#endif
+    for (auto& l : loads){
+        result r;
+        if (!run(l[0], l[1], seconds, port, r)){
+            return EXIT_FAILURE;
+        }
+        port += 2;
+
+        printf("%d source(s), blocksize %d: %.0f packets/s, %.2f MB/s, lost blocks: %lld\n",
+               l[0], l[1], r.packets / r.elapsed,
+               r.packets * l[1] * NCHANNELS * sizeof(float) / r.elapsed * 1e-6,
+               (long long)r.lost);
+        printf("    send:    %8.1f us CPU/s, %10.0f packets per CPU second\n",
+               r.cpu_send / r.elapsed * 1e6, r.packets / r.cpu_send);
+        printf("    receive: %8.1f us CPU/s, %10.0f packets per CPU second\n",
+               r.cpu_receive / r.elapsed * 1e6, r.packets / r.cpu_receive);
+        print_calls("send", r.calls_send, r.packets);
+        print_calls("receive", r.calls_receive, r.packets);
+        print_calls("audio", r.calls_audio, r.packets);
+        printf("\n");
+
+    #if AOO_USE_IO_URING
+        if (r.calls_send[SYS_URING_ENTER] > 0){
+            uring_used = true;
+        }
+    #endif
+    }
+
+#if AOO_USE_IO_URING
+    if (!uring_used){
+        printf("NOTE: io_uring is not available, the transport fell back to epoll!\n");
+    }
+#endif
+
+    aoo_terminate();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#pragma once
+
+#include "aoo/aoo.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace aoo {
+namespace old {
+
+/*////////////////////// message dispatch /////////////////////////*/
+
+// The address pattern parsing and message dispatch before the
+// hand-written parser and aoo::msg_type, only kept for comparison
+// in bench_parse.cpp.
+
+// NOTE: binary data messages did not exist yet.
+inline int32_t parse_pattern(const char *msg, int32_t n,
+                             int32_t *type, int32_t *id)
+{
+    int32_t offset = 0;
+    // special case the compact data message which doesn't use the aoo domain
+    if (n >= AOO_MSG_COMPACT_DATA_LEN
+        && !memcmp(msg, AOO_MSG_COMPACT_DATA, AOO_MSG_COMPACT_DATA_LEN))
+    {
+        *type = AOO_TYPE_SINK;
+        offset += AOO_MSG_COMPACT_DATA_LEN;
+        *id = AOO_ID_NONE; // will be looked up later
+        return offset;
+    }
+    else if (n >= AOO_MSG_DOMAIN_LEN
+        && !memcmp(msg, AOO_MSG_DOMAIN, AOO_MSG_DOMAIN_LEN))
+    {
+        offset += AOO_MSG_DOMAIN_LEN;
+        if (n >= (offset + AOO_MSG_SOURCE_LEN)
+            && !memcmp(msg + offset, AOO_MSG_SOURCE, AOO_MSG_SOURCE_LEN))
+        {
+            *type = AOO_TYPE_SOURCE;
+            offset += AOO_MSG_SOURCE_LEN;
+        } else if (n >= (offset + AOO_MSG_SINK_LEN)
+            && !memcmp(msg + offset, AOO_MSG_SINK, AOO_MSG_SINK_LEN))
+        {
+            *type = AOO_TYPE_SINK;
+            offset += AOO_MSG_SINK_LEN;
+        } else {
+            return 0;
+        }
+
+        if (!memcmp(msg + offset, "/*", 2)){
+            *id = AOO_ID_WILDCARD; // wildcard
+            return offset + 2;
+        }
+        int32_t skip = 0;
+        if (sscanf(msg + offset, "/%d%n", id, &skip) > 0){
+            return offset + skip;
+        } else {
+            return 0;
+        }
+    } else {
+        return 0; // not an AoO message
+    }
+}
+
+// the strcmp() chains of source::handle_message() and sink::handle_message();
+// returns the matching aoo::msg_type as an int (0 = unknown).
+inline int dispatch(int32_t type, const char *pattern){
+    if (type == AOO_TYPE_SOURCE){
+        if (!strcmp(pattern, AOO_MSG_FORMAT)){
+            return 1;
+        } else if (!strcmp(pattern, AOO_MSG_DATA)){
+            return 2;
+        } else if (!strcmp(pattern, AOO_MSG_INVITE)){
+            return 4;
+        } else if (!strcmp(pattern, AOO_MSG_UNINVITE)){
+            return 5;
+        } else if (!strcmp(pattern, AOO_MSG_PING)){
+            return 3;
+        } else if (!strcmp(pattern, AOO_MSG_CODEC_CHANGE)){
+            return 6;
+        }
+    } else {
+        if (!strcmp(pattern, AOO_MSG_FORMAT)){
+            return 1;
+        } else if (!strcmp(pattern, AOO_MSG_DATA)){
+            return 2;
+        } else if (!strcmp(pattern, AOO_MSG_PING)){
+            return 3;
+        }
+    }
+    return 0;
+}
+
+} // old
+} // aoo
@@ -0,0 +1,125 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others. 
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <cassert>
+
+namespace aoo {
+namespace old {
+
+/*////////////////////// queue /////////////////////////*/
+
+// The lock-free queue before the SPSC redesign (shared 'balance_' counter
+// and modulo indexing), only kept for comparison in bench_queue.cpp.
+template<typename T>
+class queue {
+ public:
+    queue() = default;
+    // we need a move constructor so we can
+    // put it in STL containers
+    queue(queue&& other)
+        : balance_(other.balance_.load()),
+          rdhead_(other.rdhead_),
+          wrhead_(other.wrhead_),
+          stride_(other.stride_),
+          data_(std::move(other.data_))
+    {}
+    queue& operator=(queue&& other){
+        balance_ = other.balance_.load();
+        rdhead_ = other.rdhead_;
+        wrhead_ = other.wrhead_;
+        stride_ = other.stride_;
+        data_ = std::move(other.data_);
+        return *this;
+    }
+
+    void resize(int32_t size, int32_t blocksize) {
+        // check if size is divisible by both rdsize and wrsize
+        assert(size >= blocksize);
+        assert((size % blocksize) == 0);
+    #if 1
+        data_.clear(); // force zero
+    #endif
+        data_.resize(size);
+        stride_ = blocksize;
+        reset();
+    }
+
+    int32_t blocksize() const { return stride_; }
+
+    int32_t capacity() const { return data_.size(); }
+
+    void reset() {
+        rdhead_ = wrhead_ = 0;
+        balance_ = 0;
+    }
+    // returns: the number of available *blocks* for reading
+    int32_t read_available() const {
+        if (stride_){
+            return balance_.load(std::memory_order_acquire) / stride_;
+        } else {
+            return 0;
+        }
+    }
+
+    void read(T& out) {
+        out = std::move(data_[rdhead_]);
+        rdhead_ = (rdhead_ + 1) % capacity();
+        --balance_;
+        assert(balance_ >= 0);
+    }
+
+    const T* read_data() const {
+        return &data_[rdhead_];
+    }
+
+    void read_commit() {
+        rdhead_ = (rdhead_ + stride_) % capacity();
+        balance_ -= stride_;
+        assert(balance_ >= 0);
+    }
+    // returns: the number of available *blocks* for writing
+    int32_t write_available() const {
+        if (stride_){
+            return (capacity() - balance_.load(std::memory_order_acquire)) / stride_;
+        } else {
+            return 0;
+        }
+    }
+
+    template<typename U>
+    void write(U&& value) {
+        data_[wrhead_] = std::forward<U>(value);
+        wrhead_ = (wrhead_ + 1) % capacity();
+        ++balance_;
+        assert(balance_ <= capacity());
+    }
+
+    T* write_data() {
+        return &data_[wrhead_];
+    }
+    // the most recently written block (only for the writer!)
+    const T* last_write_data() const {
+        return &data_[(wrhead_ + capacity() - stride_) % capacity()];
+    }
+
+    void write_commit() {
+        wrhead_ = (wrhead_ + stride_) % capacity();
+        balance_ += stride_;
+        assert(balance_ <= capacity());
+    }
+ private:
+    std::atomic<int32_t> balance_{0};
+    int32_t rdhead_{0};
+    int32_t wrhead_{0};
+    int32_t stride_{0};
+    std::vector<T> data_;
+};
+
+} // old
+} // aoo
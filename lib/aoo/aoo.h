@@ -18,6 +18,9 @@ extern "C"
 
 // these are bit masks to go in the least significant byte of the version
 #define AOO_PROTOCOL_FLAG_COMPACT_DATA 0x1 // supports compact data message
+#define AOO_PROTOCOL_FLAG_TIMESTAMP 0x2 // data messages carry the capture time stamp
+#define AOO_PROTOCOL_FLAG_BINARY_DATA 0x4 // supports binary data message
+#define AOO_PROTOCOL_FLAG_PROBE 0x8 // answers packet size probes
 
 #ifndef AOO_DEBUG_DLL
  #define AOO_DEBUG_DLL 0
@@ -73,6 +76,21 @@ extern "C"
  #define AOO_PING_INTERVAL 1000
 #endif
 
+// interval between packet size probes in ms
+#ifndef AOO_PROBE_INTERVAL
+ #define AOO_PROBE_INTERVAL 100
+#endif
+
+// max. number of attempts per probe size
+#ifndef AOO_PROBE_ATTEMPTS
+ #define AOO_PROBE_ATTEMPTS 2
+#endif
+
+// stop probing when the search range is smaller than this (in bytes)
+#ifndef AOO_PROBE_RESOLUTION
+ #define AOO_PROBE_RESOLUTION 32
+#endif
+
 // resend buffer size in ms
 #ifndef AOO_RESEND_BUFSIZE
  #define AOO_RESEND_BUFSIZE 1000
@@ -126,6 +144,16 @@ AOO_API void aoo_terminate(void);
 #define AOO_MSG_COMPACT_DATA_LEN 2
 #define AOO_MSG_CODEC_CHANGE "/codecchange"
 #define AOO_MSG_CODEC_CHANGE_LEN 12
+#define AOO_MSG_PROBE "/probe"
+#define AOO_MSG_PROBE_LEN 6
+
+// binary data message (see AOO_PROTOCOL_FLAG_BINARY_DATA)
+// the first byte contains the message type (high nibble) and
+// the header version (low nibble); it can never be confused
+// with an OSC message ('/') or bundle ('#').
+#define AOO_BINMSG_DATA 0xA0
+#define AOO_BINMSG_VERSION 2
+#define AOO_BINMSG_HEADERSIZE 8 // min. header size
 
 // id: the source or sink ID
 // returns: the offset to the remaining address pattern
@@ -141,6 +169,8 @@ typedef enum aoo_type
 
 // get the aoo_type and ID from an AoO OSC message, e.g. in /aoo/src/<id>/data
 // returns the offset on success, 0 on fail
+// NOTE: compact data messages return AOO_TYPE_SINK and AOO_ID_NONE;
+// binary data messages return 1 (there is no address pattern).
 AOO_API int32_t aoo_parse_pattern(const char *msg, int32_t n,
                                  int32_t *type, int32_t *id);
 
@@ -156,6 +186,66 @@ AOO_API uint64_t aoo_osctime_fromseconds(double s);
 // get time difference in seconds between two NTP timestamps
 AOO_API double aoo_osctime_duration(uint64_t t1, uint64_t t2);
 
+/*//////////////////// AoO scheduler /////////////////////*/
+
+// A fixed pool of worker threads which runs the non-realtime work
+// of many AoO objects, e.g. aoo_source_send() or aoo_sink_send(),
+// so you don't need dedicated threads for every object.
+// A task is never run concurrently with itself.
+
+#ifdef __cplusplus
+namespace aoo {
+    class scheduler;
+}
+using aoo_scheduler = aoo::scheduler;
+#else
+typedef struct aoo_scheduler aoo_scheduler;
+#endif
+
+// task function
+typedef void (*aoo_taskfn)(void *user);
+
+// max. number of tasks per scheduler
+#ifndef AOO_SCHEDULER_MAXTASKS
+ #define AOO_SCHEDULER_MAXTASKS 256
+#endif
+
+// scheduler flags
+#define AOO_SCHEDULER_REALTIME 0x1 // try to run workers with real-time priority
+
+// create a new scheduler with the given number of worker threads
+// (0: choose automatically)
+AOO_API aoo_scheduler * aoo_scheduler_new(int32_t nthreads, int32_t flags);
+
+// destroy the scheduler; all tasks must have been removed!
+AOO_API void aoo_scheduler_free(aoo_scheduler *s);
+
+// pin the worker threads to the given CPUs
+// returns 1 on success, 0 on failure (or if not supported)
+AOO_API int32_t aoo_scheduler_set_affinity(aoo_scheduler *s,
+                                           const int32_t *cpus, int32_t n);
+
+// add a task; returns the task ID or -1 on failure
+AOO_API int32_t aoo_scheduler_add_task(aoo_scheduler *s, aoo_taskfn fn, void *user);
+
+// remove a task; blocks until the task is not running anymore
+AOO_API void aoo_scheduler_remove_task(aoo_scheduler *s, int32_t task);
+
+// schedule a task to run on one of the worker threads (realtime safe).
+// multiple notifications are coalesced while the task is pending.
+AOO_API void aoo_scheduler_notify(aoo_scheduler *s, int32_t task);
+
+/*//////////////////// AoO threads /////////////////////*/
+
+// pin the calling thread (e.g. your network thread) to the given CPUs.
+// returns 1 on success, 0 on failure (or if not supported)
+AOO_API int32_t aoo_set_thread_affinity(const int32_t *cpus, int32_t n);
+
+// get the NUMA node of the CPU the calling thread is running on
+// or -1 if unknown. Call this on the audio thread and pass the result
+// to aoo_opt_numa_node, see below.
+AOO_API int32_t aoo_get_numa_node(void);
+
 /*//////////////////// AoO events /////////////////////*/
 
 #define AOO_EVENTQUEUESIZE 64
@@ -301,7 +391,13 @@ typedef enum aoo_option
     // have less overhead. If a audio block exceeds
     // the max. UDP packet size, it will be automatically
     // broken up into several "frames" in reassembled
-    // in the sink.
+    // in the sink. The max. value is AOO_MAXUDPPACKETSIZE;
+    // the receiving side must be able to receive packets
+    // of this size, see aoo_transport.
+    // This is also a sink option for sources: it overrides
+    // the packet size for a specific sink and stops probing
+    // (see aoo_opt_probe_packetsize). Set to 0 to go back to
+    // the source packet size.
     aoo_opt_packetsize,
     // Ping interval in ms (int32_t)
     // ---
@@ -354,7 +450,48 @@ typedef enum aoo_option
     // For sources, respect codec change requests from a sink : (int32_t) 0 or 1
     // ---
     // If > 0 the source will change its codec immediately when requested to by a remote sink
-    aoo_opt_respect_codec_change_requests
+    aoo_opt_respect_codec_change_requests,
+    // Encoder tier (int32_t)
+    // ---
+    // This is a sink option for sources. A source can encode
+    // the same audio block with up to AOO_MAXNUMTIERS different
+    // formats (see aoo_source_set_tier_format()) and each sink
+    // receives the tier it has been assigned to. The default is 0
+    // (= the source format). Sinks which are assigned to an unused
+    // tier fall back to tier 0.
+    aoo_opt_tier,
+    // NUMA node (int32_t)
+    // ---
+    // Allocate the audio queues on the given NUMA node, so that the audio
+    // thread doesn't have to access remote memory. This should be the
+    // node of the audio thread (see aoo_get_numa_node()).
+    // -1 means no preference (the default). Only supported on Linux.
+    aoo_opt_numa_node,
+    // Multicast (int32_t) 0 or 1
+    // ---
+    // This is a sink option for sources. If enabled, the sink receives
+    // the audio data via the multicast group of the source (see
+    // aoo_source_set_multicast()) instead of its own unicast copy;
+    // format messages, pings and resend requests stay unicast.
+    // All sinks in the group on the same tier share a single packet.
+    // Every group member receives all packets of the group, so the
+    // group only carries channel onset 0; sinks with another channel
+    // onset are sent to directly (with a warning). The sink must join
+    // the group, see aoo_transport_join_group().
+    aoo_opt_multicast,
+    // Max. probe packet size in bytes (int32_t)
+    // ---
+    // If > 0, the source probes each (unicast) sink with
+    // increasingly large /probe messages, starting from
+    // aoo_opt_packetsize, and uses the largest size that
+    // the sink has answered for the data sent to it.
+    // This way sinks in the local network can get large frames
+    // while sinks in the internet stay below the path MTU.
+    // Probing only makes sense if IP fragmentation is disabled
+    // on the socket, see aoo_transport_set_dontfragment().
+    // The search is restarted whenever this option is set.
+    // The default is 0 (= no probing).
+    aoo_opt_probe_packetsize
 } aoo_option;
 
 #define AOO_ARG(x) &x, sizeof(x)
@@ -415,6 +552,8 @@ AOO_API int32_t aoo_source_send(aoo_source *src);
 // data:        array of channel data (non-interleaved)
 // nsamples:    number of samples per channel
 // t:           current NTP timestamp (see aoo_osctime_get)
+// returns 1 if new blocks are ready and the send thread should be woken up.
+// Wakeups are coalesced: further calls return 0 until aoo_source_send() has run.
 AOO_API int32_t aoo_source_process(aoo_source *src, const aoo_sample **data,
                            int32_t nsamples, uint64_t t);
 
@@ -437,6 +576,27 @@ AOO_API int32_t aoo_source_set_sinkoption(aoo_source *src, void *endpoint, int32
 AOO_API int32_t aoo_source_get_sinkoption(aoo_source *src, void *endpoint, int32_t id,
                                  int32_t opt, void *p, int32_t size);
 
+// max. number of encoder tiers (including the source format)
+#define AOO_MAXNUMTIERS 4
+
+// set the format of an additional encoder tier (always threadsafe)
+// tier:    1 to AOO_MAXNUMTIERS - 1 (tier 0 is the source format, see aoo_opt_format)
+// f:       the format or NULL (= remove the tier)
+// NOTE: all tiers are fed with the same audio blocks, so the number of channels,
+// samplerate and blocksize are always taken from the source format.
+AOO_API int32_t aoo_source_set_tier_format(aoo_source *src, int32_t tier, aoo_format *f);
+
+// get the format of an encoder tier (always threadsafe)
+AOO_API int32_t aoo_source_get_tier_format(aoo_source *src, int32_t tier, aoo_format_storage *f);
+
+// set the multicast group endpoint (always threadsafe)
+// group:   the endpoint of the multicast group address or NULL (= disable)
+// fn:      the reply function for the group endpoint
+// Audio data for all sinks with aoo_opt_multicast is sent once to the group.
+// Resend requests for the same frame from several of these sinks are
+// answered with a single packet to the group as well.
+AOO_API int32_t aoo_source_set_multicast(aoo_source *src, void *group, aoo_replyfn fn);
+
 // wrapper functions for frequently used options
 
 static inline int32_t aoo_source_start(aoo_source *src) {
@@ -511,6 +671,22 @@ static inline int32_t aoo_source_get_redundancy(aoo_source *src, int32_t *n) {
     return aoo_source_get_option(src, aoo_opt_redundancy, AOO_ARG(*n));
 }
 
+static inline int32_t aoo_source_set_numa_node(aoo_source *src, int32_t node) {
+    return aoo_source_set_option(src, aoo_opt_numa_node, AOO_ARG(node));
+}
+
+static inline int32_t aoo_source_get_numa_node(aoo_source *src, int32_t *node) {
+    return aoo_source_get_option(src, aoo_opt_numa_node, AOO_ARG(*node));
+}
+
+static inline int32_t aoo_source_set_probe_packetsize(aoo_source *src, int32_t n) {
+    return aoo_source_set_option(src, aoo_opt_probe_packetsize, AOO_ARG(n));
+}
+
+static inline int32_t aoo_source_get_probe_packetsize(aoo_source *src, int32_t *n) {
+    return aoo_source_get_option(src, aoo_opt_probe_packetsize, AOO_ARG(*n));
+}
+
 static inline int32_t aoo_source_set_sink_channelonset(aoo_source *src, void *endpoint, int32_t id, int32_t onset) {
     return aoo_source_set_sinkoption(src, endpoint, id, aoo_opt_channelonset, AOO_ARG(onset));
 }
@@ -519,6 +695,30 @@ static inline int32_t aoo_source_get_sink_channelonset(aoo_source *src, void *en
     return aoo_source_get_sinkoption(src, endpoint, id, aoo_opt_channelonset, AOO_ARG(*onset));
 }
 
+static inline int32_t aoo_source_set_sink_tier(aoo_source *src, void *endpoint, int32_t id, int32_t tier) {
+    return aoo_source_set_sinkoption(src, endpoint, id, aoo_opt_tier, AOO_ARG(tier));
+}
+
+static inline int32_t aoo_source_get_sink_tier(aoo_source *src, void *endpoint, int32_t id, int32_t *tier) {
+    return aoo_source_get_sinkoption(src, endpoint, id, aoo_opt_tier, AOO_ARG(*tier));
+}
+
+static inline int32_t aoo_source_set_sink_multicast(aoo_source *src, void *endpoint, int32_t id, int32_t b) {
+    return aoo_source_set_sinkoption(src, endpoint, id, aoo_opt_multicast, AOO_ARG(b));
+}
+
+static inline int32_t aoo_source_get_sink_multicast(aoo_source *src, void *endpoint, int32_t id, int32_t *b) {
+    return aoo_source_get_sinkoption(src, endpoint, id, aoo_opt_multicast, AOO_ARG(*b));
+}
+
+static inline int32_t aoo_source_set_sink_packetsize(aoo_source *src, void *endpoint, int32_t id, int32_t n) {
+    return aoo_source_set_sinkoption(src, endpoint, id, aoo_opt_packetsize, AOO_ARG(n));
+}
+
+static inline int32_t aoo_source_get_sink_packetsize(aoo_source *src, void *endpoint, int32_t id, int32_t *n) {
+    return aoo_source_get_sinkoption(src, endpoint, id, aoo_opt_packetsize, AOO_ARG(*n));
+}
+
 /*//////////////////// AoO sink /////////////////////*/
 
 #ifdef __cplusplus
@@ -641,6 +841,14 @@ static inline int32_t aoo_sink_get_resend_maxnumframes(aoo_sink *sink, int32_t *
     return aoo_sink_get_option(sink, aoo_opt_resend_maxnumframes, AOO_ARG(*n));
 }
 
+static inline int32_t aoo_sink_set_numa_node(aoo_sink *sink, int32_t node) {
+    return aoo_sink_set_option(sink, aoo_opt_numa_node, AOO_ARG(node));
+}
+
+static inline int32_t aoo_sink_get_numa_node(aoo_sink *sink, int32_t *node) {
+    return aoo_sink_get_option(sink, aoo_opt_numa_node, AOO_ARG(*node));
+}
+
 static inline int32_t aoo_sink_reset_source(aoo_sink *sink, void *endpoint, int32_t id) {
     return aoo_sink_set_sourceoption(sink, endpoint, id, aoo_opt_reset, AOO_ARG_NULL);
 }
@@ -649,6 +857,96 @@ static inline int32_t aoo_sink_get_source_format(aoo_sink *sink, void *endpoint,
     return aoo_sink_get_sourceoption(sink, endpoint, id, aoo_opt_format, AOO_ARG(*f));
 }
 
+/*//////////////////// AoO transport /////////////////////*/
+
+// An optional UDP transport which owns a socket and the endpoints
+// and dispatches incoming messages to the registered sources and sinks,
+// so you don't have to write your own network code.
+// On Linux, it uses epoll and batches packets with recvmmsg()/sendmmsg().
+// Build with AOO_USE_IO_URING=1 to use io_uring instead (multishot receive
+// into kernel-registered buffers, one system call per send batch).
+// The transport can receive packets up to AOO_MAXUDPPACKETSIZE bytes.
+
+#ifdef __cplusplus
+namespace aoo {
+    class transport;
+}
+using aoo_transport = aoo::transport;
+#else
+typedef struct aoo_transport aoo_transport;
+#endif
+
+// max. number of packets per recvmmsg()/sendmmsg() call
+#ifndef AOO_TRANSPORT_BATCHSIZE
+ #define AOO_TRANSPORT_BATCHSIZE 32
+#endif
+
+// max. time between two send rounds (ms)
+#ifndef AOO_TRANSPORT_INTERVAL
+ #define AOO_TRANSPORT_INTERVAL 5
+#endif
+
+// create a new transport with a UDP socket bound to the given port
+AOO_API aoo_transport * aoo_transport_new(int32_t port, int32_t *err);
+
+// destroy the transport; aoo_transport_run() must have returned!
+AOO_API void aoo_transport_free(aoo_transport *t);
+
+// run the network loop on the calling thread; blocks until
+// aoo_transport_quit() is called. Incoming messages are dispatched
+// to the sources and sinks, followed by a send round.
+AOO_API int32_t aoo_transport_run(aoo_transport *t);
+
+// stop the network loop (always threadsafe)
+AOO_API void aoo_transport_quit(aoo_transport *t);
+
+// wake up the network loop for a send round (realtime safe),
+// e.g. when aoo_source_process() returns 1
+AOO_API void aoo_transport_notify(aoo_transport *t);
+
+// add/remove sources and sinks (always threadsafe, but not from within the network loop)
+AOO_API int32_t aoo_transport_add_source(aoo_transport *t, aoo_source *src);
+
+AOO_API int32_t aoo_transport_remove_source(aoo_transport *t, aoo_source *src);
+
+AOO_API int32_t aoo_transport_add_sink(aoo_transport *t, aoo_sink *sink);
+
+AOO_API int32_t aoo_transport_remove_sink(aoo_transport *t, aoo_sink *sink);
+
+// get the endpoint for the given socket address (always threadsafe),
+// e.g. for aoo_source_add_sink() together with aoo_transport_send().
+// Endpoints stay valid for the lifetime of the transport.
+AOO_API void * aoo_transport_get_endpoint(aoo_transport *t,
+                                          const void *address, int32_t addrlen);
+
+// the reply function for transport endpoints
+AOO_API int32_t aoo_transport_send(void *endpoint, const char *data, int32_t n);
+
+// join/leave a multicast group (always threadsafe), e.g. to receive
+// audio data from a source with a multicast group (see aoo_source_set_multicast()).
+// The port of the address is ignored, the source must send to the port
+// of this transport. Only IPv4 is supported.
+AOO_API int32_t aoo_transport_join_group(aoo_transport *t,
+                                         const void *address, int32_t addrlen);
+
+AOO_API int32_t aoo_transport_leave_group(aoo_transport *t,
+                                          const void *address, int32_t addrlen);
+
+// bundle the outgoing messages of a send round (always threadsafe):
+// all messages for the same endpoint, e.g. from several sources, are
+// packed into OSC bundles of up to 'maxsize' bytes, so that they need
+// less datagrams. 0 disables bundling (default).
+// NOTE: the receiver must be able to unpack the bundles; this is done
+// by the AoO transport and the Pd objects.
+AOO_API void aoo_transport_set_bundling(aoo_transport *t, int32_t maxsize);
+
+// set the "don't fragment" bit on all outgoing (IPv4) packets (always threadsafe).
+// Packets which exceed the path MTU are dropped instead of fragmented,
+// which is required for packet size probing (see aoo_opt_probe_packetsize).
+// NOTE: only enable this together with probing or with a safe packet size!
+// Returns 0 if not supported on this platform.
+AOO_API int32_t aoo_transport_set_dontfragment(aoo_transport *t, int32_t b);
+
 /*//////////////////// Codec API //////////////////////////*/
 
 #define AOO_CODEC_MAXSETTINGSIZE 256
@@ -70,6 +70,8 @@ public:
     // data:        array of channel data (non-interleaved)
     // nsamples:    number of samples per channel
     // t:           current NTP timestamp (see aoo_osctime_get)
+    // returns 1 if new blocks are ready and the send thread should be woken up.
+    // Wakeups are coalesced: further calls return 0 until send() has run.
     virtual int32_t process(const aoo_sample **data,
                             int32_t nsamples, uint64_t t) = 0;
 
@@ -167,10 +169,31 @@ public:
         return set_option(aoo_opt_respect_codec_change_requests, AOO_ARG(n));
     }
 
+    int32_t set_numa_node(int32_t node){
+        return set_option(aoo_opt_numa_node, AOO_ARG(node));
+    }
+
+    int32_t get_numa_node(int32_t& node){
+        return get_option(aoo_opt_numa_node, AOO_ARG(node));
+    }
+
     
     virtual int32_t set_option(int32_t opt, void *ptr, int32_t size) = 0;
     virtual int32_t get_option(int32_t opt, void *ptr, int32_t size) = 0;
 
+    //--------------------- encoder tiers -------------------------//
+    // set/get the format of additional encoder tiers (always threadsafe)
+    // NOTE: tier 0 is the source format; pass nullptr to remove a tier.
+
+    virtual int32_t set_tier_format(int32_t tier, aoo_format *f) = 0;
+    virtual int32_t get_tier_format(int32_t tier, aoo_format_storage& f) = 0;
+
+    //--------------------- multicast -----------------------------//
+    // set the multicast group endpoint (always threadsafe)
+    // NOTE: pass nullptr to disable multicast.
+
+    virtual int32_t set_multicast(void *group, aoo_replyfn fn) = 0;
+
     //--------------------- sink options --------------------------//
     // set/get sink options (always threadsafe)
 
@@ -182,6 +205,22 @@ public:
         return get_sinkoption(endpoint, id, aoo_opt_channelonset, AOO_ARG(onset));
     }
 
+    int32_t set_sink_tier(void *endpoint, int32_t id, int32_t tier){
+        return set_sinkoption(endpoint, id, aoo_opt_tier, AOO_ARG(tier));
+    }
+
+    int32_t get_sink_tier(void *endpoint, int32_t id, int32_t& tier){
+        return get_sinkoption(endpoint, id, aoo_opt_tier, AOO_ARG(tier));
+    }
+
+    int32_t set_sink_multicast(void *endpoint, int32_t id, int32_t n){
+        return set_sinkoption(endpoint, id, aoo_opt_multicast, AOO_ARG(n));
+    }
+
+    int32_t get_sink_multicast(void *endpoint, int32_t id, int32_t& n){
+        return get_sinkoption(endpoint, id, aoo_opt_multicast, AOO_ARG(n));
+    }
+
     virtual int32_t set_sinkoption(void *endpoint, int32_t id,
                                    int32_t opt, void *ptr, int32_t size) = 0;
     virtual int32_t get_sinkoption(void *endpoint, int32_t id,
@@ -317,6 +356,14 @@ public:
         return get_option(aoo_opt_resend_maxnumframes, AOO_ARG(n));
     }
 
+    int32_t set_numa_node(int32_t node){
+        return set_option(aoo_opt_numa_node, AOO_ARG(node));
+    }
+
+    int32_t get_numa_node(int32_t& node){
+        return get_option(aoo_opt_numa_node, AOO_ARG(node));
+    }
+
     virtual int32_t set_option(int32_t opt, void *ptr, int32_t size) = 0;
     virtual int32_t get_option(int32_t opt, void *ptr, int32_t size) = 0;
 
@@ -36,7 +36,12 @@ extern "C"
 #define AOO_MSG_DOMAIN "/aoo"
 #define AOO_MSG_DOMAIN_LEN 4
 
-#define AOO_MAXPACKETSIZE 4096 // ?
+// max. size of control messages and default size of packet buffers
+#define AOO_MAXPACKETSIZE 4096
+
+// max. UDP payload; upper limit for aoo_opt_packetsize, e.g.
+// for sending large blocks in a single jumbo datagram on a LAN.
+#define AOO_MAXUDPPACKETSIZE 65507
 
 #ifndef AOO_SAMPLETYPE
 #define AOO_SAMPLETYPE float
@@ -65,6 +70,9 @@ typedef struct aoo_event
     int32_t type;
 } aoo_event;
 
+// max. number of events passed to an event handler at once
+#define AOO_EVENTBATCHSIZE 16
+
 // event handler
 typedef int32_t (*aoo_eventhandler)(
         void *,             // user
@@ -166,7 +166,7 @@ aoo::net::client::client(void *udpsocket, aoo_sendfn fn, int port)
     }
 #endif
     commands_.resize(256, 1);
-    events_.resize(256, 1);
+    events_.resize(256);
     sendbuffer_.setup(65536);
     recvbuffer_.setup(65536);
     
@@ -499,7 +499,7 @@ int32_t aoonet_client_events_available(aoonet_server *client){
 }
 
 int32_t aoo::net::client::events_available(){
-    return 1;
+    return events_.size() > 0;
 }
 
 int32_t aoonet_client_handle_events(aoonet_client *client, aoo_eventhandler fn, void *user){
@@ -508,25 +508,36 @@ int32_t aoonet_client_handle_events(aoonet_client *client, aoo_eventhandler fn,
 
 int32_t aoo::net::client::handle_events(aoo_eventhandler fn, void *user){
     // always thread-safe
-    auto n = events_.read_available();
-    if (n > 0){
-        // copy events
-        auto events = (ievent **)alloca(sizeof(ievent *) * n);
-        auto vec = (const aoo_event **)alloca(sizeof(aoo_event *) * n); // adjusted pointers
-        for (int i = 0; i < n; ++i){
-            std::unique_ptr<ievent> ptr;
-            events_.read(ptr);
-            events[i] = ptr.release(); // get raw pointer
-            vec[i] = &events[i]->event_; // adjust pointer
+    auto dropped = events_.dropped();
+    if (dropped > 0){
+        LOG_WARNING("aoo_client: event queue full, dropped " << dropped << " events");
+    }
+    auto n = events_.size();
+    int32_t total = 0;
+    // copy events in batches of fixed size
+    while (total < n){
+        ievent *events[AOO_EVENTBATCHSIZE];
+        const aoo_event *vec[AOO_EVENTBATCHSIZE]; // adjusted pointers
+        int32_t count = 0;
+        std::unique_ptr<ievent> ptr;
+        while (count < AOO_EVENTBATCHSIZE && total + count < n
+               && events_.pop(ptr)){
+            events[count] = ptr.release(); // get raw pointer
+            vec[count] = &events[count]->event_; // adjust pointer
+            count++;
+        }
+        if (count == 0){
+            break;
         }
         // send events
-        fn(user, vec, n);
+        fn(user, vec, count);
         // manually free events
-        for (int i = 0; i < n; ++i){
+        for (int i = 0; i < count; ++i){
             delete events[i];
         }
+        total += count;
     }
-    return n;
+    return total;
 }
 
 namespace aoo {
@@ -716,10 +727,7 @@ void client::send_message_udp(const char *data, int32_t size, const ip_address&
 
 void client::push_event(std::unique_ptr<ievent> e)
 {
-    scoped_lock<spinlock> lock(event_lock_);
-    if (events_.write_available()){
-        events_.write(std::move(e));
-    }
+    events_.push(std::move(e));
 }
 
 void client::wait_for_event(float timeout){
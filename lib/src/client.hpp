@@ -199,8 +199,7 @@ private:
         }
     }
     // events
-    lockfree::queue<std::unique_ptr<ievent>> events_;
-    spinlock event_lock_;
+    lockfree::mpsc_queue<std::unique_ptr<ievent>> events_;
     // signal
     std::atomic<bool> quit_{false};
 #ifdef _WIN32
@@ -71,6 +71,14 @@ int32_t aoo_parse_pattern(const char *msg, int32_t n,
                          int32_t *type, int32_t *id)
 {
     int32_t offset = 0;
+    // special case the binary data message
+    if (aoo::is_binary_data(msg, n)){
+        if (!aoo::read_binary_data_sink(msg, n, *id)){
+            return 0;
+        }
+        *type = AOO_TYPE_SINK;
+        return 1;
+    }
     // special case the compact data message which doesn't use the aoo domain
     if (n >= AOO_MSG_COMPACT_DATA_LEN
         && !memcmp(msg, AOO_MSG_COMPACT_DATA, AOO_MSG_COMPACT_DATA_LEN)) 
@@ -98,23 +106,314 @@ int32_t aoo_parse_pattern(const char *msg, int32_t n,
             return 0;
         }
 
-        if (!memcmp(msg + offset, "/*", 2)){
+        if (n >= (offset + AOO_MSG_WILDCARD_LEN)
+            && !memcmp(msg + offset, AOO_MSG_WILDCARD, AOO_MSG_WILDCARD_LEN))
+        {
             *id = AOO_ID_WILDCARD; // wildcard
-            return offset + 2;
+            return offset + AOO_MSG_WILDCARD_LEN;
         }
-        int32_t skip = 0;
-        if (sscanf(msg + offset, "/%d%n", id, &skip) > 0){
-            return offset + skip;
-        } else {
-            // TODO only print relevant part of OSC address string
-            LOG_ERROR("aoo_parsepattern: bad ID " << msg + offset);
-            return 0;
+        // parse the ID by hand; this is much faster than sscanf()
+        // and never reads past the end of the packet.
+        auto p = msg + offset;
+        auto end = msg + n;
+        if (p < end && *p == '/'){
+            p++;
+            bool neg = false;
+            if (p < end && *p == '-'){
+                neg = true;
+                p++;
+            }
+            int64_t value = 0;
+            auto start = p;
+            while (p < end && *p >= '0' && *p <= '9' && value <= INT32_MAX){
+                value = value * 10 + (*p - '0');
+                p++;
+            }
+            if (p > start && value <= INT32_MAX){
+                *id = neg ? -value : value;
+                return p - msg;
+            }
         }
+        // TODO only print relevant part of OSC address string
+        LOG_ERROR("aoo_parsepattern: bad ID " << msg + offset);
+        return 0;
     } else {
         return 0; // not an AoO message
     }
 }
 
+namespace aoo {
+
+// match the pattern against a message name by length and first character,
+// so we only need a single memcmp() per message.
+msg_type parse_msg_type(const char *msg, int32_t n, int32_t onset){
+    auto pattern = msg + onset;
+    // the address pattern is null terminated; we only have to look
+    // as far as the longest message name.
+    auto maxlen = std::min<int32_t>(n - onset, AOO_MSG_CODEC_CHANGE_LEN + 1);
+    if (maxlen <= 1 || pattern[0] != '/'){
+        return msg_type::unknown;
+    }
+    auto end = (const char *)memchr(pattern, 0, maxlen);
+    if (!end){
+        return msg_type::unknown;
+    }
+    auto len = end - pattern;
+
+#define AOO_MATCH(name) !memcmp(pattern, AOO_MSG_##name, AOO_MSG_##name##_LEN)
+    switch (len){
+    case AOO_MSG_DATA_LEN: // == AOO_MSG_PING_LEN
+        if (pattern[1] == 'd' && AOO_MATCH(DATA)){
+            return msg_type::data;
+        } else if (pattern[1] == 'p' && AOO_MATCH(PING)){
+            return msg_type::ping;
+        }
+        break;
+    case AOO_MSG_PROBE_LEN:
+        if (AOO_MATCH(PROBE)){
+            return msg_type::probe;
+        }
+        break;
+    case AOO_MSG_FORMAT_LEN: // == AOO_MSG_INVITE_LEN
+        if (pattern[1] == 'f' && AOO_MATCH(FORMAT)){
+            return msg_type::format;
+        } else if (pattern[1] == 'i' && AOO_MATCH(INVITE)){
+            return msg_type::invite;
+        }
+        break;
+    case AOO_MSG_UNINVITE_LEN:
+        if (AOO_MATCH(UNINVITE)){
+            return msg_type::uninvite;
+        }
+        break;
+    case AOO_MSG_CODEC_CHANGE_LEN:
+        if (AOO_MATCH(CODEC_CHANGE)){
+            return msg_type::codec_change;
+        }
+        break;
+    default:
+        break;
+    }
+#undef AOO_MATCH
+    return msg_type::unknown;
+}
+
+/*//////////////////// packet buffer /////////////////////////*/
+
+struct alignas(CACHELINE_SIZE) packet_buffer {
+    char data[AOO_MAXPACKETSIZE];
+};
+
+static thread_local packet_buffer t_packet_buffer;
+// for packets larger than AOO_MAXPACKETSIZE (only grows)
+static thread_local std::unique_ptr<char[]> t_large_buffer;
+static thread_local int32_t t_large_buffer_size = 0;
+static thread_local packet_buffer_hook t_packet_buffer_hook = nullptr;
+static thread_local void *t_packet_buffer_user = nullptr;
+
+char * get_packet_buffer(int32_t& size, int32_t minsize){
+    if (t_packet_buffer_hook){
+        auto buf = t_packet_buffer_hook(t_packet_buffer_user, minsize, size);
+        if (buf){
+            return buf;
+        }
+    }
+    if (minsize <= (int32_t)sizeof(t_packet_buffer.data)){
+        size = sizeof(t_packet_buffer.data);
+        return t_packet_buffer.data;
+    }
+    if (minsize > t_large_buffer_size){
+        // over-allocate so we can align to the cache line
+        t_large_buffer.reset(new char[minsize + CACHELINE_SIZE]);
+        t_large_buffer_size = minsize;
+    }
+    auto addr = (uintptr_t)t_large_buffer.get();
+    auto aligned = (addr + CACHELINE_SIZE - 1) & ~(uintptr_t)(CACHELINE_SIZE - 1);
+    size = t_large_buffer_size;
+    return t_large_buffer.get() + (aligned - addr);
+}
+
+void set_packet_buffer_hook(packet_buffer_hook fn, void *user){
+    t_packet_buffer_hook = fn;
+    t_packet_buffer_user = user;
+}
+
+/*//////////////////// binary data message ///////////////////*/
+
+// <type|version> <flags> <sink> <salt> <seq> [<totalsize> <nframes> <frame>]
+// [<channel>] [<samplerate>] [<time>] <data...>
+//
+// salt: int32, samplerate: float64 and time: uint32 (all big endian);
+// the remaining numbers are unsigned LEB128 varints.
+// The sink ID is stored as ID + 1, so that the wildcard becomes 0.
+// The data size is implied by the packet size.
+//
+// The capture time is sent in the 32-bit NTP short format (16 bits seconds,
+// 16 bits fraction = ~15 us resolution) and the receiver restores the missing
+// upper bits from its own clock, see expand_time(). A delta to the previous
+// block would be smaller, but it can't be decoded after a lost packet.
+// The header is 8-10 bytes for a typical single-frame block (+ 4 bytes
+// with the capture time).
+
+enum binmsg_flags {
+    BINMSG_FRAMES = 0x01,
+    BINMSG_CHANNEL = 0x02,
+    BINMSG_SAMPLERATE = 0x04,
+    BINMSG_TIMESTAMP = 0x08
+};
+
+static char * write_varint(char *p, uint32_t i){
+    while (i >= 0x80){
+        *p++ = (char)((i & 0x7f) | 0x80);
+        i >>= 7;
+    }
+    *p++ = (char)i;
+    return p;
+}
+
+static const char * read_varint(const char *p, const char *end, int32_t& result){
+    uint32_t i = 0;
+    for (int shift = 0; p < end && shift < 32; shift += 7){
+        auto c = (uint8_t)*p++;
+        i |= (uint32_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)){
+            if (i > INT32_MAX){
+                return nullptr;
+            }
+            result = i;
+            return p;
+        }
+    }
+    return nullptr; // truncated or too large
+}
+
+// restore a 32-bit NTP short time stamp relative to the given (full) time.
+// The result is the value closest to 'ref'; this works as long as both
+// clocks differ by less than 9 hours.
+static uint64_t expand_time(uint32_t t, uint64_t ref){
+    const uint64_t range = (uint64_t)1 << 48;
+    uint64_t result = (ref & ~(range - 1)) | ((uint64_t)t << 16);
+    auto diff = (int64_t)(result - ref);
+    if (diff > (int64_t)(range / 2)){
+        result -= range;
+    } else if (diff < -(int64_t)(range / 2)){
+        result += range;
+    }
+    return result;
+}
+
+bool is_binary_data(const char *msg, int32_t n){
+    return n >= AOO_BINMSG_HEADERSIZE
+            && (uint8_t)msg[0] == (AOO_BINMSG_DATA | AOO_BINMSG_VERSION);
+}
+
+bool read_binary_data_sink(const char *msg, int32_t n, int32_t& id){
+    if (!is_binary_data(msg, n) || !read_varint(msg + 2, msg + n, id)){
+        return false;
+    }
+    id -= 1;
+    return true;
+}
+
+int32_t write_binary_data(char *buf, int32_t size, int32_t sink, int32_t salt,
+                          const data_packet& d, bool sendrate)
+{
+    // max. header size: 2 bytes + salt + 6 varints + samplerate + time
+    const int32_t maxheadersize = 2 + 4 + 6 * 5 + 8 + 4;
+    if (d.size > (size - maxheadersize) || d.sequence < 0 || d.channel < 0
+            || sink < AOO_ID_WILDCARD || sink == INT32_MAX){
+        return 0;
+    }
+    bool frames = d.nframes != 1 || d.framenum != 0 || d.totalsize != d.size;
+
+    auto p = buf;
+    *p++ = (char)(AOO_BINMSG_DATA | AOO_BINMSG_VERSION);
+    *p++ = (char)((frames ? BINMSG_FRAMES : 0)
+                  | (d.channel ? BINMSG_CHANNEL : 0)
+                  | (sendrate ? BINMSG_SAMPLERATE : 0)
+                  | (d.timestamp ? BINMSG_TIMESTAMP : 0));
+    p = write_varint(p, sink + 1);
+    aoo::to_bytes<int32_t>(salt, p);
+    p += 4;
+    p = write_varint(p, d.sequence);
+    if (frames){
+        p = write_varint(p, d.totalsize);
+        p = write_varint(p, d.nframes);
+        p = write_varint(p, d.framenum);
+    }
+    if (d.channel){
+        p = write_varint(p, d.channel);
+    }
+    if (sendrate){
+        aoo::to_bytes<double>(d.samplerate, p);
+        p += 8;
+    }
+    if (d.timestamp){
+        aoo::to_bytes<uint32_t>((uint32_t)(d.timestamp >> 16), p);
+        p += 4;
+    }
+    if (d.size > 0){
+        memcpy(p, d.data, d.size);
+        p += d.size;
+    }
+    return p - buf;
+}
+
+bool read_binary_data(const char *msg, int32_t n, int32_t& salt, data_packet& d){
+    if (!is_binary_data(msg, n)){
+        return false;
+    }
+    auto end = msg + n;
+    auto flags = (uint8_t)msg[1];
+    int32_t sink;
+    auto p = read_varint(msg + 2, end, sink); // see read_binary_data_sink()
+    if (!p || (end - p) < 4){
+        return false;
+    }
+    salt = aoo::from_bytes<int32_t>(p);
+    p = read_varint(p + 4, end, d.sequence);
+    if (flags & BINMSG_FRAMES){
+        if (p) p = read_varint(p, end, d.totalsize);
+        if (p) p = read_varint(p, end, d.nframes);
+        if (p) p = read_varint(p, end, d.framenum);
+    }
+    d.channel = 0;
+    if (p && (flags & BINMSG_CHANNEL)){
+        p = read_varint(p, end, d.channel);
+    }
+    d.samplerate = 0; // marker to use last
+    if (p && (flags & BINMSG_SAMPLERATE)){
+        if ((end - p) < 8){
+            return false;
+        }
+        d.samplerate = aoo::from_bytes<double>(p);
+        p += 8;
+    }
+    d.timestamp = 0;
+    if (p && (flags & BINMSG_TIMESTAMP)){
+        if ((end - p) < 4){
+            return false;
+        }
+        d.timestamp = expand_time(aoo::from_bytes<uint32_t>(p),
+                                  time_tag::now().to_uint64());
+        p += 4;
+    }
+    if (!p){
+        LOG_ERROR("aoo: bad binary data message");
+        return false;
+    }
+    d.data = p;
+    d.size = end - p;
+    if (!(flags & BINMSG_FRAMES)){
+        d.totalsize = d.size;
+        d.nframes = 1;
+        d.framenum = 0;
+    }
+    return true;
+}
+
+} // aoo
+
 // OSC time stamp (NTP time)
 uint64_t aoo_osctime_get(void){
     return aoo::time_tag::now().to_uint64();
@@ -149,6 +448,35 @@ bool encoder::set_format(aoo_format& fmt){
     }
 }
 
+int32_t encoder::max_encoded_size() const {
+    auto nsamples = nchannels_ * blocksize_;
+    aoo_format_storage f;
+    if (get_format(f)){
+        if (!strcmp(f.header.codec, AOO_CODEC_PCM)){
+            switch (reinterpret_cast<aoo_format_pcm&>(f).bitdepth){
+            case AOO_PCM_INT16:
+                return nsamples * 2;
+            case AOO_PCM_INT24:
+                return nsamples * 3;
+            case AOO_PCM_FLOAT32:
+                return nsamples * 4;
+            default:
+                break;
+            }
+        }
+    #if USE_CODEC_OPUS
+        if (!strcmp(f.header.codec, AOO_CODEC_OPUS)){
+            // max. 1275 bytes per 20 ms frame and stream (510 kbit/s) plus
+            // framing overhead; the encoder never exceeds the buffer size.
+            auto nframes = (blocksize_ * 50 + samplerate_ - 1) / samplerate_;
+            return nchannels_ * (nframes * (1275 + 2) + 8);
+        }
+    #endif
+    }
+    // unknown codec (or 64-bit PCM)
+    return sizeof(double) * nsamples;
+}
+
 int32_t encoder::read_format(const aoo_format& fmt, const char *buf, int32_t size){
     aoo_format_storage nfmt;
     memcpy(&nfmt.header, &fmt, sizeof(aoo_format));
@@ -302,11 +630,12 @@ bool block::has_frame(int32_t which) const {
 /*////////////////////////// block_ack /////////////////////////////*/
 
 block_ack::block_ack()
-    : sequence(EMPTY), count_(0), timestamp_(-1e009){}
+    : sequence(EMPTY), count_(0), attempts_(0), timestamp_(-1e009){}
 
 block_ack::block_ack(int32_t seq, int32_t limit)
     : sequence(seq) {
     count_ = limit;
+    attempts_ = 0;
     timestamp_ = -1e009;
 }
 
@@ -316,6 +645,7 @@ bool block_ack::update(double time, double interval){
         if (diff >= interval){
             timestamp_ = time;
             count_--;
+            attempts_++;
             LOG_DEBUG("request block " << sequence);
             return true;
         } else {
@@ -613,73 +943,150 @@ std::ostream& operator<<(std::ostream& os, const block_ack_list& b){
 /*////////////////////////// history_buffer ///////////////////////////*/
 
 void history_buffer::clear(){
-    head_ = 0;
-    oldest_ = -1;
-    for (auto& block : buffer_){
-        block.sequence = -1;
+    head_.store(0);
+    oldest_.store(-1);
+    for (int32_t i = 0; i < size_; ++i){
+        slots_[i].sequence.store(-1);
     }
 }
 
-int32_t history_buffer::capacity() const {
-    return buffer_.size();
-}
-
-void history_buffer::resize(int32_t n){
-    buffer_.resize(n);
+void history_buffer::resize(int32_t n, int32_t maxblocksize){
+    // allocate all block memory upfront, so that readers never
+    // access memory which might get reallocated by push().
+    if (n != size_ || maxblocksize != maxblocksize_){
+        slots_.reset(n > 0 ? new slot[n] : nullptr);
+        for (int32_t i = 0; i < n; ++i){
+            slots_[i].data.reset(new char[maxblocksize]);
+        }
+        size_ = n;
+        maxblocksize_ = maxblocksize;
+    }
     clear();
 }
 
-block * history_buffer::find(int32_t seq){
-    if (seq >= oldest_){
-    #if 0
-        // linear search
-        for (auto& block : buffer_){
-            if (block.sequence == seq){
-                return &block;
-            }
-        }
-    #else
-        // binary search
-        // blocks are always pushed in chronological order,
-        // so the ranges [begin, head] and [head, end] will always be sorted.
-        auto dofind = [&](auto begin, auto end) -> block * {
-            auto result = std::lower_bound(begin, end, seq, [](auto& a, auto& b){
-                return a.sequence < b;
-            });
-            if (result != end && result->sequence == seq){
-                return &*result;
+int32_t history_buffer::find(int32_t seq) const {
+    if (seq < oldest_.load(std::memory_order_acquire)){
+        return -1;
+    }
+    // binary search
+    // blocks are always pushed in chronological order,
+    // so the ranges [begin, head] and [head, end] will always be sorted.
+    // NOTE: the result might be outdated, so read_frame() has to validate it!
+    auto dofind = [&](int32_t begin, int32_t end) -> int32_t {
+        while (begin < end){
+            auto mid = begin + (end - begin) / 2;
+            if (slots_[mid].sequence.load(std::memory_order_relaxed) < seq){
+                begin = mid + 1;
             } else {
-                return nullptr;
+                end = mid;
             }
-        };
-        auto result = dofind(buffer_.begin() + head_, buffer_.end());
-        if (!result){
-            result = dofind(buffer_.begin(), buffer_.begin() + head_);
         }
-        return result;
-    #endif
-    } else {
-        LOG_VERBOSE("couldn't find block " << seq << " - too old");
+        return begin;
+    };
+    auto head = head_.load(std::memory_order_acquire);
+    auto index = dofind(head, size_);
+    if (index == size_ || slots_[index].sequence.load(std::memory_order_relaxed) != seq){
+        index = dofind(0, head);
+        if (index == head || slots_[index].sequence.load(std::memory_order_relaxed) != seq){
+            return -1;
+        }
     }
-    return nullptr;
+    return index;
 }
 
 void history_buffer::push(int32_t seq, double sr,
                           const char *data, int32_t nbytes,
                           int32_t nframes, int32_t framesize)
 {
-    if (buffer_.empty()){
+    if (size_ == 0){
         return;
     }
     assert(data != nullptr && nbytes > 0);
+    if (nbytes > maxblocksize_){
+        LOG_ERROR("history_buffer: block " << seq << " too large ("
+                  << nbytes << " bytes)");
+        return;
+    }
+    auto head = head_.load(std::memory_order_relaxed);
+    auto& s = slots_[head];
     // check if we're going to overwrite an existing block
-    if (buffer_[head_].sequence >= 0){
-        oldest_ = buffer_[head_].sequence;
+    auto old = s.sequence.load(std::memory_order_relaxed);
+    if (old >= 0){
+        // readers check this before looking at the slot
+        oldest_.store(old + 1, std::memory_order_release);
     }
-    buffer_[head_].set(seq, sr, 0, data, nbytes, nframes, framesize);
-    if (++head_ >= (int32_t)buffer_.size()){
-        head_ = 0;
+    // mark slot as busy
+    auto version = s.version.load(std::memory_order_relaxed);
+    s.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    // write block
+    s.sequence.store(seq, std::memory_order_relaxed);
+    s.samplerate = sr;
+    s.size = nbytes;
+    s.nframes = nframes;
+    s.framesize = framesize;
+    memcpy(s.data.get(), data, nbytes);
+    // publish
+    s.version.store(version + 2, std::memory_order_release);
+    if (++head >= size_){
+        head = 0;
     }
+    head_.store(head, std::memory_order_release);
+}
+
+int32_t history_buffer::read_frame(int32_t seq, int32_t frame, int32_t framesize,
+                                   char *buf, int32_t size, data_packet& d) const {
+    // retry a few times if the slot is being written
+    for (int i = 0; i < 4; ++i){
+        auto index = find(seq);
+        if (index < 0){
+            return 0;
+        }
+        auto& s = slots_[index];
+        auto version = s.version.load(std::memory_order_acquire);
+        if (version & 1){
+            continue; // busy
+        }
+        if (s.sequence.load(std::memory_order_relaxed) != seq){
+            continue; // just overwritten
+        }
+        // copy block info and frame
+        auto samplerate = s.samplerate;
+        auto totalsize = s.size;
+        auto nframes = s.nframes;
+        if (framesize > 0 && framesize != s.framesize){
+            nframes = (totalsize + framesize - 1) / framesize;
+        } else {
+            framesize = s.framesize;
+        }
+        int32_t nbytes = -1; // validate before reporting an error
+        if (frame >= 0 && frame < nframes && framesize > 0){
+            auto onset = frame * framesize;
+            auto n = (frame == nframes - 1) ? totalsize - onset : framesize;
+            if (n > 0 && n <= size && onset + n <= maxblocksize_){
+                memcpy(buf, s.data.get() + onset, n);
+                nbytes = n;
+            }
+        }
+        // validate
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.version.load(std::memory_order_relaxed) != version){
+            continue;
+        }
+        if (nbytes < 0){
+            LOG_ERROR("history_buffer: can't read frame " << frame
+                      << " of block " << seq);
+            return 0;
+        }
+        d.sequence = seq;
+        d.samplerate = samplerate;
+        d.channel = 0;
+        d.totalsize = totalsize;
+        d.nframes = nframes;
+        d.framenum = frame;
+        return nbytes;
+    }
+    return 0;
 }
 
 /*////////////////////////// block_queue /////////////////////////////*/
@@ -21,6 +21,23 @@ bool check_version(uint32_t version);
 
 uint32_t make_version(uint8_t protocolflags = 0);
 
+// message types, i.e. the remaining address pattern
+// after /aoo/src/<id> resp. /aoo/sink/<id>
+enum class msg_type {
+    unknown = 0,
+    format,
+    data,
+    ping,
+    invite,
+    uninvite,
+    codec_change,
+    probe
+};
+
+// get the message type of an AoO message; 'onset' is the
+// return value of aoo_parse_pattern().
+msg_type parse_msg_type(const char *msg, int32_t n, int32_t onset);
+
 class dynamic_resampler {
 public:
     void setup(int32_t nfrom, int32_t nto, int32_t srfrom, int32_t srto, int32_t nchannels);
@@ -77,6 +94,8 @@ public:
     int32_t encode(const aoo_sample *s, int32_t n, char *buf, int32_t size){
         return codec_->encoder_encode(obj_, s, n, buf, size);
     }
+    // upper bound for the size of an encoded block
+    int32_t max_encoded_size() const;
 
     int32_t reset() {
         return codec_->encoder_reset(obj_);
@@ -136,8 +155,39 @@ struct data_packet {
     int32_t framenum;
     const char *data;
     int32_t size;
+    uint64_t timestamp = 0; // capture time (0: not available)
 };
 
+// Get a buffer for an outgoing packet on the calling thread, so we
+// don't need a AOO_MAXPACKETSIZE stack buffer for every message.
+// The buffer has at least 'minsize' bytes (e.g. the packet size for
+// data messages) and is reused, so the packet must be sent before the
+// next call!
+char * get_packet_buffer(int32_t& size, int32_t minsize = AOO_MAXPACKETSIZE);
+
+// A network backend can hand out its own buffers, e.g. the next slot of
+// its send batch, so that the packet doesn't have to be copied.
+// The hook may return nullptr if it can't provide 'minsize' bytes.
+// The hook is installed for the calling thread; pass nullptr to remove it.
+using packet_buffer_hook = char * (*)(void *user, int32_t minsize, int32_t& size);
+
+void set_packet_buffer_hook(packet_buffer_hook fn, void *user);
+
+// binary data message, see AOO_PROTOCOL_FLAG_BINARY_DATA.
+bool is_binary_data(const char *msg, int32_t n);
+
+// get the sink ID (might be AOO_ID_WILDCARD)
+bool read_binary_data_sink(const char *msg, int32_t n, int32_t& id);
+
+// returns the message size or 0 if the data doesn't fit into the buffer;
+// the samplerate is only sent if 'sendrate' is true.
+int32_t write_binary_data(char *buf, int32_t size, int32_t sink, int32_t salt,
+                          const data_packet& d, bool sendrate);
+
+// NOTE: d.data points into 'msg' and d.samplerate is 0 if omitted.
+// The capture time is restored relative to the local clock.
+bool read_binary_data(const char *msg, int32_t n, int32_t& salt, data_packet& d);
+
 class block {
 public:
     // methods
@@ -153,6 +203,7 @@ public:
     int32_t get_frame(int32_t which, char * data, int32_t n);
     bool has_frame(int32_t which) const;
     int32_t frame_size(int32_t which) const;
+    int32_t frame_size() const { return framesize_; } // 0: not known yet
     int32_t num_frames() const { return numframes_; }
     // data
     int32_t sequence = -1;
@@ -201,9 +252,12 @@ public:
 
     bool update(double time, double interval);
     int32_t remaining() const { return count_; }
+    int32_t attempts() const { return attempts_; }
+    double timestamp() const { return timestamp_; }
     int32_t sequence;
 private:
     int32_t count_;
+    int32_t attempts_;
     double timestamp_;
 };
 
@@ -242,19 +296,44 @@ private:
     std::vector<block_ack> data_;
 };
 
+// A versioned ring buffer: push() (single writer) may run concurrently
+// with read_frame(). Every slot has a version stamp which is odd while
+// the slot is being written; readers copy optimistically and validate
+// the stamp afterwards, so they never block the writer.
+// NOTE: clear() and resize() must not run concurrently with anything else.
 class history_buffer {
 public:
     void clear();
-    int32_t capacity() const;
-    void resize(int32_t n);
-    block * find(int32_t seq);
+    int32_t capacity() const { return size_; }
+    void resize(int32_t n, int32_t maxblocksize);
     void push(int32_t seq, double sr,
              const char *data, int32_t nbytes,
              int32_t nframes, int32_t framesize);
+    // copy a single frame of the given block into 'buf' and fill in
+    // the block info of 'd' (except for the data). returns the frame size
+    // or 0 if the block isn't available (anymore).
+    // 'framesize' splits the block into frames of the given size
+    // (e.g. for sinks with their own packet size); 0 means the
+    // frame size which the block has been pushed with.
+    int32_t read_frame(int32_t seq, int32_t frame, int32_t framesize,
+                       char *buf, int32_t size, data_packet& d) const;
 private:
-    std::vector<block> buffer_;
-    int32_t oldest_ = 0;
-    int32_t head_ = 0;
+    struct slot {
+        std::atomic<uint32_t> version{0};
+        std::atomic<int32_t> sequence{-1};
+        double samplerate = 0;
+        int32_t size = 0;
+        int32_t nframes = 0;
+        int32_t framesize = 0;
+        std::unique_ptr<char[]> data;
+    };
+    int32_t find(int32_t seq) const;
+
+    std::unique_ptr<slot[]> slots_;
+    int32_t size_ = 0;
+    int32_t maxblocksize_ = 0;
+    std::atomic<int32_t> oldest_{-1};
+    std::atomic<int32_t> head_{0};
 };
 
 /*//////////////////////// timer //////////////////////*/
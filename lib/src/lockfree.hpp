@@ -4,9 +4,13 @@
 
 #pragma once
 
+#include "sync.hpp"
+
 #include <stdint.h>
 #include <atomic>
 #include <vector>
+#include <memory>
+#include <algorithm>
 #include <cassert>
 
 namespace aoo {
@@ -14,27 +18,41 @@ namespace lockfree {
 
 /*////////////////////// queue /////////////////////////*/
 
-// a lock-free queue which supports reading/writing data
-// in fixed-sized blocks.
+// a lock-free single-producer/single-consumer queue which
+// supports reading/writing data in fixed-sized blocks.
+//
+// The producer and consumer indices live on separate cache lines
+// and each side caches the index of the other side, so it only has to
+// touch the other cache line if the queue appears to be full resp. empty.
+// The indices count blocks and wrap around naturally; the number of
+// block slots is rounded up to a power of 2, so we can use a bit mask
+// instead of a division. The logical capacity is not affected.
 template<typename T>
 class queue {
  public:
     queue() = default;
     // we need a move constructor so we can
-    // put it in STL containers
+    // put it in STL containers (not thread-safe!)
     queue(queue&& other)
-        : balance_(other.balance_.load()),
-          rdhead_(other.rdhead_),
-          wrhead_(other.wrhead_),
-          stride_(other.stride_),
+        : stride_(other.stride_),
+          nblocks_(other.nblocks_),
+          mask_(other.mask_),
           data_(std::move(other.data_))
-    {}
+    {
+        wrindex_.store(other.wrindex_.load(std::memory_order_relaxed));
+        rdcache_ = other.rdcache_;
+        rdindex_.store(other.rdindex_.load(std::memory_order_relaxed));
+        wrcache_ = other.wrcache_;
+    }
     queue& operator=(queue&& other){
-        balance_ = other.balance_.load();
-        rdhead_ = other.rdhead_;
-        wrhead_ = other.wrhead_;
         stride_ = other.stride_;
+        nblocks_ = other.nblocks_;
+        mask_ = other.mask_;
         data_ = std::move(other.data_);
+        wrindex_.store(other.wrindex_.load(std::memory_order_relaxed));
+        rdcache_ = other.rdcache_;
+        rdindex_.store(other.rdindex_.load(std::memory_order_relaxed));
+        wrcache_ = other.wrcache_;
         return *this;
     }
 
@@ -42,79 +60,229 @@ class queue {
         // check if size is divisible by both rdsize and wrsize
         assert(size >= blocksize);
         assert((size % blocksize) == 0);
+        stride_ = blocksize;
+        nblocks_ = size / blocksize;
+        // round up to power of 2
+        uint32_t nslots = 1;
+        while (nslots < (uint32_t)nblocks_){
+            nslots <<= 1;
+        }
+        mask_ = nslots - 1;
     #if 1
         data_.clear(); // force zero
     #endif
-        data_.resize(size);
-        stride_ = blocksize;
+        data_.resize(nslots * blocksize);
         reset();
     }
 
     int32_t blocksize() const { return stride_; }
 
-    int32_t capacity() const { return data_.size(); }
+    int32_t capacity() const { return nblocks_ * stride_; }
 
     void reset() {
-        rdhead_ = wrhead_ = 0;
-        balance_ = 0;
+        wrindex_.store(0, std::memory_order_relaxed);
+        rdcache_ = 0;
+        rdindex_.store(0, std::memory_order_relaxed);
+        wrcache_ = 0;
     }
-    // returns: the number of available *blocks* for reading
+    // returns: the number of available *blocks* for reading.
+    // NOTE: only call on the consumer thread! The result might be
+    // smaller than the actual number, but it is never 0 if there is
+    // something to read.
     int32_t read_available() const {
-        if (stride_){
-            return balance_.load(std::memory_order_acquire) / stride_;
-        } else {
-            return 0;
+        auto rd = rdindex_.load(std::memory_order_relaxed);
+        if (wrcache_ == rd){
+            wrcache_ = wrindex_.load(std::memory_order_acquire);
         }
+        return wrcache_ - rd;
     }
 
     void read(T& out) {
-        out = std::move(data_[rdhead_]);
-        rdhead_ = (rdhead_ + 1) % capacity();
-        --balance_;
-        assert(balance_ >= 0);
+        assert(stride_ == 1);
+        auto rd = rdindex_.load(std::memory_order_relaxed);
+        out = std::move(data_[rd & mask_]);
+        rdindex_.store(rd + 1, std::memory_order_release);
     }
 
     const T* read_data() const {
-        return &data_[rdhead_];
+        auto rd = rdindex_.load(std::memory_order_relaxed);
+        return &data_[(rd & mask_) * stride_];
     }
 
     void read_commit() {
-        rdhead_ = (rdhead_ + stride_) % capacity();
-        balance_ -= stride_;
-        assert(balance_ >= 0);
+        auto rd = rdindex_.load(std::memory_order_relaxed);
+        rdindex_.store(rd + 1, std::memory_order_release);
     }
-    // returns: the number of available *blocks* for writing
+    // returns: the number of available *blocks* for writing.
+    // NOTE: only call on the producer thread! The result might be
+    // smaller than the actual number, but it is never 0 if there is
+    // space left.
     int32_t write_available() const {
-        if (stride_){
-            return (capacity() - balance_.load(std::memory_order_acquire)) / stride_;
-        } else {
-            return 0;
+        auto wr = wrindex_.load(std::memory_order_relaxed);
+        if ((int32_t)(wr - rdcache_) >= nblocks_){
+            rdcache_ = rdindex_.load(std::memory_order_acquire);
         }
+        return nblocks_ - (int32_t)(wr - rdcache_);
     }
 
     template<typename U>
     void write(U&& value) {
-        data_[wrhead_] = std::forward<U>(value);
-        wrhead_ = (wrhead_ + 1) % capacity();
-        ++balance_;
-        assert(balance_ <= capacity());
+        assert(stride_ == 1);
+        auto wr = wrindex_.load(std::memory_order_relaxed);
+        data_[wr & mask_] = std::forward<U>(value);
+        wrindex_.store(wr + 1, std::memory_order_release);
     }
 
     T* write_data() {
-        return &data_[wrhead_];
+        auto wr = wrindex_.load(std::memory_order_relaxed);
+        return &data_[(wr & mask_) * stride_];
     }
 
     void write_commit() {
-        wrhead_ = (wrhead_ + stride_) % capacity();
-        balance_ += stride_;
-        assert(balance_ <= capacity());
+        auto wr = wrindex_.load(std::memory_order_relaxed);
+        wrindex_.store(wr + 1, std::memory_order_release);
+    }
+    // the most recently written block (only for the producer!)
+    const T* last_write_data() const {
+        auto wr = wrindex_.load(std::memory_order_relaxed);
+        return &data_[((wr - 1) & mask_) * stride_];
     }
+    // returns: the number of *blocks* in the queue.
+    // This can be safely called from any thread.
+    int32_t size() const {
+        // load the read index first, so it can't overtake the write index
+        auto rd = rdindex_.load(std::memory_order_acquire);
+        auto wr = wrindex_.load(std::memory_order_acquire);
+        return std::min<int32_t>(wr - rd, nblocks_);
+    }
+    // the underlying memory, e.g. for binding it to a NUMA node.
+    const std::vector<T>& storage() const { return data_; }
  private:
-    std::atomic<int32_t> balance_{0};
-    int32_t rdhead_{0};
-    int32_t wrhead_{0};
+    // constant after resize()
     int32_t stride_{0};
+    int32_t nblocks_{0};
+    uint32_t mask_{0};
     std::vector<T> data_;
+    char pad1_[CACHELINE_SIZE];
+    // producer
+    std::atomic<uint32_t> wrindex_{0};
+    mutable uint32_t rdcache_{0}; // cached read index
+    char pad2_[CACHELINE_SIZE];
+    // consumer
+    std::atomic<uint32_t> rdindex_{0};
+    mutable uint32_t wrcache_{0}; // cached write index
+    char pad3_[CACHELINE_SIZE];
+};
+
+/*////////////////////// mpsc_queue /////////////////////////*/
+
+// a bounded lock-free multi-producer/single-consumer queue
+// (after Dmitry Vyukov's bounded MPMC queue).
+//
+// Producers claim a slot with a CAS loop, the consumer never
+// has to wait for anyone. If the queue is full, the item is
+// dropped and counted, see dropped().
+template<typename T>
+class mpsc_queue {
+ public:
+    mpsc_queue() = default;
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    // not thread-safe!
+    void resize(int32_t n) {
+        // round up to power of 2
+        uint32_t size = 1;
+        while (size < (uint32_t)n){
+            size <<= 1;
+        }
+        cells_.reset(new cell[size]);
+        mask_ = size - 1;
+        for (uint32_t i = 0; i < size; ++i){
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        dropped_.store(0, std::memory_order_relaxed);
+    }
+
+    int32_t capacity() const { return cells_ ? mask_ + 1 : 0; }
+
+    // can be called from any thread.
+    // returns: false if the queue is full
+    template<typename U>
+    bool push(U&& value) {
+        auto pos = head_.load(std::memory_order_relaxed);
+        for (;;){
+            auto& c = cells_[pos & mask_];
+            auto seq = c.sequence.load(std::memory_order_acquire);
+            auto diff = (int32_t)(seq - pos);
+            if (diff == 0){
+                // the slot is free, try to claim it.
+                // on failure, 'pos' is updated to the current head.
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    c.data = std::forward<U>(value);
+                    c.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0){
+                // the consumer hasn't released the slot yet
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                // another producer got there first
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // only call on the consumer thread!
+    // returns: false if the queue is empty (or the next item
+    // has been claimed but not written yet)
+    bool pop(T& value) {
+        auto pos = tail_.load(std::memory_order_relaxed);
+        auto& c = cells_[pos & mask_];
+        auto seq = c.sequence.load(std::memory_order_acquire);
+        if ((int32_t)(seq - (pos + 1)) < 0){
+            return false;
+        }
+        value = std::move(c.data);
+        // release the slot for the next round
+        c.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        tail_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // returns: the number of (claimed) items in the queue.
+    // This can be safely called from any thread.
+    int32_t size() const {
+        // load the tail first, so it can't overtake the head
+        auto tail = tail_.load(std::memory_order_acquire);
+        auto head = head_.load(std::memory_order_acquire);
+        return std::min<int32_t>(head - tail, capacity());
+    }
+
+    // returns: the number of items which have been dropped
+    // since the last call because the queue was full.
+    int32_t dropped() {
+        return dropped_.exchange(0, std::memory_order_relaxed);
+    }
+ private:
+    struct cell {
+        std::atomic<uint32_t> sequence{0};
+        T data;
+    };
+    // constant after resize()
+    std::unique_ptr<cell[]> cells_;
+    uint32_t mask_{0};
+    char pad1_[CACHELINE_SIZE];
+    // producers
+    std::atomic<uint32_t> head_{0};
+    std::atomic<int32_t> dropped_{0};
+    char pad2_[CACHELINE_SIZE];
+    // consumer
+    std::atomic<uint32_t> tail_{0};
+    char pad3_[CACHELINE_SIZE];
 };
 
 /*///////////////////////// list ////////////////////////*/
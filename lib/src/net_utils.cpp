@@ -2,6 +2,10 @@
 
 #include <stdio.h>
 
+#ifdef _WIN32
+#include <ws2tcpip.h> // ip_mreq
+#endif
+
 namespace aoo {
 namespace net {
 
@@ -53,6 +57,46 @@ int socket_set_nonblocking(int socket, int nonblocking)
     return 0;
 }
 
+static int socket_membership(int socket, const ip_address& group, int option)
+{
+    if (group.address.ss_family != AF_INET){
+        return -1; // IPv6 not supported yet
+    }
+    struct ip_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr = reinterpret_cast<const struct sockaddr_in *>(&group.address)->sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    return setsockopt(socket, IPPROTO_IP, option, (const char *)&mreq, sizeof(mreq));
+}
+
+int socket_join_group(int socket, const ip_address& group)
+{
+    return socket_membership(socket, group, IP_ADD_MEMBERSHIP);
+}
+
+int socket_leave_group(int socket, const ip_address& group)
+{
+    return socket_membership(socket, group, IP_DROP_MEMBERSHIP);
+}
+
+int socket_set_dontfragment(int socket, int dontfragment)
+{
+#if defined(_WIN32)
+    DWORD val = dontfragment != 0;
+    return setsockopt(socket, IPPROTO_IP, IP_DONTFRAGMENT, (const char *)&val, sizeof(val));
+#elif defined(IP_MTU_DISCOVER)
+    // IP_PMTUDISC_PROBE sets the DF bit but ignores the cached path MTU,
+    // so we can probe for larger packet sizes.
+    int val = dontfragment ? IP_PMTUDISC_PROBE : IP_PMTUDISC_DONT;
+    return setsockopt(socket, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val));
+#elif defined(IP_DONTFRAG)
+    int val = dontfragment != 0;
+    return setsockopt(socket, IPPROTO_IP, IP_DONTFRAG, &val, sizeof(val));
+#else
+    return -1; // not supported
+#endif
+}
+
 // kudos to https://stackoverflow.com/a/46062474/6063908
 int socket_connect(int socket, const ip_address& addr, float timeout)
 {
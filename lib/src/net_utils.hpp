@@ -115,5 +115,14 @@ int socket_set_nonblocking(int socket, int nonblocking);
 
 int socket_connect(int socket, const ip_address& addr, float timeout);
 
+// join/leave an IPv4 multicast group on all interfaces
+int socket_join_group(int socket, const ip_address& group);
+
+int socket_leave_group(int socket, const ip_address& group);
+
+// set/clear the "don't fragment" bit on outgoing IPv4 packets,
+// so that packets which exceed the path MTU are dropped
+int socket_set_dontfragment(int socket, int dontfragment);
+
 } // net
 } // aoo
@@ -0,0 +1,185 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#include "scheduler.hpp"
+#include "thread_utils.hpp"
+#include "aoo/aoo_utils.hpp"
+
+#include <algorithm>
+
+/*//////////////////// AoO scheduler /////////////////////*/
+
+aoo_scheduler * aoo_scheduler_new(int32_t nthreads, int32_t flags){
+    return new aoo::scheduler(nthreads, flags);
+}
+
+void aoo_scheduler_free(aoo_scheduler *s){
+    delete s;
+}
+
+int32_t aoo_scheduler_set_affinity(aoo_scheduler *s,
+                                   const int32_t *cpus, int32_t n){
+    return s->set_affinity(cpus, n);
+}
+
+int32_t aoo_scheduler_add_task(aoo_scheduler *s, aoo_taskfn fn, void *user){
+    return s->add_task(fn, user);
+}
+
+void aoo_scheduler_remove_task(aoo_scheduler *s, int32_t task){
+    s->remove_task(task);
+}
+
+void aoo_scheduler_notify(aoo_scheduler *s, int32_t task){
+    s->notify(task);
+}
+
+namespace aoo {
+
+/*//////////////////////// scheduler //////////////////////////*/
+
+scheduler::scheduler(int32_t nthreads, int32_t flags)
+    : tasks_(new task[AOO_SCHEDULER_MAXTASKS])
+{
+    if (nthreads <= 0){
+        // leave some cores for the audio thread(s)
+        int32_t ncores = std::thread::hardware_concurrency();
+        nthreads = std::max<int32_t>(1, std::min<int32_t>(ncores / 2, 4));
+    }
+    bool realtime = flags & AOO_SCHEDULER_REALTIME;
+    for (int32_t i = 0; i < nthreads; ++i){
+        threads_.emplace_back([this, realtime](){
+            if (realtime && !set_thread_realtime()){
+                LOG_WARNING("aoo_scheduler: couldn't set real-time priority");
+            }
+            run();
+        });
+    }
+    LOG_VERBOSE("aoo_scheduler: started " << nthreads << " worker threads");
+}
+
+scheduler::~scheduler(){
+    quit_.store(true);
+    // wake up all threads
+    for (size_t i = 0; i < threads_.size(); ++i){
+        sem_.post();
+    }
+    for (auto& thread : threads_){
+        thread.join();
+    }
+}
+
+bool scheduler::set_affinity(const int32_t *cpus, int32_t n){
+    if (n <= 0){
+        LOG_ERROR("aoo_scheduler: empty CPU set");
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(affinity_mutex_);
+        cpus_.assign(cpus, cpus + n);
+    }
+#if defined(_WIN32) || defined(__linux__)
+    // the workers update themselves on the next wakeup
+    affinity_changed_.fetch_add(1);
+    for (size_t i = 0; i < threads_.size(); ++i){
+        sem_.post();
+    }
+    return true;
+#else
+    LOG_WARNING("aoo_scheduler: CPU affinity not supported on this platform");
+    return false;
+#endif
+}
+
+int32_t scheduler::add_task(aoo_taskfn fn, void *user){
+    std::lock_guard<std::mutex> lock(task_mutex_);
+    for (int32_t i = 0; i < AOO_SCHEDULER_MAXTASKS; ++i){
+        auto& t = tasks_[i];
+        if (!(t.state.load() & ACTIVE)){
+            t.fn = fn;
+            t.user = user;
+            // publish; this also clears stale notifications
+            t.state.store(ACTIVE, std::memory_order_release);
+            if (i >= numtasks_.load(std::memory_order_relaxed)){
+                numtasks_.store(i + 1, std::memory_order_release);
+            }
+            return i;
+        }
+    }
+    LOG_ERROR("aoo_scheduler: too many tasks");
+    return -1;
+}
+
+// NOTE: must not be called from the task itself!
+void scheduler::remove_task(int32_t id){
+    if (id < 0 || id >= AOO_SCHEDULER_MAXTASKS){
+        LOG_ERROR("aoo_scheduler: bad task ID " << id);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(task_mutex_);
+    auto& t = tasks_[id];
+    // deactivate the task, so it can't be claimed anymore...
+    t.state.fetch_and(~(ACTIVE | PENDING));
+    // ...and wait until it has finished running.
+    while (t.state.load(std::memory_order_acquire) & RUNNING){
+        std::this_thread::yield();
+    }
+    t.fn = nullptr;
+    t.user = nullptr;
+}
+
+void scheduler::notify(int32_t id){
+    if (id < 0 || id >= AOO_SCHEDULER_MAXTASKS){
+        return;
+    }
+    auto state = tasks_[id].state.fetch_or(PENDING);
+    // only wake up a worker if the task is neither pending nor running;
+    // in the latter case, run_task() will reschedule it.
+    if (!(state & (PENDING | RUNNING)) && (state & ACTIVE)){
+        sem_.post();
+    }
+}
+
+void scheduler::run(){
+    uint32_t affinity = 0;
+    for (;;){
+        sem_.wait();
+        if (quit_.load(std::memory_order_acquire)){
+            break;
+        }
+        // check for affinity changes
+        auto changed = affinity_changed_.load(std::memory_order_acquire);
+        if (changed != affinity){
+            std::lock_guard<std::mutex> lock(affinity_mutex_);
+            if (!set_thread_affinity(cpus_.data(), cpus_.size())){
+                LOG_WARNING("aoo_scheduler: couldn't set CPU affinity");
+            }
+            affinity = changed;
+        }
+        // run all pending tasks
+        auto n = numtasks_.load(std::memory_order_acquire);
+        for (int32_t i = 0; i < n; ++i){
+            run_task(tasks_[i]);
+        }
+    }
+}
+
+bool scheduler::run_task(task& t){
+    auto state = t.state.load(std::memory_order_relaxed);
+    while ((state & (ACTIVE | PENDING | RUNNING)) == (ACTIVE | PENDING)){
+        // try to claim the task
+        if (t.state.compare_exchange_weak(state, (state & ~PENDING) | RUNNING,
+                                          std::memory_order_acquire)){
+            t.fn(t.user);
+            // if the task has been notified in the meantime, reschedule it.
+            if (t.state.fetch_and(~RUNNING, std::memory_order_release) & PENDING){
+                sem_.post();
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+} // aoo
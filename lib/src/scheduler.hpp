@@ -0,0 +1,62 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#pragma once
+
+#include "aoo/aoo.h"
+
+#include "sync.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aoo {
+
+/*//////////////////////// scheduler //////////////////////////*/
+
+class scheduler {
+public:
+    scheduler(int32_t nthreads, int32_t flags);
+    ~scheduler();
+    scheduler(const scheduler&) = delete;
+    scheduler& operator=(const scheduler&) = delete;
+
+    bool set_affinity(const int32_t *cpus, int32_t n);
+
+    int32_t add_task(aoo_taskfn fn, void *user);
+
+    void remove_task(int32_t id);
+
+    void notify(int32_t id);
+private:
+    // task states
+    static const uint32_t ACTIVE = 0x1;
+    static const uint32_t PENDING = 0x2;
+    static const uint32_t RUNNING = 0x4;
+
+    struct task {
+        aoo_taskfn fn = nullptr;
+        void *user = nullptr;
+        std::atomic<uint32_t> state{0};
+    };
+
+    void run();
+    bool run_task(task& t);
+
+    std::unique_ptr<task[]> tasks_;
+    std::atomic<int32_t> numtasks_{0}; // highest used slot + 1
+    std::mutex task_mutex_; // for adding/removing tasks
+    std::vector<std::thread> threads_;
+    semaphore sem_;
+    std::atomic<bool> quit_{false};
+    // CPU affinity
+    std::vector<int32_t> cpus_;
+    std::mutex affinity_mutex_;
+    std::atomic<uint32_t> affinity_changed_{0};
+};
+
+} // aoo
@@ -173,7 +173,7 @@ aoo::net::server::server(int tcpsocket, int udpsocket)
     }
 #endif
     commands_.resize(256, 1);
-    events_.resize(256, 1);
+    events_.resize(256);
 }
 
 void aoonet_server_free(aoonet_server *server){
@@ -242,7 +242,7 @@ int32_t aoonet_server_events_available(aoonet_server *server){
 }
 
 int32_t aoo::net::server::events_available(){
-    return 0;
+    return events_.size() > 0;
 }
 
 int32_t aoonet_server_handle_events(aoonet_server *server, aoo_eventhandler fn, void *user){
@@ -251,25 +251,36 @@ int32_t aoonet_server_handle_events(aoonet_server *server, aoo_eventhandler fn,
 
 int32_t aoo::net::server::handle_events(aoo_eventhandler fn, void *user){
     // always thread-safe
-    auto n = events_.read_available();
-    if (n > 0){
-        // copy events
-        auto events = (ievent **)alloca(sizeof(ievent *) * n);
-        auto vec = (const aoo_event **)alloca(sizeof(aoo_event *) * n); // adjusted pointers
-        for (int i = 0; i < n; ++i){
-            std::unique_ptr<ievent> ptr;
-            events_.read(ptr);
-            events[i] = ptr.release(); // get raw pointer
-            vec[i] = &events[i]->event_; // adjust pointer
+    auto dropped = events_.dropped();
+    if (dropped > 0){
+        LOG_WARNING("aoo_server: event queue full, dropped " << dropped << " events");
+    }
+    auto n = events_.size();
+    int32_t total = 0;
+    // copy events in batches of fixed size
+    while (total < n){
+        ievent *events[AOO_EVENTBATCHSIZE];
+        const aoo_event *vec[AOO_EVENTBATCHSIZE]; // adjusted pointers
+        int32_t count = 0;
+        std::unique_ptr<ievent> ptr;
+        while (count < AOO_EVENTBATCHSIZE && total + count < n
+               && events_.pop(ptr)){
+            events[count] = ptr.release(); // get raw pointer
+            vec[count] = &events[count]->event_; // adjust pointer
+            count++;
+        }
+        if (count == 0){
+            break;
         }
         // send events
-        fn(user, vec, n);
+        fn(user, vec, count);
         // manually free events
-        for (int i = 0; i < n; ++i){
+        for (int i = 0; i < count; ++i){
             delete events[i];
         }
+        total += count;
     }
-    return n;
+    return total;
 }
 
 namespace aoo {
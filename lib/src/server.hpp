@@ -195,11 +195,9 @@ private:
     group_list groups_;
     // queues
     lockfree::queue<std::unique_ptr<icommand>> commands_;
-    lockfree::queue<std::unique_ptr<ievent>> events_;
+    lockfree::mpsc_queue<std::unique_ptr<ievent>> events_;
     void push_event(std::unique_ptr<ievent> e){
-        if (events_.write_available()){
-            events_.write(std::move(e));
-        }
+        events_.push(std::move(e));
     }
     // signal
     std::atomic<bool> quit_{false};
@@ -3,7 +3,9 @@
  * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
 #include "sink.hpp"
+#include "thread_utils.hpp"
 #include "aoo/aoo_utils.hpp"
+#include "aoo/aoo_pcm.h"
 
 #include <algorithm>
 #include <cmath>
@@ -174,9 +176,9 @@ int32_t aoo::sink::set_option(int32_t opt, void *ptr, int32_t size)
         if (packetsize < minpacketsize){
             LOG_WARNING("packet size too small! setting to " << minpacketsize);
             packetsize_ = minpacketsize;
-        } else if (packetsize > AOO_MAXPACKETSIZE){
-            LOG_WARNING("packet size too large! setting to " << AOO_MAXPACKETSIZE);
-            packetsize_ = AOO_MAXPACKETSIZE;
+        } else if (packetsize > AOO_MAXUDPPACKETSIZE){
+            LOG_WARNING("packet size too large! setting to " << AOO_MAXUDPPACKETSIZE);
+            packetsize_ = AOO_MAXUDPPACKETSIZE;
         } else {
             packetsize_ = packetsize;
         }
@@ -202,6 +204,19 @@ int32_t aoo::sink::set_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(int32_t);
         protocol_flags_ = as<int32_t>(ptr) & 0xff;
         break;
+    // NUMA node
+    case aoo_opt_numa_node:
+    {
+        CHECKARG(int32_t);
+        auto node = std::max<int32_t>(as<int32_t>(ptr), -1);
+        if (numa_node_.exchange(node) != node){
+            // migrate existing queues
+            for (auto& src : sources_){
+                src.bind_queues(*this);
+            }
+        }
+        break;
+    }
     // unknown
     default:
         LOG_WARNING("aoo_sink: unsupported option " << opt);
@@ -256,6 +271,10 @@ int32_t aoo::sink::get_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(int32_t);
         as<int32_t>(ptr) = protocol_flags_;
         break;
+    case aoo_opt_numa_node:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = numa_node_;
+        break;
     // unknown
     default:
         LOG_WARNING("aoo_sink: unsupported option " << opt);
@@ -328,26 +347,35 @@ int32_t aoo_sink_handle_message(aoo_sink *sink, const char *data, int32_t n,
 
 int32_t aoo::sink::handle_message(const char *data, int32_t n,
                                   void *endpoint, aoo_replyfn fn) {
-    try {
-        osc::ReceivedPacket packet(data, n);
-        osc::ReceivedMessage msg(packet);
+    if (samplerate_ == 0){
+        return 0; // not setup yet
+    }
 
-        if (samplerate_ == 0){
-            return 0; // not setup yet
-        }
+    // first check the address pattern, so we don't have to
+    // parse the whole OSC message if it's not for us.
+    int32_t type, sinkid;
+    auto onset = aoo_parse_pattern(data, n, &type, &sinkid);
+    if (!onset){
+        LOG_WARNING("not an AoO message!");
+        return 0;
+    }
 
-        int32_t type, sinkid;
-        auto onset = aoo_parse_pattern(data, n, &type, &sinkid);
-        if (!onset){
-            LOG_WARNING("not an AoO message!");
-            return 0;
-        }
-        
-        if (type != AOO_TYPE_SINK){
-            LOG_WARNING("not a sink message!");
-            return 0;
+    if (type != AOO_TYPE_SINK){
+        LOG_WARNING("not a sink message!");
+        return 0;
+    }
+
+    try {
+        if (is_binary_data(data, n)){
+            if (sinkid != id() && sinkid != AOO_ID_WILDCARD){
+                LOG_WARNING("wrong sink ID!");
+                return 0;
+            }
+            return handle_binary_data_message(endpoint, fn, data, n);
         }
         if (sinkid == AOO_ID_NONE) {
+            osc::ReceivedPacket packet(data, n);
+            osc::ReceivedMessage msg(packet);
             // special case, this is a be a compact data message
             // use the salt to see if it matches the current salt for us
             // using salt as unique token instead of dealing with a long OSC message and arguments
@@ -368,15 +396,27 @@ int32_t aoo::sink::handle_message(const char *data, int32_t n,
             return 0;
         }
 
-        auto pattern = msg.AddressPattern() + onset;
-        if (!strcmp(pattern, AOO_MSG_FORMAT)){
+        auto mtype = parse_msg_type(data, n, onset);
+        if (mtype == msg_type::unknown){
+            LOG_WARNING("unknown message " << data + onset);
+            return 0;
+        }
+
+        osc::ReceivedPacket packet(data, n);
+        osc::ReceivedMessage msg(packet);
+
+        switch (mtype){
+        case msg_type::format:
             return handle_format_message(endpoint, fn, msg);
-        } else if (!strcmp(pattern, AOO_MSG_DATA)){
+        case msg_type::data:
             return handle_data_message(endpoint, fn, msg);
-        } else if (!strcmp(pattern, AOO_MSG_PING)){
+        case msg_type::ping:
             return handle_ping_message(endpoint, fn, msg);
-        } else {
-            LOG_WARNING("unknown message " << pattern);
+        case msg_type::probe:
+            return handle_probe_message(endpoint, fn, msg, n);
+        default:
+            LOG_WARNING("unexpected message " << data + onset);
+            break;
         }
     } catch (const osc::Exception& e){
         LOG_ERROR("aoo_sink: exception in handle_message: " << e.what());
@@ -595,6 +635,10 @@ int32_t sink::handle_data_message(void *endpoint, aoo_replyfn fn,
     (it++)->AsBlob(blobdata, blobsize);
     d.data = (const char *)blobdata;
     d.size = blobsize;
+    // optional capture time stamp
+    if (it != msg.ArgumentsEnd() && it->IsTimeTag()){
+        d.timestamp = (it++)->AsTimeTag();
+    }
 
     if (id < 0){
         LOG_WARNING("bad ID for " << AOO_MSG_DATA << " message");
@@ -617,15 +661,15 @@ int32_t sink::handle_data_message(void *endpoint, aoo_replyfn fn,
 int32_t sink::handle_compact_data_message(void *endpoint, aoo_replyfn fn,
                                           const osc::ReceivedMessage& msg)
 {
-    // /d <i:salt> <i:seq> <b:data>
-    // /d <i:salt> <i:seq> <f:srate> <b:data>
+    // /d <i:salt> <i:seq> <b:data> [<t:time>]
+    // /d <i:salt> <i:seq> <d:srate> <b:data> [<t:time>]
     auto it = msg.ArgumentsBegin();
 
     aoo::data_packet d;
 
     auto salt = (it++)->AsInt32();
     d.sequence = (it++)->AsInt32();
-    if (msg.ArgumentCount() == 4) {
+    if (it->IsDouble()) {
         d.samplerate = (it++)->AsDouble();
     }
     else {
@@ -634,6 +678,10 @@ int32_t sink::handle_compact_data_message(void *endpoint, aoo_replyfn fn,
     const void *blobdata;
     osc::osc_bundle_element_size_t blobsize;
     (it++)->AsBlob(blobdata, blobsize);
+    // optional capture time stamp
+    if (it != msg.ArgumentsEnd() && it->IsTimeTag()){
+        d.timestamp = (it++)->AsTimeTag();
+    }
     // reconstruct the rest from prior format
     d.channel = 0 ;
     d.nframes = 1;
@@ -652,6 +700,26 @@ int32_t sink::handle_compact_data_message(void *endpoint, aoo_replyfn fn,
     }
 }
 
+int32_t sink::handle_binary_data_message(void *endpoint, aoo_replyfn fn,
+                                         const char *data, int32_t n)
+{
+    // see write_binary_data() in common.cpp
+    aoo::data_packet d;
+    int32_t salt;
+    if (!read_binary_data(data, n, salt, d)){
+        return 0;
+    }
+
+    // try to find existing source by salt
+    auto src = find_source_by_salt(endpoint, salt);
+    if (src){
+        return src->handle_data(*this, salt, d);
+    } else {
+        // discard data message
+        return 0;
+    }
+}
+
 int32_t sink::handle_ping_message(void *endpoint, aoo_replyfn fn,
                                   const osc::ReceivedMessage& msg)
 {
@@ -674,25 +742,108 @@ int32_t sink::handle_ping_message(void *endpoint, aoo_replyfn fn,
     }
 }
 
+// /aoo/sink/<id>/probe <src> <size> <token> <padding>
+// reply with the size of the packet we have actually received
+// and the token of the probe:
+// /aoo/src/<id>/probe <sink> <size> <token>
+int32_t sink::handle_probe_message(void *endpoint, aoo_replyfn fn,
+                                   const osc::ReceivedMessage& msg, int32_t size)
+{
+    if (!(protocol_flags_.load() & AOO_PROTOCOL_FLAG_PROBE)){
+        return 0;
+    }
+
+    auto it = msg.ArgumentsBegin();
+    auto id = (it++)->AsInt32();
+    if (id < 0){
+        LOG_WARNING("bad ID for " << AOO_MSG_PROBE << " message");
+        return 0;
+    }
+    it++; // skip the requested size
+    auto token = (it++)->AsInt32();
+
+    LOG_DEBUG("handle probe from source " << id << " (" << size << " bytes)");
+
+    // the reply is tiny, so we can send it right away
+    int32_t bufsize;
+    auto buffer = get_packet_buffer(bufsize);
+    osc::OutboundPacketStream reply(buffer, bufsize);
+
+    const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
+            + AOO_MSG_SOURCE_LEN + 16 + AOO_MSG_PROBE_LEN;
+    char address[max_addr_size];
+    snprintf(address, sizeof(address), "%s%s/%d%s",
+             AOO_MSG_DOMAIN, AOO_MSG_SOURCE, id, AOO_MSG_PROBE);
+
+    reply << osc::BeginMessage(address) << this->id() << size << token
+          << osc::EndMessage;
+
+    fn(endpoint, reply.Data(), (int32_t)reply.Size());
+
+    return 1;
+}
+
+/*////////////////////////// transit_estimator /////////////////////////////*/
+
+void transit_estimator::reset(){
+    reftime_ = 0;
+    refseq_ = 0;
+    period_ = 0;
+    mean_ = 0;
+    dev_ = 0;
+    count_ = 0;
+}
+
+void transit_estimator::update(int32_t seq, time_tag capture, time_tag arrival, double period){
+    auto t = capture.to_double();
+    auto transit = arrival.to_double() - t;
+    if (count_ > 0){
+        // smoothed mean and mean deviation (RFC 6298)
+        auto delta = transit - mean_;
+        mean_ += delta * 0.125;
+        dev_ += (std::fabs(delta) - dev_) * 0.25;
+    } else {
+        mean_ = transit;
+        dev_ = period * 0.5;
+    }
+    count_++;
+    period_ = period;
+    // the most recent block is the reference for
+    // estimating the capture time of other blocks.
+    if (count_ == 1 || seq > refseq_){
+        reftime_ = t;
+        refseq_ = seq;
+    }
+}
+
+bool transit_estimator::overdue(int32_t seq, time_tag now) const {
+    // estimated capture time (relative to reference block)
+    auto capture = (seq - refseq_) * period_;
+    // latest expected arrival time; always tolerate at least
+    // one block period, so that reordering doesn't trigger resending.
+    auto deadline = capture + mean_ + std::max<double>(4.0 * dev_, period_);
+    return (now.to_double() - reftime_) > deadline;
+}
+
 /*////////////////////////// source_desc /////////////////////////////*/
 
 source_desc::source_desc(void *endpoint, aoo_replyfn fn, int32_t id, int32_t salt)
     : endpoint_(endpoint), fn_(fn), id_(id), salt_(salt)
 {
-    eventqueue_.resize(AOO_EVENTQUEUESIZE, 1);
+    eventqueue_.resize(AOO_EVENTQUEUESIZE);
     // push "add" event
     event e;
     e.ping.type = AOO_SOURCE_ADD_EVENT;
     e.ping.endpoint = endpoint;
     e.ping.id = id;
-    eventqueue_.write(e); // no need to lock
+    eventqueue_.push(e);
     LOG_DEBUG("add new source with id " << id);
     resendqueue_.resize(256, 1);
 }
 
 int32_t source_desc::get_format(aoo_format_storage &format){
     // synchronize with handle_format() and update()!
-    shared_lock lock(mutex_);
+    rt_shared_lock lock(mutex_);
     if (decoder_){
         return decoder_->get_format(format);
     } else {
@@ -715,7 +866,7 @@ void source_desc::request_codec_change(aoo_format & f)
 
 int32_t source_desc::get_buffer_fill_ratio(float &ratio){
     if (audioqueue_.capacity() > 0) {
-        ratio = (audioqueue_.read_available() * audioqueue_.blocksize()) / (float)audioqueue_.capacity();
+        ratio = (audioqueue_.size() * audioqueue_.blocksize()) / (float)audioqueue_.capacity();
     } else {
         ratio = 0.0f;
     }
@@ -725,7 +876,7 @@ int32_t source_desc::get_buffer_fill_ratio(float &ratio){
 
 void source_desc::update(const sink &s){
     // take writer lock!
-    unique_lock lock(mutex_);
+    rt_unique_lock lock(mutex_);
     do_update(s);
 }
 
@@ -742,6 +893,7 @@ void source_desc::do_update(const sink &s){
         auto nsamples = decoder_->nchannels() * decoder_->blocksize();
         audioqueue_.resize(nbuffers * nsamples, nsamples);
         infoqueue_.resize(nbuffers, 1);
+        do_bind_queues(s);
         int count = 0;
         while (audioqueue_.write_available() && infoqueue_.write_available()){
             audioqueue_.write_commit();
@@ -760,6 +912,9 @@ void source_desc::do_update(const sink &s){
         // setup resampler
         resampler_.setup(decoder_->blocksize(), s.blocksize(),
                             decoder_->samplerate(), s.samplerate(), decoder_->nchannels());
+        // scratch buffer for process()
+        processbuffer_.resize(s.blocksize() * decoder_->nchannels());
+        blocksize_error_ = false;
         // resize block queue
         blockqueue_.resize(nbuffers + 8); // (32) extra capacity for network jitter (allows lower buffersizes) (should be option?)
         newest_ = 0;
@@ -768,6 +923,8 @@ void source_desc::do_update(const sink &s){
         channel_ = 0;
         samplerate_ = decoder_->samplerate();
         streamstate_.reset();
+        transit_.reset();
+        rtt_ = 0;
         ack_list_.set_limit(s.resend_limit());
         ack_list_.clear();
 
@@ -780,12 +937,29 @@ void source_desc::do_update(const sink &s){
     }
 }
 
+void source_desc::bind_queues(const sink &s){
+    // take writer lock!
+    rt_unique_lock lock(mutex_);
+    do_bind_queues(s);
+}
+
+void source_desc::do_bind_queues(const sink &s){
+    auto node = s.numa_node();
+    if (node >= 0){
+        // the info queue is typically smaller than a page (best effort)
+        bind_memory(infoqueue_.storage(), node);
+        if (!bind_memory(audioqueue_.storage(), node)){
+            LOG_WARNING("aoo_sink: couldn't bind audio queue to NUMA node " << node);
+        }
+    }
+}
+
 // /aoo/sink/<id>/format <src> <salt> <numchannels> <samplerate> <blocksize> <codec> <settings...>
 
 int32_t source_desc::handle_format(const sink& s, int32_t salt, const aoo_format& f,
                                    const char *settings, int32_t size, int32_t version){
     // take writer lock!
-    unique_lock lock(mutex_);
+    rt_unique_lock lock(mutex_);
 
     salt_ = salt;
 
@@ -822,11 +996,11 @@ int32_t source_desc::handle_format(const sink& s, int32_t salt, const aoo_format
     return 1;
 }
 
-// /aoo/sink/<id>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data>
+// /aoo/sink/<id>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data> [<time>]
 
 int32_t source_desc::handle_data(const sink& s, int32_t salt, const aoo::data_packet& d){
     // synchronize with update()!
-    shared_lock lock(mutex_);
+    rt_shared_lock lock(mutex_);
 
     // the source format might have changed and we haven't noticed,
     // e.g. because of dropped UDP packets.
@@ -852,6 +1026,12 @@ int32_t source_desc::handle_data(const sink& s, int32_t salt, const aoo::data_pa
         nextneedsfadein_ = next_;
     }
 
+    // update transit time statistics
+    update_transit(d);
+
+    // update resend round trip time
+    update_rtt(s, d);
+
     // check data packet
     if (!check_packet(d)){
         return 0;
@@ -928,10 +1108,12 @@ bool source_desc::send(const sink& s){
 }
 
 bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int32_t numsampleframes){
-    // synchronize with handle_format() and update()!
-    // the mutex should be uncontended most of the time.
-    // NOTE: We could use try_lock() and skip the block if we couldn't aquire the lock.
-    shared_lock lock(mutex_);
+    // synchronize with handle_format() and update() without taking a lock.
+    // if the state is currently being updated, we just skip the block.
+    rt_lock lock(mutex_);
+    if (!lock.owns_lock()){
+        return false;
+    }
 
     if (!decoder_){
         return false;
@@ -1013,8 +1195,17 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
     
     //LOG_VERBOSE("s.blocksize: " << s.blocksize() << "  size: " << numsampleframes << "  stride: " << stride << " readsamp: " << readsamples << " ravail: " << resampler_.read_available() << " wavail: " << resampler_.write_available());
     
+    if (readsamples > (int32_t)processbuffer_.size()){
+        // don't flood the log from the audio thread
+        if (!blocksize_error_){
+            LOG_ERROR("aoo_sink: process() called with more samples than the blocksize passed to setup()");
+            blocksize_error_ = true;
+        }
+        return false;
+    }
+
     if (resampler_.read_available() >= readsamples){
-        auto buf = (aoo_sample *)alloca(readsamples * sizeof(aoo_sample));
+        auto buf = processbuffer_.data();
         resampler_.read(buf, readsamples);
 
         // sum source into sink (interleaved -> non-interleaved),
@@ -1066,20 +1257,30 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
 }
 
 int32_t source_desc::handle_events(aoo_eventhandler fn, void *user){
+    auto dropped = eventqueue_.dropped();
+    if (dropped > 0){
+        LOG_WARNING("aoo_sink: event queue full, dropped " << dropped << " events");
+    }
     // copy events - always lockfree! (the eventqueue is never resized)
-    auto n = eventqueue_.read_available();
-    if (n > 0){
-        auto events = (event *)alloca(sizeof(event) * n);
-        for (int i = 0; i < n; ++i){
-            eventqueue_.read(events[i]);
+    auto n = eventqueue_.size();
+    int32_t total = 0;
+    // copy events in batches of fixed size
+    while (total < n){
+        event events[AOO_EVENTBATCHSIZE];
+        const aoo_event *vec[AOO_EVENTBATCHSIZE];
+        int32_t count = 0;
+        while (count < AOO_EVENTBATCHSIZE && total + count < n
+               && eventqueue_.pop(events[count])){
+            vec[count] = (aoo_event *)&events[count];
+            count++;
         }
-        auto vec = (const aoo_event **)alloca(sizeof(aoo_event *) * n);
-        for (int i = 0; i < n; ++i){
-            vec[i] = (aoo_event *)&events[i];
+        if (count == 0){
+            break;
         }
-        fn(user, vec, n);
+        fn(user, vec, count);
+        total += count;
     }
-    return n;
+    return total;
 }
 
 bool source_desc::check_packet(const data_packet &d){
@@ -1105,8 +1306,12 @@ bool source_desc::check_packet(const data_packet &d){
 
     // check and update newest sequence number
     if (diff < 0){
-        // TODO the following distinction doesn't seem to work reliably.
-        if (ack_list_.find(d.sequence)){
+        // If the source sends time stamps, we can reliably tell resent
+        // blocks from reordered blocks because the former don't have any.
+        // TODO the fallback doesn't seem to work reliably.
+        bool resent = transit_.valid() ? !d.timestamp
+                                       : ack_list_.find(d.sequence) != nullptr;
+        if (resent){
             LOG_DEBUG("resent block " << d.sequence);
             streamstate_.add_resent(1);
         } else {
@@ -1135,7 +1340,9 @@ bool source_desc::check_packet(const data_packet &d){
         // push empty blocks to keep the buffer full, but leave room for one block!
         int count = 0;
         auto nsamples = audioqueue_.blocksize();
-        while (audioqueue_.write_available() > 1 && infoqueue_.write_available() > 1){
+        // NOTE: write_available() might underestimate, so we need the exact size.
+        auto nblocks = audioqueue_.capacity() / nsamples;
+        while ((nblocks - audioqueue_.size()) > 1 && infoqueue_.write_available()){
             auto ptr = audioqueue_.write_data();
             if (!decoder_->decode(nullptr, 0, ptr, nsamples)) {
                 LOG_WARNING("decode failed nsamples: " << nsamples << " audioqavail: " << audioqueue_.write_available());
@@ -1171,6 +1378,40 @@ bool source_desc::check_packet(const data_packet &d){
     return true;
 }
 
+void source_desc::update_transit(const data_packet &d){
+    // only original blocks carry a time stamp;
+    // resent blocks would distort the statistics anyway.
+    if (d.timestamp){
+        auto period = (double)decoder_->blocksize() / (double)decoder_->samplerate();
+        transit_.update(d.sequence, d.timestamp, aoo_osctime_get(), period);
+    #if AOO_DEBUG_BLOCK_BUFFER
+        DO_LOG("transit: mean = " << (transit_.mean() * 1000.0)
+               << " ms, deviation = " << (transit_.deviation() * 1000.0) << " ms");
+    #endif
+    }
+}
+
+void source_desc::update_rtt(const sink &s, const data_packet &d){
+    // measure the time between the resend request and the arrival
+    // of the (first frame of the) resent block. Following Karn's rule,
+    // we ignore blocks which have been requested more than once.
+    // If the source sends time stamps, we can also ignore late originals.
+    if (d.sequence >= newest_ || (transit_.valid() && d.timestamp)
+            || blockqueue_.find(d.sequence)){
+        return;
+    }
+    auto ack = ack_list_.find(d.sequence);
+    if (ack && ack->attempts() == 1){
+        auto rtt = s.elapsed_time() - ack->timestamp();
+        if (rtt_ > 0){
+            rtt_ += (rtt - rtt_) * 0.125;
+        } else {
+            rtt_ = rtt;
+        }
+        LOG_DEBUG("resend round trip time: " << (rtt_ * 1000.0) << " ms");
+    }
+}
+
 bool source_desc::add_packet(const data_packet& d){
     auto block = blockqueue_.find(d.sequence);
     if (!block){
@@ -1187,7 +1428,8 @@ bool source_desc::add_packet(const data_packet& d){
                 // push empty blocks to keep the buffer full, but leave room for one block!
                 int count = 0;
                 auto nsamples = audioqueue_.blocksize();
-                while (audioqueue_.write_available() > 1 && infoqueue_.write_available() > 1){
+                auto nblocks = audioqueue_.capacity() / nsamples;
+                while ((nblocks - audioqueue_.size()) > 1 && infoqueue_.write_available()){
                     auto ptr = audioqueue_.write_data();
                     decoder_->decode(nullptr, 0, ptr, nsamples);
                     audioqueue_.write_commit();
@@ -1208,7 +1450,7 @@ bool source_desc::add_packet(const data_packet& d){
                 if (audioqueue_.write_available() && infoqueue_.write_available()){
                     auto ptr = audioqueue_.write_data();
                     auto nsamples = audioqueue_.blocksize();
-                    decoder_->decode(nullptr, 0, ptr, nsamples);
+                    decode_lost(ptr, nsamples);
                     audioqueue_.write_commit();
                     // push nominal samplerate + current channel
                     block_info i;
@@ -1232,6 +1474,13 @@ bool source_desc::add_packet(const data_packet& d){
         int chan = d.channel >= 0 ? d.channel : channel_;
         block = blockqueue_.insert(d.sequence, srate,
                                    chan, d.totalsize, d.nframes);
+    } else if (d.nframes != block->num_frames()){
+        // the source has changed our packet size in the middle of the block
+        // (e.g. while probing), so the frame doesn't fit. This only happens
+        // on the rare occasion of a packet size change.
+        LOG_VERBOSE("frame " << d.framenum << " of block " << d.sequence
+                    << " has a different frame size!");
+        return false;
     } else if (block->has_frame(d.framenum)){
         LOG_VERBOSE("frame " << d.framenum << " of block " << d.sequence << " already received!");
         return false;
@@ -1262,6 +1511,7 @@ void source_desc::process_blocks(){
     {
         const char *data;
         int32_t size;
+        const block *partial = nullptr;
         block_info i;
         const bool dofadein = b->sequence == nextneedsfadein_;
         
@@ -1282,10 +1532,18 @@ void source_desc::process_blocks(){
             i.channel = channel_;
 
             if (b->sequence == next){
+                // PCM frames map to contiguous sample ranges,
+                // so we can still use the frames we've got.
+                if (b->frame_size() > 0 && !strcmp(decoder_->name(), AOO_CODEC_PCM)){
+                    partial = b;
+                    i.sr = b->samplerate;
+                    i.channel = b->channel;
+                }
                 b++;
             }
 
-            LOG_VERBOSE("dropped block " << next);
+            LOG_VERBOSE((partial ? "concealed missing frames of block " : "dropped block ")
+                        << next);
             streamstate_.add_lost(1);
         } else {
             // wait for block
@@ -1297,11 +1555,21 @@ void source_desc::process_blocks(){
         // decode data and push samples
         auto ptr = audioqueue_.write_data();
         auto nsamples = audioqueue_.blocksize();
-        // decode audio data
-        if (decoder_->decode(data, size, ptr, nsamples) < 0){
-            LOG_WARNING("aoo_sink: couldn't decode block!");
+        // decode audio data; partial blocks are faded in
+        // resp. crossfaded just like complete blocks.
+        if (!data && !partial){
+            decode_lost(ptr, nsamples);
+            if (dofadein){
+                // fade in the next block instead
+                nextneedsfadein_ = next;
+            }
+        } else if (!(partial ? decode_partial(*partial, ptr, nsamples)
+                             : decoder_->decode(data, size, ptr, nsamples) >= 0)){
+            LOG_WARNING("aoo_sink: couldn't decode " << (partial ? "partial " : "")
+                        << "block!");
             // decoder failed - fill with zeros
             std::fill(ptr, ptr + nsamples, 0);
+            concealed_ = false;
         }
         else if (dofadein) {
             // fade the samples in
@@ -1318,6 +1586,10 @@ void source_desc::process_blocks(){
             }                   
             
             nextneedsfadein_ = -1;
+            concealed_ = false;
+        } else if (concealed_){
+            // crossfade out of the concealed gap
+            crossfade_block(ptr, nsamples);
         }
         audioqueue_.write_commit();
 
@@ -1339,6 +1611,140 @@ void source_desc::process_blocks(){
     LOG_DEBUG("next: " << next_);
 }
 
+// Conceal a gap in interleaved audio by crossfading the signal
+// mirrored at the left edge into the signal mirrored at the right edge.
+// This keeps the waveform continuous at both edges of the gap.
+// 'limit' is the end of the valid audio after the gap (e.g. the start
+// of the next gap); beyond that we fade towards zero.
+static void conceal_gap(aoo_sample *buf, int32_t limit, int32_t nchannels,
+                        int32_t onset, int32_t length)
+{
+    auto end = onset + length;
+    for (int32_t j = 0; j < length; ++j){
+        auto left = onset - 1 - j;
+        auto right = end + length - 1 - j;
+        auto x = ((float)j + 0.5f) / (float)length;
+        for (int32_t i = 0; i < nchannels; ++i){
+            auto a = left >= 0 ? buf[left * nchannels + i] : 0;
+            auto b = right < limit ? buf[right * nchannels + i] : 0;
+            buf[(onset + j) * nchannels + i] = a * (1.f - x) + b * x;
+        }
+    }
+}
+
+bool source_desc::decode_partial(const block &b, aoo_sample *buffer, int32_t nsamples){
+    // missing frames contain garbage, see below.
+    if (decoder_->decode(b.data(), b.size(), buffer, nsamples) <= 0){
+        return false;
+    }
+    auto nchannels = decoder_->nchannels();
+    auto nframes = nsamples / nchannels;
+    auto framesize = b.frame_size();
+    auto numframes = b.num_frames();
+    // PCM has a fixed number of bytes per sample
+    auto ratio = (double)nsamples / (double)b.size();
+    // find the next run of missing frames, starting from frame 'i',
+    // and get the corresponding range of sample frames.
+    // returns the frame after the run (or 'numframes' if there is none).
+    auto next_gap = [&](int32_t i, int32_t& start, int32_t& stop){
+        while (i < numframes && b.has_frame(i)){
+            i++;
+        }
+        if (i == numframes){
+            start = stop = nframes;
+            return i;
+        }
+        // merge adjacent missing frames
+        auto first = i;
+        while (i < numframes && !b.has_frame(i)){
+            i++;
+        }
+        auto onset = first * framesize;
+        auto end = std::min<int32_t>(i * framesize, b.size());
+        // frames don't necessarily end on sample boundaries,
+        // so we round outwards to whole sample frames.
+        start = (int32_t)(onset * ratio) / nchannels;
+        stop = std::min<int32_t>(((int32_t)std::ceil(end * ratio) + nchannels - 1) / nchannels, nframes);
+        return i;
+    };
+    // first silence all gaps, so that we never read garbage
+    int32_t start, stop;
+    for (int32_t i = next_gap(0, start, stop); start < nframes; i = next_gap(i, start, stop)){
+        if (stop > start){
+            std::fill(buffer + start * nchannels, buffer + stop * nchannels, 0);
+        }
+    }
+    // then conceal each gap with the received audio up to the next gap
+    int32_t i = next_gap(0, start, stop);
+    while (start < nframes){
+        int32_t nextstart, nextstop;
+        i = next_gap(i, nextstart, nextstop);
+        if (stop > start){
+            conceal_gap(buffer, nextstart, nchannels, start, stop - start);
+        }
+        start = nextstart;
+        stop = nextstop;
+    }
+    return true;
+}
+
+void source_desc::decode_lost(aoo_sample *buffer, int32_t nsamples){
+    // use the codec's packet loss concealment, if available;
+    // otherwise we have to do it ourselves.
+    auto result = decoder_->decode(nullptr, 0, buffer, nsamples);
+    if (result == 0){
+        conceal_block(buffer, nsamples);
+        concealed_ = true;
+    } else {
+        if (result < 0){
+            std::fill(buffer, buffer + nsamples, 0);
+        }
+        concealed_ = false;
+    }
+}
+
+// Replace a lost block with the time reversed previous block, faded out
+// with a raised cosine window. The time reversal keeps the waveform
+// continuous at the block boundary.
+void source_desc::conceal_block(aoo_sample *buffer, int32_t nsamples){
+    auto nchannels = decoder_->nchannels();
+    auto nframes = nsamples / nchannels;
+    // NOTE: the previous block is the current block if the queue only has a single block
+    auto prev = audioqueue_.last_write_data();
+    if (prev != buffer){
+        std::copy(prev, prev + nsamples, buffer);
+    }
+    for (int32_t j = 0, k = nframes - 1; j < k; ++j, --k){
+        std::swap_ranges(buffer + j * nchannels, buffer + (j + 1) * nchannels,
+                         buffer + k * nchannels);
+    }
+    for (int32_t j = 0; j < nframes; ++j){
+        auto gain = 0.5 + 0.5 * std::cos(M_PI * (j + 0.5) / nframes);
+        for (int32_t i = 0; i < nchannels; ++i){
+            buffer[j * nchannels + i] *= gain;
+        }
+    }
+}
+
+// Crossfade from the time reversed (concealed) previous block into the current block.
+void source_desc::crossfade_block(aoo_sample *buffer, int32_t nsamples){
+    concealed_ = false;
+    auto prev = audioqueue_.last_write_data();
+    if (prev == buffer){
+        return;
+    }
+    auto nchannels = decoder_->nchannels();
+    auto nframes = nsamples / nchannels;
+    for (int32_t j = 0; j < nframes; ++j){
+        auto fadein = 0.5 - 0.5 * std::cos(M_PI * (j + 0.5) / nframes);
+        auto src = prev + (nframes - 1 - j) * nchannels;
+        auto dst = buffer + j * nchannels;
+        for (int32_t i = 0; i < nchannels; ++i){
+            dst[i] = dst[i] * fadein + src[i] * (1.0 - fadein);
+        }
+    }
+}
+
 void source_desc::check_outdated_blocks(){
     // pop outdated blocks (shouldn't really happen...)
     while (!blockqueue_.empty() &&
@@ -1370,55 +1776,62 @@ void source_desc::check_missing_blocks(const sink& s){
         }
         return;
     }
-    // don't check below a certain threshold,
-    // because we might just experience packet reordering.
-    // TODO find something better
-    if (blockqueue_.size() < AOO_BLOCKQUEUE_CHECK_THRESHOLD){
+    // If the source sends capture time stamps, we know when a block
+    // should have arrived and only request it once it is overdue;
+    // until then it is merely late (e.g. because of packet reordering).
+    // Otherwise we don't check below a certain threshold.
+    bool timing = transit_.valid();
+    if (!timing && blockqueue_.size() < AOO_BLOCKQUEUE_CHECK_THRESHOLD){
         return;
     }
+    time_tag now = timing ? aoo_osctime_get() : 0;
 #if LOGLEVEL >= 4
     std::cerr << queue << std::endl;
 #endif
     int32_t numframes = 0;
+    int32_t skipped = 0;
+
+    // Request missing blocks and the missing frames of incomplete blocks
+    // in sequence order, i.e. the blocks closest to their playout deadline
+    // come first. This way a limited resend budget is spent where it
+    // actually prevents dropouts. Blocks which can't possibly arrive
+    // before they are needed by process_blocks() are skipped.
+    auto elapsed = s.elapsed_time();
+    auto interval = s.resend_interval();
+    auto maxnumframes = s.resend_maxnumframes();
+    auto period = (double)decoder_->blocksize() / (double)decoder_->samplerate();
+    // blocks which are already waiting in the audio buffer
+    auto buffered = audioqueue_.size();
+    auto too_late = [&](int32_t seq){
+        // time until the block is read by the audio thread
+        auto deadline = (buffered + seq - next_) * period;
+        return rtt_ > 0 && deadline < rtt_;
+    };
 
-    // resend incomplete blocks except for the last block
-    LOG_DEBUG("resend incomplete blocks");
-    for (auto it = blockqueue_.begin(); it != (blockqueue_.end() - 1); ++it){
-        if (!it->complete() && resendqueue_.write_available()){
-            // insert ack (if needed)
-            auto& ack = ack_list_.get(it->sequence);
-            if (ack.update(s.elapsed_time(), s.resend_interval())){
-                for (int i = 0; i < it->num_frames(); ++i){
-                    if (!it->has_frame(i)){
-                        if (numframes < s.resend_maxnumframes()){
-                            resendqueue_.write(data_request { it->sequence, i });
-                            numframes++;
-                        } else {
-                            goto resend_incomplete_done;
-                        }
-                    }
-                }
-            }
-        }
-    }
-resend_incomplete_done:
-
-    // resend missing blocks before any (half)completed blocks
     LOG_DEBUG("resend missing blocks");
     int32_t next = next_;
     for (auto it = blockqueue_.begin(); it != blockqueue_.end(); ++it){
+        // first request missing blocks before this block
         auto missing = it->sequence - next;
         if (missing > 0){
-            for (int i = 0; i < missing && resendqueue_.write_available(); ++i){
+            for (int i = 0; i < missing; ++i){
+                auto seq = next + i;
+                if (timing && !transit_.overdue(seq, now)){
+                    goto resend_done; // not lost (yet)
+                }
+                if (too_late(seq)){
+                    skipped++;
+                    continue;
+                }
+                if (numframes + it->num_frames() > maxnumframes
+                        || !resendqueue_.write_available()){
+                    goto resend_done;
+                }
                 // insert ack (if necessary)
-                auto& ack = ack_list_.get(next + i);
-                if (ack.update(s.elapsed_time(), s.resend_interval())){
-                    if (numframes + it->num_frames() <= s.resend_maxnumframes()){
-                        resendqueue_.write(data_request { next + i, -1 }); // whole block
-                        numframes += it->num_frames();
-                    } else {
-                        goto resend_missing_done;
-                    }
+                auto& ack = ack_list_.get(seq);
+                if (ack.update(elapsed, interval)){
+                    resendqueue_.write(data_request { seq, -1 }); // whole block
+                    numframes += it->num_frames();
                 }
             }
         } else if (missing < 0){
@@ -1426,13 +1839,43 @@ resend_incomplete_done:
             assert(false);
         }
         next = it->sequence + 1;
+
+        // then request missing frames of this block
+        if (!it->complete()){
+            if (timing ? !transit_.overdue(it->sequence, now)
+                       : it == (blockqueue_.end() - 1)){
+                // without timing data, the last block might still be arriving
+                goto resend_done;
+            }
+            if (too_late(it->sequence)){
+                skipped++;
+                continue;
+            }
+            // insert ack (if needed)
+            auto& ack = ack_list_.get(it->sequence);
+            if (ack.update(elapsed, interval)){
+                for (int i = 0; i < it->num_frames(); ++i){
+                    if (!it->has_frame(i)){
+                        if (numframes < maxnumframes && resendqueue_.write_available()){
+                            resendqueue_.write(data_request { it->sequence, i });
+                            numframes++;
+                        } else {
+                            goto resend_done;
+                        }
+                    }
+                }
+            }
+        }
     }
-resend_missing_done:
+resend_done:
 
     assert(numframes <= s.resend_maxnumframes());
     if (numframes > 0){
         LOG_DEBUG("requested " << numframes << " frames");
     }
+    if (skipped > 0){
+        LOG_DEBUG("skipped " << skipped << " blocks which can't arrive in time");
+    }
 
 #if 1
     // clean ack list
@@ -1452,8 +1895,9 @@ resend_missing_done:
 bool source_desc::send_format_request(const sink& s) {
     if (streamstate_.need_format()){
         LOG_VERBOSE("request format for source " << id_);
-        char buf[AOO_MAXPACKETSIZE];
-        osc::OutboundPacketStream msg(buf, sizeof(buf));
+        int32_t bufsize;
+        auto buf = get_packet_buffer(bufsize);
+        osc::OutboundPacketStream msg(buf, bufsize);
 
         // make OSC address pattern
         const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN +
@@ -1479,8 +1923,9 @@ bool source_desc::send_format_request(const sink& s) {
 bool source_desc::send_codec_change_request(const sink& s) {
     if (streamstate_.need_codec_change()){
         LOG_VERBOSE("request change of codec for source " << id_);
-        char buf[AOO_MAXPACKETSIZE];
-        osc::OutboundPacketStream msg(buf, sizeof(buf));
+        int32_t bufsize;
+        auto buf = get_packet_buffer(bufsize);
+        osc::OutboundPacketStream msg(buf, bufsize);
 
         int32_t size = 0;
         const aoo_format_storage & f = streamstate_.get_codec_change_format(size);
@@ -1507,16 +1952,13 @@ bool source_desc::send_codec_change_request(const sink& s) {
 
 int32_t source_desc::send_data_request(const sink &s){
     // called without lock!
-    shared_lock lock(mutex_);
+    rt_shared_lock lock(mutex_);
     int32_t salt = salt_;
     lock.unlock();
 
     int32_t numrequests = 0;
     while ((numrequests = resendqueue_.read_available()) > 0){
         // send request messages
-        char buf[AOO_MAXPACKETSIZE];
-        osc::OutboundPacketStream msg(buf, sizeof(buf));
-
         // make OSC address pattern
         const int32_t maxaddrsize = AOO_MSG_DOMAIN_LEN +
                 AOO_MSG_SOURCE_LEN + 16 + AOO_MSG_DATA_LEN;
@@ -1529,6 +1971,11 @@ int32_t source_desc::send_data_request(const sink &s){
         auto d = div(numrequests, maxrequests);
 
         auto dorequest = [&](int32_t n){
+            // get a new buffer for each message!
+            int32_t bufsize;
+            auto buf = get_packet_buffer(bufsize, s.packetsize());
+            osc::OutboundPacketStream msg(buf, bufsize);
+
             msg << osc::BeginMessage(address) << s.id() << salt;
             while (n--){
                 data_request request;
@@ -1567,8 +2014,9 @@ bool source_desc::send_notifications(const sink& s){
     #endif
             auto lost_blocks = streamstate_.get_lost_since_ping();
 
-            char buffer[AOO_MAXPACKETSIZE];
-            osc::OutboundPacketStream msg(buffer, sizeof(buffer));
+            int32_t bufsize;
+            auto buffer = get_packet_buffer(bufsize);
+            osc::OutboundPacketStream msg(buffer, bufsize);
 
             // make OSC address pattern
             const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
@@ -1592,8 +2040,9 @@ bool source_desc::send_notifications(const sink& s){
 
     auto invitation = streamstate_.get_invitation_state();
     if (invitation == stream_state::INVITE){
-        char buffer[AOO_MAXPACKETSIZE];
-        osc::OutboundPacketStream msg(buffer, sizeof(buffer));
+        int32_t bufsize;
+        auto buffer = get_packet_buffer(bufsize);
+        osc::OutboundPacketStream msg(buffer, bufsize);
 
         // make OSC address pattern
         const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
@@ -1610,8 +2059,9 @@ bool source_desc::send_notifications(const sink& s){
 
         didsomething = true;
     } else if (invitation == stream_state::UNINVITE){
-        char buffer[AOO_MAXPACKETSIZE];
-        osc::OutboundPacketStream msg(buffer, sizeof(buffer));
+        int32_t bufsize;
+        auto buffer = get_packet_buffer(bufsize);
+        osc::OutboundPacketStream msg(buffer, bufsize);
 
         // make OSC address pattern
         const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
@@ -127,6 +127,29 @@ struct block_info {
     int32_t channel;
 };
 
+// Estimate the network transit time of data blocks from the
+// capture time stamps sent by the source (similar to the RTT
+// estimation in RFC 6298). The unknown clock offset between source
+// and sink is part of the mean, but it cancels out because we only
+// compare it against other arrival times.
+class transit_estimator {
+public:
+    void reset();
+    bool valid() const { return count_ > 0; }
+    void update(int32_t seq, time_tag capture, time_tag arrival, double period);
+    // check if a block should have arrived by now
+    bool overdue(int32_t seq, time_tag now) const;
+    double mean() const { return mean_; }
+    double deviation() const { return dev_; }
+private:
+    double reftime_ = 0; // capture time of most recent block
+    int32_t refseq_ = 0; // sequence number of most recent block
+    double period_ = 0;
+    double mean_ = 0;
+    double dev_ = 0;
+    int32_t count_ = 0;
+};
+
 class sink;
 
 class source_desc {
@@ -152,7 +175,7 @@ public:
 
     void *endpoint() const { return endpoint_; }
 
-    bool has_events() const { return  eventqueue_.read_available() > 0; }
+    bool has_events() const { return eventqueue_.size() > 0; }
 
     int32_t get_format(aoo_format_storage& format);
     
@@ -165,6 +188,8 @@ public:
     // methods
     void update(const sink& s);
 
+    void bind_queues(const sink& s);
+
     int32_t handle_format(const sink& s, int32_t salt, const aoo_format& f,
                           const char *settings, int32_t size, int32_t version);
 
@@ -194,13 +219,27 @@ private:
         int32_t frame;
     };
     void do_update(const sink& s);
+
+    void do_bind_queues(const sink& s);
     // handle messages
     bool check_packet(const data_packet& d);
 
+    void update_transit(const data_packet& d);
+
+    void update_rtt(const sink& s, const data_packet& d);
+
     bool add_packet(const data_packet& d);
 
     void process_blocks();
 
+    bool decode_partial(const block& b, aoo_sample *buffer, int32_t nsamples);
+
+    void decode_lost(aoo_sample *buffer, int32_t nsamples);
+
+    void conceal_block(aoo_sample *buffer, int32_t nsamples);
+
+    void crossfade_block(aoo_sample *buffer, int32_t nsamples);
+
     void check_outdated_blocks();
 
     void check_missing_blocks(const sink& s);
@@ -226,27 +265,28 @@ private:
     int32_t newest_ = 0; // sequence number of most recent incoming block
     int32_t next_ = 0; // next outgoing block
     int32_t nextneedsfadein_ = -1; // sequence number that needs fadein
+    bool concealed_ = false; // last block has been concealed
     int32_t channel_ = 0; // recent channel onset
     double samplerate_ = 0; // recent samplerate
     int32_t protocol_flags_ = 0; // protocol flags sent from the remote source
     stream_state streamstate_;
+    transit_estimator transit_;
+    double rtt_ = 0; // smoothed resend round trip time (0: unknown)
     // queues and buffers
     block_queue blockqueue_;
     block_ack_list ack_list_;
     lockfree::queue<aoo_sample> audioqueue_;
     lockfree::queue<block_info> infoqueue_;
     lockfree::queue<data_request> resendqueue_;
-    lockfree::queue<event> eventqueue_;
-    spinlock eventqueuelock_;
+    lockfree::mpsc_queue<event> eventqueue_;
     void push_event(const event& e){
-        scoped_lock<spinlock> l(eventqueuelock_);
-        if (eventqueue_.write_available()){
-            eventqueue_.write(e);
-        }
+        eventqueue_.push(e);
     }
     dynamic_resampler resampler_;
+    std::vector<aoo_sample> processbuffer_; // resampler output, see do_update()
+    bool blocksize_error_ = false; // only report once, see process()
     // thread synchronization
-    aoo::shared_mutex mutex_; // LATER replace with a spinlock?
+    aoo::rt_shared_mutex mutex_;
 };
 
 class sink final : public isink {
@@ -315,6 +355,8 @@ public:
 
     int32_t protocol_flags() const { return protocol_flags_; }
 
+    int32_t numa_node() const { return numa_node_; }
+
 private:
     // settings
     std::atomic<int32_t> id_;
@@ -329,7 +371,9 @@ private:
     std::atomic<int32_t> resend_limit_{ AOO_RESEND_LIMIT };
     std::atomic<float> resend_interval_{ AOO_RESEND_INTERVAL * 0.001 };
     std::atomic<int32_t> resend_maxnumframes_{ AOO_RESEND_MAXNUMFRAMES };
-    std::atomic<int32_t> protocol_flags_{ 0 };
+    std::atomic<int32_t> protocol_flags_{ AOO_PROTOCOL_FLAG_TIMESTAMP | AOO_PROTOCOL_FLAG_BINARY_DATA
+                                          | AOO_PROTOCOL_FLAG_PROBE };
+    std::atomic<int32_t> numa_node_{ -1 };
     // the sources
     lockfree::list<source_desc> sources_;
     // timing
@@ -353,8 +397,14 @@ private:
     int32_t handle_compact_data_message(void *endpoint, aoo_replyfn fn,
                                         const osc::ReceivedMessage& msg);
 
+    int32_t handle_binary_data_message(void *endpoint, aoo_replyfn fn,
+                                       const char *data, int32_t n);
+
     int32_t handle_ping_message(void *endpoint, aoo_replyfn fn,
                                 const osc::ReceivedMessage& msg);
+
+    int32_t handle_probe_message(void *endpoint, aoo_replyfn fn,
+                                 const osc::ReceivedMessage& msg, int32_t size);
 };
 
 } // aoo
@@ -3,6 +3,7 @@
  * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
 #include "source.hpp"
+#include "thread_utils.hpp"
 #include "aoo/aoo_utils.hpp"
 
 #include <cstring>
@@ -12,10 +13,10 @@
 
 /*//////////////////// AoO source /////////////////////*/
 
-#define AOO_DATA_HEADERSIZE 80
+#define AOO_DATA_HEADERSIZE 88
 // address pattern string: max 32 bytes
 // typetag string: max. 12 bytes
-// args (without blob data): 36 bytes
+// args (without blob data): 44 bytes (including optional time stamp)
 
 aoo_source * aoo_source_new(int32_t id) {
     return new aoo::source(id);
@@ -25,10 +26,12 @@ aoo::source::source(int32_t id)
     : id_(id)
 {
     // event queue
-    eventqueue_.resize(AOO_EVENTQUEUESIZE, 1);
+    eventqueue_.resize(AOO_EVENTQUEUESIZE);
     // request queues
     formatrequestqueue_.resize(64, 1);
     datarequestqueue_.resize(1024, 1);
+    // sinks
+    sinks_.store(new sink_list);
 }
 
 void aoo_source_free(aoo_source *src){
@@ -37,7 +40,10 @@ void aoo_source_free(aoo_source *src){
     delete static_cast<aoo::source *>(src);
 }
 
-aoo::source::~source() {}
+aoo::source::~source() {
+    reclaim_sinks();
+    delete sinks_.load();
+}
 
 template<typename T>
 T& as(void *p){
@@ -46,6 +52,15 @@ T& as(void *p){
 
 #define CHECKARG(type) assert(size == sizeof(type))
 
+// see sink_desc::group_member()
+static void check_multicast_channel(const aoo::sink_desc& sink){
+    if (sink.multicast.load() && sink.channel.load() != 0){
+        LOG_WARNING("aoo_source: sink " << sink.id << " has channel onset "
+                    << sink.channel.load() << " - skipped in multicast group, "
+                    << "sending directly instead");
+    }
+}
+
 int32_t aoo_source_set_option(aoo_source *src, int32_t opt, void *p, int32_t size)
 {
     return src->set_option(opt, p, size);
@@ -59,7 +74,7 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
     {
         auto newid = as<int32_t>(ptr);
         if (id_.exchange(newid) != newid){
-            unique_lock lock(update_mutex_); // writer lock!
+            rt_unique_lock lock(update_mutex_); // writer lock!
             update();
         }
         break;
@@ -71,7 +86,7 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
     // resume
     case aoo_opt_start:
     {
-        unique_lock lock(update_mutex_); // writer lock!
+        rt_unique_lock lock(update_mutex_); // writer lock!
         update();
         play_ = true;
         break;
@@ -87,7 +102,7 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
         auto bufsize = std::max<int32_t>(as<int32_t>(ptr), 0);
         if (bufsize != buffersize_){
             buffersize_ = bufsize;
-            unique_lock lock(update_mutex_); // writer lock!
+            rt_unique_lock lock(update_mutex_); // writer lock!
             update();
         }
         break;
@@ -101,12 +116,38 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
         if (packetsize < minpacketsize){
             LOG_WARNING("packet size too small! setting to " << minpacketsize);
             packetsize_ = minpacketsize;
-        } else if (packetsize > AOO_MAXPACKETSIZE){
-            LOG_WARNING("packet size too large! setting to " << AOO_MAXPACKETSIZE);
-            packetsize_ = AOO_MAXPACKETSIZE;
+        } else if (packetsize > AOO_MAXUDPPACKETSIZE){
+            LOG_WARNING("packet size too large! setting to " << AOO_MAXUDPPACKETSIZE);
+            packetsize_ = AOO_MAXUDPPACKETSIZE;
         } else {
             packetsize_ = packetsize;
         }
+        // the probes start from the source packet size
+        probe_generation_++;
+        break;
+    }
+    // max. probe packet size
+    case aoo_opt_probe_packetsize:
+    {
+        CHECKARG(int32_t);
+        auto maxsize = std::max<int32_t>(as<int32_t>(ptr), 0);
+        if (maxsize > AOO_MAXUDPPACKETSIZE){
+            LOG_WARNING("probe packet size too large! setting to " << AOO_MAXUDPPACKETSIZE);
+            maxsize = AOO_MAXUDPPACKETSIZE;
+        }
+        probe_packetsize_ = maxsize;
+        // restart probing
+        probe_generation_++;
+        if (maxsize == 0){
+            // go back to the source packet size
+            shared_lock lock(sink_mutex_); // reader lock!
+            for (auto& sink : current_sinks()){
+                if (sink.probe.load()){
+                    sink.probe_hi = 0;
+                    sink.packetsize = 0;
+                }
+            }
+        }
         break;
     }
     // dynamic resampling
@@ -134,7 +175,7 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
         auto bufsize = std::max<int32_t>(as<int32_t>(ptr), 0);
         if (bufsize != resend_buffersize_){
             resend_buffersize_ = bufsize;
-            unique_lock lock(update_mutex_); // writer lock!
+            rt_unique_lock lock(update_mutex_); // writer lock!
             update_historybuffer();
         }
         break;
@@ -149,6 +190,17 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(int32_t);
         respect_codec_change_req_ = as<int32_t>(ptr);
         break;
+    // NUMA node
+    case aoo_opt_numa_node:
+    {
+        CHECKARG(int32_t);
+        auto node = std::max<int32_t>(as<int32_t>(ptr), -1);
+        if (numa_node_.exchange(node) != node){
+            rt_unique_lock lock(update_mutex_); // writer lock!
+            bind_queues();
+        }
+        break;
+    }
     // unknown
     default:
         LOG_WARNING("aoo_source: unsupported option " << opt);
@@ -174,7 +226,7 @@ int32_t aoo::source::get_option(int32_t opt, void *ptr, int32_t size)
     case aoo_opt_format:
         CHECKARG(aoo_format_storage);
         if (encoder_){
-            shared_lock lock(update_mutex_); // read lock!
+            rt_shared_lock lock(update_mutex_); // read lock!
             return encoder_->get_format(as<aoo_format_storage>(ptr));
         } else {
             return 0;
@@ -200,6 +252,11 @@ int32_t aoo::source::get_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(int32_t);
         as<int32_t>(ptr) = packetsize_;
         break;
+    // max. probe packet size
+    case aoo_opt_probe_packetsize:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = probe_packetsize_;
+        break;
     // ping interval
     case aoo_opt_ping_interval:
         CHECKARG(int32_t);
@@ -210,6 +267,11 @@ int32_t aoo::source::get_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(int32_t);
         as<int32_t>(ptr) = redundancy_;
         break;
+    // NUMA node
+    case aoo_opt_numa_node:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = numa_node_;
+        break;
     // unknown
     default:
         LOG_WARNING("aoo_source: unsupported option " << opt);
@@ -236,14 +298,64 @@ int32_t aoo::source::set_sinkoption(void *endpoint, int32_t id,
             CHECKARG(int32_t);
             auto chn = as<int32_t>(ptr);
             shared_lock lock(sink_mutex_); // reader lock!
-            for (auto& sink : sinks_){
+            for (auto& sink : current_sinks()){
                 if (sink.user == endpoint){
                     sink.channel = chn;
+                    check_multicast_channel(sink);
                 }
             }
             LOG_VERBOSE("aoo_source: send to all sinks on channel " << chn);
             break;
         }
+        // encoder tier
+        case aoo_opt_tier:
+        {
+            CHECKARG(int32_t);
+            auto tier = as<int32_t>(ptr);
+            if (tier < 0 || tier >= AOO_MAXNUMTIERS){
+                LOG_ERROR("aoo_source: tier " << tier << " out of range!");
+                return 0;
+            }
+            shared_lock lock(sink_mutex_); // reader lock!
+            for (auto& sink : current_sinks()){
+                if (sink.user == endpoint && sink.tier.exchange(tier) != tier){
+                    sink.format_changed = true;
+                    // notify send_format()
+                    format_changed_ = true;
+                }
+            }
+            LOG_VERBOSE("aoo_source: send to all sinks on tier " << tier);
+            break;
+        }
+        // multicast
+        case aoo_opt_multicast:
+        {
+            CHECKARG(int32_t);
+            bool b = as<int32_t>(ptr) != 0;
+            shared_lock lock(sink_mutex_); // reader lock!
+            for (auto& sink : current_sinks()){
+                if (sink.user == endpoint){
+                    sink.multicast = b;
+                    check_multicast_channel(sink);
+                }
+            }
+            LOG_VERBOSE("aoo_source: " << (b ? "enable" : "disable")
+                        << " multicast for all sinks");
+            break;
+        }
+        // packet size
+        case aoo_opt_packetsize:
+        {
+            CHECKARG(int32_t);
+            auto packetsize = as<int32_t>(ptr);
+            shared_lock lock(sink_mutex_); // reader lock!
+            for (auto& sink : current_sinks()){
+                if (sink.user == endpoint){
+                    set_sink_packetsize(sink, packetsize);
+                }
+            }
+            break;
+        }
         // unknown
         default:
             LOG_WARNING("aoo_source: unsupported sink option " << opt);
@@ -269,6 +381,7 @@ int32_t aoo::source::set_sinkoption(void *endpoint, int32_t id,
                 sink->channel = chn;
                 LOG_VERBOSE("aoo_source: send to sink " << sink->id
                             << " on channel " << chn);
+                check_multicast_channel(*sink);
                 break;
             }
             case aoo_opt_protocol_flags:
@@ -280,6 +393,40 @@ int32_t aoo::source::set_sinkoption(void *endpoint, int32_t id,
                             << " flags " << flags);
                 break;
             }
+            // encoder tier
+            case aoo_opt_tier:
+            {
+                CHECKARG(int32_t);
+                auto tier = as<int32_t>(ptr);
+                if (tier < 0 || tier >= AOO_MAXNUMTIERS){
+                    LOG_ERROR("aoo_source: tier " << tier << " out of range!");
+                    return 0;
+                }
+                if (sink->tier.exchange(tier) != tier){
+                    // the sink has to receive the format of the new tier
+                    sink->format_changed = true;
+                    format_changed_ = true;
+                }
+                LOG_VERBOSE("aoo_source: send to sink " << sink->id
+                            << " on tier " << tier);
+                break;
+            }
+            // multicast
+            case aoo_opt_multicast:
+            {
+                CHECKARG(int32_t);
+                bool b = as<int32_t>(ptr) != 0;
+                sink->multicast = b;
+                LOG_VERBOSE("aoo_source: " << (b ? "enable" : "disable")
+                            << " multicast for sink " << sink->id);
+                check_multicast_channel(*sink);
+                break;
+            }
+            // packet size
+            case aoo_opt_packetsize:
+                CHECKARG(int32_t);
+                set_sink_packetsize(*sink, as<int32_t>(ptr));
+                break;
             // unknown
             default:
                 LOG_WARNING("aoo_source: unknown sink option " << opt);
@@ -317,6 +464,24 @@ int32_t aoo::source::get_sinkoption(void *endpoint, int32_t id,
             CHECKARG(int32_t);
             as<int32_t>(p) = sink->channel;
             break;
+        // encoder tier
+        case aoo_opt_tier:
+            CHECKARG(int32_t);
+            as<int32_t>(p) = sink->tier;
+            break;
+        // multicast
+        case aoo_opt_multicast:
+            CHECKARG(int32_t);
+            as<int32_t>(p) = sink->multicast;
+            break;
+        // packet size
+        case aoo_opt_packetsize:
+        {
+            CHECKARG(int32_t);
+            auto packetsize = sink->packetsize.load();
+            as<int32_t>(p) = packetsize > 0 ? packetsize : packetsize_.load();
+            break;
+        }
         // unknown
         default:
             LOG_WARNING("aoo_source: unsupported sink option " << opt);
@@ -330,6 +495,107 @@ int32_t aoo::source::get_sinkoption(void *endpoint, int32_t id,
     }
 }
 
+int32_t aoo_source_set_tier_format(aoo_source *src, int32_t tier, aoo_format *f){
+    return src->set_tier_format(tier, f);
+}
+
+int32_t aoo::source::set_tier_format(int32_t tier, aoo_format *f){
+    if (tier < 1 || tier >= AOO_MAXNUMTIERS){
+        LOG_ERROR("aoo_source: tier " << tier << " out of range!");
+        return 0;
+    }
+    rt_unique_lock lock(update_mutex_); // writer lock!
+    auto& t = tiers_[tier - 1];
+    if (f){
+        if (!encoder_){
+            LOG_ERROR("aoo_source: can't set tier format - no source format!");
+            return 0;
+        }
+        if (!t.encoder || strcmp(t.encoder->name(), f->codec)){
+            auto codec = aoo::find_codec(f->codec);
+            if (codec){
+                t.encoder = codec->create_encoder();
+            } else {
+                LOG_ERROR("codec '" << f->codec << "' not supported!");
+                return 0;
+            }
+            if (!t.encoder){
+                LOG_ERROR("couldn't create encoder!");
+                return 0;
+            }
+        }
+        // all tiers are fed with the same audio blocks
+        f->nchannels = encoder_->nchannels();
+        f->samplerate = encoder_->samplerate();
+        f->blocksize = encoder_->blocksize();
+        t.encoder->set_format(*f);
+        if (t.encoder->blocksize() != encoder_->blocksize()){
+            LOG_ERROR("aoo_source: codec '" << f->codec << "' doesn't support blocksize "
+                      << encoder_->blocksize() << " - removing tier " << tier);
+            t.encoder = nullptr;
+        } else {
+            t.encoder->reset();
+        }
+    } else {
+        t.encoder = nullptr;
+    }
+
+    update_historybuffer();
+
+    // sinks on this tier need the new format
+    shared_lock lock2(sink_mutex_);
+    for (auto& sink : current_sinks()){
+        if (sink.tier == tier){
+            sink.format_changed = true;
+        }
+    }
+    // notify send_format()
+    format_changed_ = true;
+
+    return t.encoder != nullptr || !f;
+}
+
+int32_t aoo_source_get_tier_format(aoo_source *src, int32_t tier, aoo_format_storage *f){
+    return src->get_tier_format(tier, *f);
+}
+
+int32_t aoo::source::get_tier_format(int32_t tier, aoo_format_storage& f){
+    if (tier < 0 || tier >= AOO_MAXNUMTIERS){
+        LOG_ERROR("aoo_source: tier " << tier << " out of range!");
+        return 0;
+    }
+    rt_shared_lock lock(update_mutex_); // reader lock!
+    auto enc = tier_encoder(tier);
+    if (enc){
+        return enc->get_format(f);
+    } else {
+        return 0;
+    }
+}
+
+int32_t aoo_source_set_multicast(aoo_source *src, void *group, aoo_replyfn fn){
+    return src->set_multicast(group, fn);
+}
+
+int32_t aoo::source::set_multicast(void *group, aoo_replyfn fn){
+    if (group && !fn){
+        LOG_ERROR("aoo_source: missing reply function for multicast group");
+        return 0;
+    }
+    unique_lock lock(sink_mutex_); // writer lock!
+    auto list = new sink_list;
+    list->sinks = current_sinks();
+    if (group){
+        // the data is addressed to all sinks in the group
+        list->group = endpoint(group, fn, AOO_ID_WILDCARD);
+        LOG_VERBOSE("aoo_source: enable multicast");
+    } else {
+        LOG_VERBOSE("aoo_source: disable multicast");
+    }
+    replace_sinks(list);
+    return 1;
+}
+
 int32_t aoo_source_setup(aoo_source *src, int32_t samplerate,
                          int32_t blocksize, int32_t nchannels){
     return src->setup(samplerate, blocksize, nchannels);
@@ -337,13 +603,17 @@ int32_t aoo_source_setup(aoo_source *src, int32_t samplerate,
 
 int32_t aoo::source::setup(int32_t samplerate,
                            int32_t blocksize, int32_t nchannels){
-    unique_lock lock(update_mutex_); // writer lock!
+    rt_unique_lock lock(update_mutex_); // writer lock!
     if (samplerate > 0 && blocksize > 0 && nchannels > 0)
     {
         nchannels_ = nchannels;
         samplerate_ = samplerate;
         blocksize_ = blocksize;
 
+        // scratch buffer for process()
+        processbuffer_.resize(blocksize * nchannels);
+        blocksize_error_ = false;
+
         // reset timer + time DLL filter
         timer_.setup(samplerate_, blocksize_);
 
@@ -361,13 +631,7 @@ int32_t aoo_source_add_sink(aoo_source *src, void *sink, int32_t id, aoo_replyfn
 
 int32_t aoo::source::add_sink(void *endpoint, int32_t id, aoo_replyfn fn){
     unique_lock lock(sink_mutex_); // writer lock!
-    if (id == AOO_ID_WILDCARD){
-        // first remove all sinks on the given endpoint!
-        auto it = std::remove_if(sinks_.begin(), sinks_.end(), [&](auto& s){
-            return s.user == endpoint;
-        });
-        sinks_.erase(it, sinks_.end());
-    } else {
+    if (id != AOO_ID_WILDCARD){
         // check if sink exists!
         auto result = find_sink(endpoint, id);
         if (result){
@@ -381,7 +645,16 @@ int32_t aoo::source::add_sink(void *endpoint, int32_t id, aoo_replyfn fn){
         }
     }
     // add sink descriptor
-    sinks_.emplace_back(endpoint, fn, id);
+    update_sinks([&](std::vector<sink_desc>& sinks){
+        if (id == AOO_ID_WILDCARD){
+            // first remove all sinks on the given endpoint!
+            auto it = std::remove_if(sinks.begin(), sinks.end(), [&](auto& s){
+                return s.user == endpoint;
+            });
+            sinks.erase(it, sinks.end());
+        }
+        sinks.emplace_back(endpoint, fn, id);
+    });
     // notify send_format()
     format_changed_ = true;
 
@@ -396,20 +669,26 @@ int32_t aoo::source::remove_sink(void *endpoint, int32_t id){
     unique_lock lock(sink_mutex_); // writer lock!
     if (id == AOO_ID_WILDCARD){
         // remove all sinks on the given endpoint
-        auto it = std::remove_if(sinks_.begin(), sinks_.end(), [&](auto& s){
-            return s.user == endpoint;
+        update_sinks([&](std::vector<sink_desc>& sinks){
+            auto it = std::remove_if(sinks.begin(), sinks.end(), [&](auto& s){
+                return s.user == endpoint;
+            });
+            sinks.erase(it, sinks.end());
         });
-        sinks_.erase(it, sinks_.end());
         return 1;
     } else {
-        for (auto it = sinks_.begin(); it != sinks_.end(); ++it){
+        auto& sinks = current_sinks();
+        for (auto it = sinks.begin(); it != sinks.end(); ++it){
             if (it->user == endpoint){
                 if (it->id == AOO_ID_WILDCARD){
                     LOG_WARNING("aoo_source: can't remove individual sink "
                                 << id << " because of wildcard!");
                     return 0;
                 } else if (it->id == id){
-                    sinks_.erase(it);
+                    auto index = it - sinks.begin();
+                    update_sinks([&](std::vector<sink_desc>& sinks){
+                        sinks.erase(sinks.begin() + index);
+                    });
                     return 1;
                 }
             }
@@ -425,7 +704,9 @@ void aoo_source_remove_all(aoo_source *src) {
 
 void aoo::source::remove_all(){
     unique_lock lock(sink_mutex_); // writer lock!
-    sinks_.clear();
+    update_sinks([](std::vector<sink_desc>& sinks){
+        sinks.clear();
+    });
 }
 
 int32_t aoo_source_handle_message(aoo_source *src, const char *data, int32_t n,
@@ -435,50 +716,61 @@ int32_t aoo_source_handle_message(aoo_source *src, const char *data, int32_t n,
 
 // /aoo/src/<id>/format <sink>
 int32_t aoo::source::handle_message(const char *data, int32_t n, void *endpoint, aoo_replyfn fn){
+    // first check the address pattern, so we don't have to
+    // parse the whole OSC message if it's not for us.
+    int32_t type, src;
+    auto onset = aoo_parse_pattern(data, n, &type, &src);
+    if (!onset){
+        LOG_WARNING("aoo_source: not an AoO message!");
+        return 0;
+    }
+    if (type != AOO_TYPE_SOURCE){
+        LOG_WARNING("aoo_source: not a source message!");
+        return 0;
+    }
+    if (src == AOO_ID_WILDCARD){
+        LOG_WARNING("aoo_source: can't handle wildcard messages (yet)!");
+        return 0;
+    }
+    if (src != id()){
+        LOG_WARNING("aoo_source: wrong source ID!");
+        return 0;
+    }
+    auto mtype = parse_msg_type(data, n, onset);
+    if (mtype == msg_type::unknown){
+        LOG_WARNING("unknown message " << data + onset);
+        return 0;
+    }
+
     try {
         osc::ReceivedPacket packet(data, n);
         osc::ReceivedMessage msg(packet);
 
-        int32_t type, src;
-        auto onset = aoo_parse_pattern(data, n, &type, &src);
-        if (!onset){
-            LOG_WARNING("aoo_source: not an AoO message!");
-            return 0;
-        }
-        if (type != AOO_TYPE_SOURCE){
-            LOG_WARNING("aoo_source: not a source message!");
-            return 0;
-        }
-        if (src == AOO_ID_WILDCARD){
-            LOG_WARNING("aoo_source: can't handle wildcard messages (yet)!");
-            return 0;
-        }
-        if (src != id()){
-            LOG_WARNING("aoo_source: wrong source ID!");
-            return 0;
-        }
-
-        auto pattern = msg.AddressPattern() + onset;
-        if (!strcmp(pattern, AOO_MSG_FORMAT)){
+        switch (mtype){
+        case msg_type::format:
             handle_format_request(endpoint, fn, msg);
             return 1;
-        } else if (!strcmp(pattern, AOO_MSG_DATA)){
+        case msg_type::data:
             handle_data_request(endpoint, fn, msg);
             return 1;
-        } else if (!strcmp(pattern, AOO_MSG_INVITE)){
+        case msg_type::invite:
             handle_invite(endpoint, fn, msg);
             return 1;
-        } else if (!strcmp(pattern, AOO_MSG_UNINVITE)){
+        case msg_type::uninvite:
             handle_uninvite(endpoint, fn, msg);
             return 1;
-        } else if (!strcmp(pattern, AOO_MSG_PING)){
+        case msg_type::ping:
             handle_ping(endpoint, fn, msg);
             return 1;
-        } else if (!strcmp(pattern, AOO_MSG_CODEC_CHANGE)){
+        case msg_type::codec_change:
             handle_codec_change(endpoint, fn, msg);
             return 1;
-        } else {
-            LOG_WARNING("unknown message " << pattern);
+        case msg_type::probe:
+            handle_probe(endpoint, fn, msg);
+            return 1;
+        default:
+            LOG_WARNING("aoo_source: unexpected message " << data + onset);
+            break;
         }
     } catch (const osc::Exception& e){
         LOG_ERROR("aoo_source: exception in handle_message: " << e.what());
@@ -498,6 +790,14 @@ int32_t aoo_source_send(aoo_source *src) {
 // We have to make a local copy of the sink list, but this should be
 // rather cheap in comparison to encoding and sending the audio data.
 int32_t aoo::source::send(){
+    // free old sink lists; we're the only thread which
+    // reads the sink list without holding the sink mutex.
+    reclaim_sinks();
+
+    // clear *before* reading the audio queue, so that process() will
+    // notify us about any block which we might miss in this pass.
+    send_pending_.store(false);
+
     if (!play_.load() && !activeplay_.load()){
         return false;
     }
@@ -520,6 +820,10 @@ int32_t aoo::source::send(){
         didsomething = true;
     }
 
+    if (send_probe()){
+        didsomething = true;
+    }
+
     return didsomething;
 }
 
@@ -562,9 +866,15 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
     }
     
     
-    // the mutex should be uncontended most of the time.
-    // NOTE: We could use try_lock() and skip the block if we couldn't aquire the lock.
-    shared_lock lock(update_mutex_);
+    // synchronize with update(), set_format(), etc. without taking a lock.
+    // if the state is currently being updated, we just skip the block.
+    rt_lock lock(update_mutex_);
+    if (!lock.owns_lock()){
+        // like above, count the skipped block, so that send_data()
+        // sends an empty block and the sinks stay in sync.
+        dropped_++;
+        return 0;
+    }
 
     if (!encoder_){
         return 0;
@@ -606,7 +916,15 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
     //auto insamples = blocksize_ * nchannels_;
     auto insamples = n * nchannels_;
     auto outsamples = audioqueue_.blocksize(); // encoder_->blocksize() * nchannels_;
-    auto *buf = (aoo_sample *)alloca(insamples * sizeof(aoo_sample));
+    if (insamples > (int32_t)processbuffer_.size()){
+        // don't flood the log from the audio thread
+        if (!blocksize_error_){
+            LOG_ERROR("aoo_source: process() called with more samples than the blocksize passed to setup()");
+            blocksize_error_ = true;
+        }
+        return 0;
+    }
+    auto *buf = processbuffer_.data();
 
     if (n > 0 && (dofadein || dofadeout || pushingSilence)) {
         const float fadedelta = dofadeout ? (-1.0f / n) : pushingSilence ? 0.0f : (1.0f / n);
@@ -632,6 +950,8 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
     // back calling with fewer samples. More importantly, this allows us to better decouple 
     // the audio process blocksize from the audioqueue blocksize (which matches the codec blocksize).
 
+    bool notify = false;
+
     //if (encoder_->blocksize() != blocksize_ || encoder_->samplerate() != samplerate_)
     {
         // go through resampler
@@ -639,6 +959,11 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
         auto * pbuf = buf;
 
         auto availsamples = resampler_.write_available();
+
+        // capture time of the first input sample
+        double t0 = time_tag(t).to_double();
+
+        bool newblocks = false;
         
         while (samplesleft > 0) {
             auto usesamples = std::min(samplesleft, availsamples);
@@ -652,21 +977,31 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
             
             while (resampler_.read_available() >= outsamples
                    && audioqueue_.write_available()
-                   && srqueue_.write_available())
+                   && infoqueue_.write_available())
             {
+                // estimate the capture time of the outgoing block:
+                // end of the consumed input minus the samples which are
+                // still buffered in the resampler.
+                auto consumed = (double)((insamples - samplesleft) / nchannels_) / samplerate_;
+                auto buffered = (double)(resampler_.read_available() / nchannels_) / encoder_->samplerate();
+
                 // copy audio samples
                 resampler_.read(audioqueue_.write_data(), outsamples);
                 audioqueue_.write_commit();
                 
-                // push samplerate
+                // push samplerate + time stamp
+                block_info info;
                 if (!ignoredll) {
                     auto ratio = (double)encoder_->samplerate() / (double)samplerate_;
-                    srqueue_.write(dll_.samplerate() * ratio);
+                    info.samplerate = dll_.samplerate() * ratio;
                 } else {
-                    srqueue_.write(encoder_->samplerate());
+                    info.samplerate = encoder_->samplerate();
                 }
+                info.time = t ? time_tag(t0 + consumed - buffered).to_uint64() : 0;
+                infoqueue_.write(info);
 
                 didconsume = true;
+                newblocks = true;
             }
 
             // now update after any processing
@@ -678,17 +1013,25 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
                 break;
             }
         }
+
+        // coalesce wakeups: only ask for a notification if we have new blocks
+        // and the send thread hasn't been notified since its last run.
+        // NOTE: exchange() is a full barrier, so the send thread either sees
+        // our blocks or clears the flag afterwards (see send()).
+        if (newblocks && !send_pending_.exchange(true)){
+            notify = true;
+        }
     } 
 #if 0
     else {
         // bypass resampler
-        if (audioqueue_.write_available() && srqueue_.write_available()){
+        if (audioqueue_.write_available() && infoqueue_.write_available()){
             // copy audio samples
             std::copy(buf, buf + outsamples, audioqueue_.write_data());
             audioqueue_.write_commit();
 
-            // push samplerate
-            srqueue_.write(dll_.samplerate());
+            // push samplerate + time stamp
+            infoqueue_.write(block_info { dll_.samplerate(), t });
         } else {
             // LOG_DEBUG("couldn't process");
         }
@@ -699,7 +1042,7 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
         pushing_silent_frames_ -= n;
     }
     
-    return 1;
+    return notify;
 }
 
 int32_t aoo_source_events_available(aoo_source *src){
@@ -707,7 +1050,7 @@ int32_t aoo_source_events_available(aoo_source *src){
 }
 
 int32_t aoo::source::events_available(){
-    return eventqueue_.read_available() > 0;
+    return eventqueue_.size() > 0;
 }
 
 int32_t aoo_source_handle_events(aoo_source *src,
@@ -717,34 +1060,44 @@ int32_t aoo_source_handle_events(aoo_source *src,
 
 int32_t aoo::source::handle_events(aoo_eventhandler fn, void *user){
     // always thread-safe
-    auto n = eventqueue_.read_available();
-    if (n > 0){
-        // copy events
-        auto events = (event *)alloca(sizeof(event) * n);
-        for (int i = 0; i < n; ++i){
-            eventqueue_.read(events[i]);
+    auto dropped = eventqueue_.dropped();
+    if (dropped > 0){
+        LOG_WARNING("aoo_source: event queue full, dropped " << dropped << " events");
+    }
+    auto n = eventqueue_.size();
+    int32_t total = 0;
+    // copy events in batches of fixed size
+    while (total < n){
+        event events[AOO_EVENTBATCHSIZE];
+        const aoo_event *vec[AOO_EVENTBATCHSIZE];
+        int32_t count = 0;
+        while (count < AOO_EVENTBATCHSIZE && total + count < n
+               && eventqueue_.pop(events[count])){
+            vec[count] = (aoo_event *)&events[count];
+            count++;
         }
-        auto vec = (const aoo_event **)alloca(sizeof(aoo_event *) * n);
-        for (int i = 0; i < n; ++i){
-            vec[i] = (aoo_event *)&events[i];
+        if (count == 0){
+            break;
         }
         // send events
-        fn(user, vec, n);
+        fn(user, vec, count);
+        total += count;
     }
-    return n;
+    return total;
 }
 
 namespace aoo {
 
 /*//////////////////////////////// endpoint /////////////////////////////////////*/
 
-// /aoo/sink/<id>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <nframes> <frame> <data>
+// /aoo/sink/<id>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <nframes> <frame> <data> [<time>]
 
 void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d) const{
     // call without lock!
 
-    char buf[AOO_MAXPACKETSIZE];
-    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    int32_t bufsize;
+    auto buf = get_packet_buffer(bufsize, d.size + AOO_DATA_HEADERSIZE);
+    osc::OutboundPacketStream msg(buf, bufsize);
 
     if (id != AOO_ID_WILDCARD){
         const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
@@ -760,7 +1113,14 @@ void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d) c
 
     msg << src << salt << d.sequence << d.samplerate << d.channel
         << d.totalsize << d.nframes << d.framenum
-        << osc::Blob(d.data, d.size) << osc::EndMessage;
+        << osc::Blob(d.data, d.size);
+
+    // optional capture time stamp
+    if (d.timestamp){
+        msg << osc::TimeTag(d.timestamp);
+    }
+
+    msg << osc::EndMessage;
 
     LOG_DEBUG("send block: seq = " << d.sequence << ", sr = " << d.samplerate
               << ", chn = " << d.channel << ", totalsize = " << d.totalsize
@@ -770,14 +1130,15 @@ void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d) c
     send(msg.Data(), (int32_t)msg.Size());
 }
 
-// /d <salt> <seq> <data>
-// /d <salt> <seq> <srate> <data>
+// /d <salt> <seq> <data> [<time>]
+// /d <salt> <seq> <srate> <data> [<time>]
 
-void endpoint::send_data_compact(int32_t src, int32_t salt, const aoo::data_packet& d, bool sendrate) {
+void endpoint::send_data_compact(int32_t src, int32_t salt, const aoo::data_packet& d, bool sendrate) const {
     // call without lock!
 
-    char buf[AOO_MAXPACKETSIZE];
-    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    int32_t bufsize;
+    auto buf = get_packet_buffer(bufsize, d.size + AOO_DATA_HEADERSIZE);
+    osc::OutboundPacketStream msg(buf, bufsize);
     
     msg << osc::BeginMessage(AOO_MSG_COMPACT_DATA);
 
@@ -790,7 +1151,14 @@ void endpoint::send_data_compact(int32_t src, int32_t salt, const aoo::data_pack
         msg << d.samplerate;
     }
     
-    msg << osc::Blob(d.data, d.size) << osc::EndMessage;
+    msg << osc::Blob(d.data, d.size);
+
+    // optional capture time stamp
+    if (d.timestamp){
+        msg << osc::TimeTag(d.timestamp);
+    }
+
+    msg << osc::EndMessage;
 
     LOG_DEBUG("send compact block: seq = " << d.sequence << ", sr = " << d.samplerate
               << ", chn = " << d.channel << ", totalsize = " << d.totalsize
@@ -800,6 +1168,39 @@ void endpoint::send_data_compact(int32_t src, int32_t salt, const aoo::data_pack
     send(msg.Data(), (int32_t)msg.Size());
 }
 
+// see write_binary_data() in common.cpp
+
+bool endpoint::send_data_binary(int32_t salt, const aoo::data_packet& d, bool sendrate) const {
+    // call without lock!
+
+    int32_t bufsize;
+    auto buf = get_packet_buffer(bufsize, d.size + AOO_DATA_HEADERSIZE);
+    auto size = write_binary_data(buf, bufsize, id, salt, d, sendrate);
+    if (size > 0){
+        LOG_DEBUG("send binary block: seq = " << d.sequence << ", sr = " << d.samplerate
+                  << ", chn = " << d.channel << ", totalsize = " << d.totalsize
+                  << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size << " msgsize: " << size);
+
+        send(buf, size);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d,
+                         int32_t flags, bool sendrate) const {
+    if ((flags & AOO_PROTOCOL_FLAG_BINARY_DATA) && send_data_binary(salt, d, sendrate)){
+        return;
+    }
+    // if the protocol_flags allow using the compact data message, use it if appropriate
+    if (d.nframes == 1 && d.channel == 0 && (flags & AOO_PROTOCOL_FLAG_COMPACT_DATA)) {
+        send_data_compact(src, salt, d, sendrate);
+    } else {
+        send_data(src, salt, d);
+    }
+}
+
 // /aoo/sink/<id>/format <src> <version> <salt> <numchannels> <samplerate> <blocksize> <codec> <options...>
 
 void endpoint::send_format(int32_t src, int32_t salt, const aoo_format& f,
@@ -807,8 +1208,9 @@ void endpoint::send_format(int32_t src, int32_t salt, const aoo_format& f,
     // call without lock!
     LOG_DEBUG("send format to " << id << " (salt = " << salt << ")");
 
-    char buf[AOO_MAXPACKETSIZE];
-    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    int32_t bufsize;
+    auto buf = get_packet_buffer(bufsize);
+    osc::OutboundPacketStream msg(buf, bufsize);
 
     if (id != AOO_ID_WILDCARD){
         const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
@@ -822,7 +1224,9 @@ void endpoint::send_format(int32_t src, int32_t salt, const aoo_format& f,
         msg << osc::BeginMessage(AOO_MSG_DOMAIN AOO_MSG_SINK AOO_MSG_WILDCARD AOO_MSG_FORMAT);
     }
 
-    msg << src << (int32_t)make_version(AOO_PROTOCOL_FLAG_COMPACT_DATA) << salt << f.nchannels << f.samplerate << f.blocksize
+    auto flags = AOO_PROTOCOL_FLAG_COMPACT_DATA | AOO_PROTOCOL_FLAG_TIMESTAMP
+            | AOO_PROTOCOL_FLAG_BINARY_DATA | AOO_PROTOCOL_FLAG_PROBE;
+    msg << src << (int32_t)make_version(flags) << salt << f.nchannels << f.samplerate << f.blocksize
         << f.codec << osc::Blob(options, size) << osc::EndMessage;
 
     send(msg.Data(), (int32_t)msg.Size());
@@ -834,8 +1238,9 @@ void endpoint::send_ping(int32_t src, time_tag t) const {
     // call without lock!
     LOG_DEBUG("send ping to " << id);
 
-    char buf[AOO_MAXPACKETSIZE];
-    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    int32_t bufsize;
+    auto buf = get_packet_buffer(bufsize);
+    osc::OutboundPacketStream msg(buf, bufsize);
 
     if (id != AOO_ID_WILDCARD){
         const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
@@ -854,10 +1259,82 @@ void endpoint::send_ping(int32_t src, time_tag t) const {
     send(msg.Data(), (int32_t)msg.Size());
 }
 
+// /aoo/sink/<id>/probe <src> <size> <token> <padding>
+
+void endpoint::send_probe(int32_t src, int32_t size, int32_t token) const {
+    // call without lock!
+    LOG_DEBUG("send probe (" << size << " bytes) to " << id);
+
+    int32_t bufsize;
+    auto buf = get_packet_buffer(bufsize, size);
+    osc::OutboundPacketStream msg(buf, bufsize);
+
+    if (id != AOO_ID_WILDCARD){
+        const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
+                + AOO_MSG_SINK_LEN + 16 + AOO_MSG_PROBE_LEN;
+        char address[max_addr_size];
+        snprintf(address, sizeof(address), "%s%s/%d%s",
+                 AOO_MSG_DOMAIN, AOO_MSG_SINK, id, AOO_MSG_PROBE);
+
+        msg << osc::BeginMessage(address);
+    } else {
+        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOO_MSG_SINK AOO_MSG_WILDCARD AOO_MSG_PROBE);
+    }
+
+    // write an empty blob and patch its size afterwards,
+    // so we don't need a separate buffer for the padding.
+    msg << src << size << token << osc::Blob(buf, 0) << osc::EndMessage;
+
+    auto n = (int32_t)msg.Size();
+    // OSC messages are always a multiple of 4 bytes
+    auto padding = std::min<int32_t>(size, bufsize) - n;
+    if (padding > 0){
+        padding &= ~3;
+        aoo::to_bytes<int32_t>(padding, buf + n - 4);
+        memset(buf + n, 0, padding);
+        n += padding;
+    }
+
+    send(buf, n);
+}
+
 /*///////////////////////// source ////////////////////////////////*/
 
+// The sink list is never modified in place. Instead, writers (holding
+// 'sink_mutex_') publish a modified copy and retire the old list.
+// The send thread reads the current list without any lock and
+// frees retired lists at the beginning of send(), when it can't
+// hold any references anymore. All other threads must take a reader
+// lock, so they can't see retired lists in the first place.
+template<typename F>
+void source::update_sinks(F&& fn){
+    auto old = sinks_.load(std::memory_order_relaxed);
+    auto list = new sink_list;
+    list->sinks = old->sinks;
+    list->group = old->group;
+    fn(list->sinks);
+    replace_sinks(list);
+}
+
+void source::replace_sinks(sink_list *list){
+    auto old = sinks_.exchange(list, std::memory_order_acq_rel);
+    // retire old list
+    old->next = retired_sinks_.load(std::memory_order_relaxed);
+    while (!retired_sinks_.compare_exchange_weak(old->next, old,
+                                                 std::memory_order_release)) ;
+}
+
+void source::reclaim_sinks(){
+    auto list = retired_sinks_.exchange(nullptr, std::memory_order_acquire);
+    while (list){
+        auto next = list->next;
+        delete list;
+        list = next;
+    }
+}
+
 sink_desc * source::find_sink(void *endpoint, int32_t id){
-    for (auto& sink : sinks_){
+    for (auto& sink : current_sinks()){
         if ((sink.user == endpoint) &&
             (sink.id == AOO_ID_WILDCARD || sink.id == id))
         {
@@ -868,7 +1345,7 @@ sink_desc * source::find_sink(void *endpoint, int32_t id){
 }
 
 int32_t source::set_format(aoo_format &f){
-    unique_lock lock(update_mutex_); // writer lock!
+    rt_unique_lock lock(update_mutex_); // writer lock!
     if (!encoder_ || strcmp(encoder_->name(), f.codec)){
         auto codec = aoo::find_codec(f.codec);
         if (codec){
@@ -903,6 +1380,8 @@ void source::update(){
     }
     assert(encoder_->blocksize() > 0 && encoder_->samplerate() > 0);
 
+    update_tiers();
+
     if (blocksize_ > 0){
         assert(samplerate_ > 0 && nchannels_ > 0);
         // setup audio buffer
@@ -913,7 +1392,8 @@ void source::update(){
         int32_t nbuffers = d.quot + (d.rem != 0); // round up
         nbuffers = std::max<int32_t>(nbuffers, 1); // need at least 1 buffer!
         audioqueue_.resize(nbuffers * nsamples, nsamples);
-        srqueue_.resize(nbuffers, 1);
+        infoqueue_.resize(nbuffers, 1);
+        bind_queues();
         LOG_DEBUG("aoo::source::update: id: " << id_ << " nbuffers = " << nbuffers << " dquot: " << d.quot << " drem: " << d.rem <<  " bufsize: " << bufsize << " bs: " << encoder_->blocksize() << " reqbufms: " << buffersize_);
 
         // resampler
@@ -945,7 +1425,7 @@ void source::update(){
         dropped_ = 0;
         {
             shared_lock lock2(sink_mutex_);
-            for (auto& sink : sinks_){
+            for (auto& sink : current_sinks()){
                 sink.format_changed = true;
             }
             // notify send_format()
@@ -954,12 +1434,63 @@ void source::update(){
     }
 }
 
+// always called with update_mutex_ locked!
+void source::update_tiers(){
+    // make sure that all tiers match the source format
+    for (int32_t i = 0; i < (int32_t)tiers_.size(); ++i){
+        auto& t = tiers_[i];
+        if (t.encoder){
+            aoo_format_storage f;
+            if (t.encoder->get_format(f)){
+                f.header.nchannels = encoder_->nchannels();
+                f.header.samplerate = encoder_->samplerate();
+                f.header.blocksize = encoder_->blocksize();
+                t.encoder->set_format(f.header);
+            }
+            if (t.encoder->blocksize() != encoder_->blocksize()){
+                LOG_WARNING("aoo_source: tier " << (i + 1) << " doesn't match "
+                            "the source format - removing");
+                t.encoder = nullptr;
+            } else {
+                t.encoder->reset();
+            }
+        }
+    }
+}
+
+// always called with update_mutex_ locked!
+int32_t source::get_tier(int32_t tier) const {
+    if (tier > 0 && tier < AOO_MAXNUMTIERS && tiers_[tier - 1].encoder){
+        return tier;
+    } else {
+        return 0; // fall back to source format
+    }
+}
+
 void source::update_historybuffer(){
     if (samplerate_ > 0 && encoder_){
         double bufsize = (double)resend_buffersize_ * 0.001 * samplerate_;
         auto d = div(bufsize, encoder_->blocksize());
         int32_t nbuffers = d.quot + (d.rem != 0); // round up
-        history_.resize(nbuffers);
+        // only allocate the max. encoded block size of each tier,
+        // see send_data(). NOTE: all tiers have the same blocksize.
+        history_.resize(nbuffers, encoder_->max_encoded_size());
+        for (auto& t : tiers_){
+            t.history.resize(t.encoder ? nbuffers : 0,
+                             t.encoder ? t.encoder->max_encoded_size() : 0);
+        }
+    }
+}
+
+// always called with update_mutex_ locked!
+void source::bind_queues(){
+    auto node = numa_node_.load();
+    if (node >= 0){
+        // the info queue is typically smaller than a page (best effort)
+        bind_memory(infoqueue_.storage(), node);
+        if (!bind_memory(audioqueue_.storage(), node)){
+            LOG_WARNING("aoo_source: couldn't bind audio queue to NUMA node " << node);
+        }
     }
 }
 
@@ -971,48 +1502,64 @@ bool source::send_format(){
         return false;
     }
 
-    shared_lock updatelock(update_mutex_); // reader lock!
+    rt_shared_lock updatelock(update_mutex_); // reader lock!
 
     if (!encoder_){
         return false;
     }
 
+    // serialize the format of every encoder tier
+    struct tier_format {
+        aoo_format fmt;
+        char settings[AOO_CODEC_MAXSETTINGSIZE];
+        int32_t size;
+    } formats[AOO_MAXNUMTIERS];
+
+    for (int32_t i = 0; i < AOO_MAXNUMTIERS; ++i){
+        auto enc = tier_encoder(i);
+        if (enc){
+            formats[i].size = enc->write_format(formats[i].fmt, formats[i].settings,
+                                                sizeof(formats[i].settings));
+        } else {
+            formats[i].size = -1;
+        }
+    }
+
     int32_t salt = salt_;
 
-    aoo_format fmt;
-    char settings[AOO_CODEC_MAXSETTINGSIZE];
-    auto size = encoder_->write_format(fmt, settings, sizeof(settings));
+    // resolve tiers while we still hold the update lock
+    int32_t tiermap[AOO_MAXNUMTIERS];
+    for (int32_t t = 0; t < AOO_MAXNUMTIERS; ++t){
+        tiermap[t] = get_tier(t);
+    }
 
     updatelock.unlock();
+    // now we don't hold any lock!
 
-    if (size < 0){
-        return false;
-    }
+    auto dosend = [&](const endpoint& ep, int32_t tier){
+        auto& f = formats[tier];
+        if (f.size >= 0){
+            ep.send_format(id(), tier_salt(salt, tier), f.fmt, f.settings, f.size);
+        }
+    };
 
+    // the send thread can read the sink list without locking
     if (format_changed){
-        // only copy sinks which require a format update!
-        shared_lock sinklock(sink_mutex_);
-        auto sinks = (aoo::sink_desc *)alloca((sinks_.size() + 1) * sizeof(aoo::endpoint)); // avoid alloca(0)
-        int numsinks = 0;
-        for (auto& sink : sinks_){
+        // only sinks which require a format update!
+        for (auto& sink : current_sinks()){
             if (sink.format_changed.exchange(false)){
-                new (sinks + numsinks) aoo::endpoint (sink.user, sink.fn, sink.id);
-                numsinks++;
+                dosend(sink, tiermap[sink.tier.load()]);
             }
         }
-        sinklock.unlock();
-        // now we don't hold any lock!
-
-        for (int i = 0; i < numsinks; ++i){
-            sinks[i].send_format(id(), salt, fmt, settings, size);
-        }
     }
 
     if (format_requested){
-        while (formatrequestqueue_.read_available()){
+        auto n = formatrequestqueue_.read_available();
+        while (n--){
             endpoint ep;
             formatrequestqueue_.read(ep);
-            ep.send_format(id(), salt, fmt, settings, size);
+            auto sink = find_sink(ep.user, ep.id);
+            dosend(ep, tiermap[sink ? sink->tier.load() : 0]);
         }
     }
 
@@ -1020,85 +1567,113 @@ bool source::send_format(){
 }
 
 bool source::resend_data(){
-    shared_lock updatelock(update_mutex_); // reader lock!
+    rt_shared_lock updatelock(update_mutex_); // reader lock!
     if (!history_.capacity()){
         return false;
     }
 
+    // Collect all pending requests, so we can merge identical requests
+    // from sinks in the multicast group.
+    // NOTE: the send thread can read the sink list without locking.
+    auto& list = current_list();
+    resend_requests_.clear();
+    while (datarequestqueue_.read_available()){
+        resend_request r;
+        datarequestqueue_.read(r.request);
+        auto sink = find_sink(r.request.user, r.request.id);
+        r.channel = sink ? sink->channel.load() : 0;
+        r.multicast = list.group.fn && sink && sink->group_member();
+        // sinks with their own packet size (see send_probe())
+        auto packetsize = (sink && !r.multicast) ? sink->packetsize.load() : 0;
+        r.framesize = packetsize > 0 ? packetsize - AOO_DATA_HEADERSIZE : 0;
+        r.protocol_flags = sink ? sink->protocol_flags.load() : 0;
+        r.count = 1;
+        if (r.multicast){
+            auto it = std::find_if(resend_requests_.begin(), resend_requests_.end(),
+                                   [&](auto& x){
+                return x.multicast && x.request.salt == r.request.salt
+                        && x.request.sequence == r.request.sequence
+                        && x.request.frame == r.request.frame;
+            });
+            if (it != resend_requests_.end()){
+                it->protocol_flags &= r.protocol_flags;
+                it->count++;
+                continue;
+            }
+        }
+        resend_requests_.push_back(r);
+    }
+
     bool didsomething = false;
 
-    while (datarequestqueue_.read_available()){
-        data_request request;
-        datarequestqueue_.read(request);
+    // the frames can't be larger than the (largest) packet size
+    int32_t packetsize = packetsize_;
+    for (auto& r : resend_requests_){
+        packetsize = std::max<int32_t>(packetsize, r.framesize);
+    }
+    if ((int32_t)resendbuffer_.size() < packetsize){
+        resendbuffer_.resize(packetsize);
+    }
 
+    for (auto& r : resend_requests_){
+        auto& request = r.request;
+        // the salt tells us which tier the sink has been listening to
         auto salt = salt_;
-        if (salt != request.salt){
+        auto tier = request.salt ^ salt;
+        if (tier < 0 || tier >= AOO_MAXNUMTIERS || get_tier(tier) != tier){
             // outdated request
             continue;
         }
 
-        auto block = history_.find(request.sequence);
-        if (block){
-            aoo::data_packet d;
-            d.sequence = block->sequence;
-            d.samplerate = block->samplerate;
-            d.channel = block->channel;
-            d.totalsize = block->size();
-            d.nframes = block->num_frames();
-            // We use a buffer on the heap because blocks and even frames
-            // can be quite large and we don't want them to sit on the stack.
-            if (request.frame < 0){
-                // Copy whole block and save frame pointers.
-                sendbuffer_.resize(d.totalsize);
-                char *buf = sendbuffer_.data();
-                char *frameptr[256];
-                int32_t framesize[256];
-                int32_t onset = 0;
-
-                for (int i = 0; i < d.nframes; ++i){
-                    auto nbytes = block->get_frame(i, buf + onset, d.totalsize - onset);
-                    if (nbytes > 0){
-                        frameptr[i] = buf + onset;
-                        framesize[i] = nbytes;
-                        onset += nbytes;
-                    } else {
-                        LOG_ERROR("empty frame!");
-                    }
-                }
+        // If several sinks in the multicast group are missing
+        // the same frame, we only send it once to the whole group.
+        const endpoint& target = (r.count > 1) ? list.group : request;
+
+        // The history buffer is lock-free, so we don't block send_data()
+        // and we only need to copy a single frame at a time.
+        // NOTE: the reader lock only protects against resizing.
+        auto& history = tier_history(tier);
+        auto buf = resendbuffer_.data();
+        aoo::data_packet d;
+        d.channel = r.channel;
+
+        auto dosend = [&](int32_t frame){
+            auto size = history.read_frame(request.sequence, frame, r.framesize,
+                                           buf, (int32_t)resendbuffer_.size(), d);
+            if (size > 0){
                 // unlock before sending
                 updatelock.unlock();
 
-                // send frames to sink
-                for (int i = 0; i < d.nframes; ++i){
-                    d.framenum = i;
-                    d.data = frameptr[i];
-                    d.size = framesize[i];
-                    request.send_data(id(), salt, d);
-                }
+                d.data = buf;
+                d.size = size;
+                target.send_data(id(), request.salt, d, r.protocol_flags, true);
+
+                // lock again
+                updatelock.lock();
+                return true;
             } else {
-                // Copy a single frame
-                if (request.frame >= 0 && request.frame < d.nframes){
-                    int32_t size = block->frame_size(request.frame);
-                    sendbuffer_.resize(size);
-                    block->get_frame(request.frame, sendbuffer_.data(), size);
-                    // unlock before sending
-                    updatelock.unlock();
-
-                    // send frame to sink
-                    d.framenum = request.frame;
-                    d.data = sendbuffer_.data();
-                    d.size = size;
-                    request.send_data(id(), salt, d);
-                } else {
-                    LOG_ERROR("frame number " << request.frame << " out of range!");
+                return false;
+            }
+        };
+
+        if (request.frame < 0){
+            // send whole block; the first frame tells us the number of frames
+            if (dosend(0)){
+                auto nframes = d.nframes;
+                for (int32_t i = 1; i < nframes; ++i){
+                    if (!dosend(i)){
+                        break; // block has been overwritten
+                    }
                 }
+                didsomething = true;
+            } else {
+                LOG_VERBOSE("couldn't find block " << request.sequence);
             }
-            // lock again
-            updatelock.lock();
-
+        } else if (dosend(request.frame)){
             didsomething = true;
         } else {
-            LOG_VERBOSE("couldn't find block " << request.sequence);
+            LOG_VERBOSE("couldn't find block " << request.sequence
+                        << " (frame " << request.frame << ")");
         }
     }
 
@@ -1106,7 +1681,7 @@ bool source::resend_data(){
 }
 
 bool source::send_data(){
-    shared_lock updatelock(update_mutex_); // reader lock!
+    rt_shared_lock updatelock(update_mutex_); // reader lock!
     if (!encoder_){
         return 0;
     }
@@ -1125,35 +1700,49 @@ bool source::send_data(){
         d.framenum = 0;
         d.data = nullptr;
         d.size = 0;
-        // now we can unlock
-        updatelock.unlock();
 
-        // make local copy of sink descriptors
-        shared_lock listlock(sink_mutex_);
-        int32_t numsinks = (int32_t) sinks_.size();
-        auto sinks = (sink_desc *)alloca((numsinks + 1) * sizeof(sink_desc)); // avoid alloca(0)
-        std::copy(sinks_.begin(), sinks_.end(), sinks);
+        // resolve tiers while we still hold the update lock
+        int32_t tiermap[AOO_MAXNUMTIERS];
+        for (int32_t t = 0; t < AOO_MAXNUMTIERS; ++t){
+            tiermap[t] = get_tier(t);
+        }
 
         // unlock before sending!
-        listlock.unlock();
+        updatelock.unlock();
 
-        // send block to sinks
-        for (int i = 0; i < numsinks; ++i){
-            sinks[i].send_data(id(), salt, d);            
+        // send block to sinks (no need to lock the sink list)
+        auto& list = current_list();
+        bool grouptier[AOO_MAXNUMTIERS] = { false };
+        for (auto& sink : list.sinks){
+            auto tier = tiermap[sink.tier.load()];
+            if (list.group.fn && sink.group_member()){
+                grouptier[tier] = true;
+            } else {
+                d.channel = sink.channel;
+                sink.send_data(id(), tier_salt(salt, tier), d,
+                               sink.protocol_flags, true);
+            }
+        }
+        // send once per tier to the multicast group
+        d.channel = 0;
+        for (int32_t t = 0; t < AOO_MAXNUMTIERS; ++t){
+            if (grouptier[t]){
+                list.group.send_data(id(), tier_salt(salt, t), d);
+            }
         }
         --dropped_;
-    } else if (audioqueue_.read_available() && srqueue_.read_available()){
-        // make local copy of sink descriptors
-        shared_lock listlock(sink_mutex_);
-        int32_t numsinks = (int32_t) sinks_.size();
-        auto sinks = (sink_desc *)alloca((numsinks + 1) * sizeof(sink_desc)); // avoid alloca(0)
-        std::copy(sinks_.begin(), sinks_.end(), sinks);
-
-        // unlock before sending!
-        listlock.unlock();
+    } else if (audioqueue_.read_available() && infoqueue_.read_available()){
+        // the send thread can read the sink list without locking
+        auto& list = current_list();
+        auto& sinks = list.sinks;
+        auto& group = list.group;
 
         d.sequence = sequence_++;
-        srqueue_.read(d.samplerate); // always read samplerate from ringbuffer
+        // always read samplerate and time stamp from ringbuffer
+        block_info info;
+        infoqueue_.read(info);
+        d.samplerate = info.samplerate;
+        d.timestamp = info.time;
 
         // for compact data sending purposes... only send rate when necessary
         bool sendrate = false;
@@ -1162,62 +1751,149 @@ bool source::send_data(){
             prev_sent_samplerate_ = d.samplerate;
         }
         
-        if (numsinks){
+        if (!sinks.empty()){
+            // only encode the tiers which are actually used.
+            // NOTE: read each sink's tier only once, because it might be
+            // changed concurrently by set_sinkoption().
+            bool used[AOO_MAXNUMTIERS] = { false };
+            int32_t tiermap[AOO_MAXNUMTIERS];
+            for (int32_t t = 0; t < AOO_MAXNUMTIERS; ++t){
+                tiermap[t] = get_tier(t);
+            }
+            // Sinks in the multicast group on the same tier share
+            // a single stream (on channel 0, see sink_desc::group_member()); the optional protocol features
+            // are only used if all of these sinks support them.
+            // Other sinks might have their own packet size (see send_probe()).
+            auto maxpacketsize = packetsize_ - AOO_DATA_HEADERSIZE;
+            multicast_streams_.clear();
+            for (auto& sink : sinks){
+                sink.sendtier = tiermap[sink.tier.load()];
+                used[sink.sendtier] = true;
+                sink.sendgroup = group.fn && sink.group_member();
+                auto packetsize = sink.packetsize.load();
+                sink.sendframesize = (packetsize > 0 && !sink.sendgroup) ?
+                            packetsize - AOO_DATA_HEADERSIZE : maxpacketsize;
+                if (sink.sendgroup){
+                    int32_t flags = sink.protocol_flags;
+                    auto it = std::find_if(multicast_streams_.begin(), multicast_streams_.end(),
+                                           [&](auto& m){ return m.tier == sink.sendtier; });
+                    if (it != multicast_streams_.end()){
+                        it->protocol_flags &= flags;
+                    } else {
+                        multicast_streams_.push_back({ sink.sendtier, flags });
+                    }
+                }
+            }
+
             // copy and convert audio samples to blob data
-            auto nchannels = encoder_->nchannels();
-            auto blocksize = encoder_->blocksize();
-            sendbuffer_.resize(sizeof(double) * nchannels * blocksize); // overallocate
+            int32_t totalsize[AOO_MAXNUMTIERS] = { 0 };
+
+            for (int32_t tier = 0; tier < AOO_MAXNUMTIERS; ++tier){
+                if (!used[tier]){
+                    continue;
+                }
+                auto& buffer = tier_sendbuffer(tier);
+                // NOTE: must not exceed the history buffer slots, see update_historybuffer()
+                buffer.resize(tier_encoder(tier)->max_encoded_size());
+
+                totalsize[tier] = tier_encoder(tier)->encode(
+                            audioqueue_.read_data(), audioqueue_.blocksize(),
+                            buffer.data(), (int32_t) buffer.size());
+
+                if (totalsize[tier] > 0){
+                    // calculate number of frames
+                    auto dv = div(totalsize[tier], maxpacketsize);
+                    auto nframes = dv.quot + (dv.rem != 0);
+
+                    // save block
+                    tier_history(tier).push(d.sequence, d.samplerate, buffer.data(),
+                                            totalsize[tier], nframes, maxpacketsize);
+                } else {
+                    LOG_WARNING("aoo_source: couldn't encode audio data!");
+                }
+            }
 
-            d.totalsize = encoder_->encode(audioqueue_.read_data(), audioqueue_.blocksize(),
-                                           sendbuffer_.data(), (int32_t) sendbuffer_.size());
             audioqueue_.read_commit();
 
-            if (d.totalsize > 0){
-                // calculate number of frames
-                auto maxpacketsize = packetsize_ - AOO_DATA_HEADERSIZE;
-                auto dv = div(d.totalsize, maxpacketsize);
-                d.nframes = dv.quot + (dv.rem != 0);
+            // unlock before sending!
+            updatelock.unlock();
 
-                // save block
-                history_.push(d.sequence, d.samplerate, sendbuffer_.data(),
-                              d.totalsize, d.nframes, maxpacketsize);
+            // from here on we don't hold any lock!
 
-                // unlock before sending!
-                updatelock.unlock();
+            for (int32_t tier = 0; tier < AOO_MAXNUMTIERS; ++tier){
+                if (totalsize[tier] <= 0){
+                    continue;
+                }
+                auto tiersalt = tier_salt(salt, tier);
+                d.totalsize = totalsize[tier];
+
+                // split the block once for every frame size on this tier;
+                // the multicast group always uses the source packet size.
+                framesizes_.clear();
+                for (auto& sink : sinks){
+                    if (sink.sendtier == tier && !sink.sendgroup &&
+                        std::find(framesizes_.begin(), framesizes_.end(),
+                                  sink.sendframesize) == framesizes_.end()){
+                        framesizes_.push_back(sink.sendframesize);
+                    }
+                }
+                bool multicast = std::any_of(multicast_streams_.begin(), multicast_streams_.end(),
+                                             [&](auto& m){ return m.tier == tier; });
+                if (multicast && std::find(framesizes_.begin(), framesizes_.end(),
+                                           maxpacketsize) == framesizes_.end()){
+                    framesizes_.push_back(maxpacketsize);
+                }
 
-                // from here on we don't hold any lock!
-
-                // send a single frame to all sinks
-                // /AoO/<sink>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data>
-                auto dosend = [&](int32_t frame, const char* data, auto n){
-                    d.framenum = frame;
-                    d.data = data;
-                    d.size = n;
-                    for (int i = 0; i < numsinks; ++i){
-                        d.channel = sinks[i].channel;
-                        // if the protocol_flags allow using the compact data message, use it if appropriate
-                        if (d.nframes == 1 && d.channel == 0 && sinks[i].protocol_flags & AOO_PROTOCOL_FLAG_COMPACT_DATA) {
-                            sinks[i].send_data_compact(id(), salt, d, sendrate);                
-                        } else {
-                            sinks[i].send_data(id(), salt, d);
+                for (auto framesize : framesizes_){
+                    auto dv = div(d.totalsize, framesize);
+                    d.nframes = dv.quot + (dv.rem != 0);
+
+                    // send a single frame to all sinks on this tier with the given frame size
+                    // /AoO/<sink>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data>
+                    auto dosend = [&](int32_t frame, const char* data, auto n){
+                        d.framenum = frame;
+                        d.data = data;
+                        d.size = n;
+                        for (size_t i = 0; i < sinks.size(); ++i){
+                            if (sinks[i].sendtier != tier || sinks[i].sendgroup
+                                    || sinks[i].sendframesize != framesize){
+                                continue;
+                            }
+                            d.channel = sinks[i].channel;
+                            // only send capture time stamp if the sink supports it
+                            d.timestamp = (sinks[i].protocol_flags & AOO_PROTOCOL_FLAG_TIMESTAMP) ?
+                                        info.time : 0;
+                            sinks[i].send_data(id(), tiersalt, d,
+                                               sinks[i].protocol_flags, sendrate);
+                        }
+                        if (framesize != maxpacketsize){
+                            return;
+                        }
+                        // send once to the multicast group
+                        for (auto& m : multicast_streams_){
+                            if (m.tier != tier){
+                                continue;
+                            }
+                            d.channel = 0;
+                            d.timestamp = (m.protocol_flags & AOO_PROTOCOL_FLAG_TIMESTAMP) ?
+                                        info.time : 0;
+                            group.send_data(id(), tiersalt, d, m.protocol_flags, sendrate);
+                        }
+                    };
+
+                    auto ntimes = redundancy_.load();
+                    for (auto i = 0; i < ntimes; ++i){
+                        auto ptr = tier_sendbuffer(tier).data();
+                        // send large frames (might be 0)
+                        for (int32_t j = 0; j < dv.quot; ++j, ptr += framesize){
+                            dosend(j, ptr, framesize);
+                        }
+                        // send remaining bytes as a single frame (might be the only one!)
+                        if (dv.rem){
+                            dosend(dv.quot, ptr, dv.rem);
                         }
-                    }
-                };
-
-                auto ntimes = redundancy_.load();
-                for (auto i = 0; i < ntimes; ++i){
-                    auto ptr = sendbuffer_.data();
-                    // send large frames (might be 0)
-                    for (int32_t j = 0; j < dv.quot; ++j, ptr += maxpacketsize){
-                        dosend(j, ptr, maxpacketsize);
-                    }
-                    // send remaining bytes as a single frame (might be the only one!)
-                    if (dv.rem){
-                        dosend(dv.quot, ptr, dv.rem);
                     }
                 }
-            } else {
-                LOG_WARNING("aoo_source: couldn't encode audio data!");
             }
         } else {
             // drain buffer anyway
@@ -1236,7 +1912,7 @@ bool source::send_data(){
     // handle overflow (with 64 samples @ 44.1 kHz this happens every 36 days)
     // for now just force a reset by changing the salt, LATER think how to handle this better
     if (d.sequence == INT32_MAX){
-        unique_lock lock2(update_mutex_); // take writer lock
+        rt_unique_lock lock2(update_mutex_); // take writer lock
         salt_ = make_salt();
     }
 
@@ -1249,17 +1925,11 @@ bool source::send_ping(){
     auto pingtime = lastpingtime_.load();
     auto interval = ping_interval_.load(); // 0: no ping
     if (interval > 0 && (elapsed - pingtime) >= interval){
-        // only copy sinks which require a format update!
-        shared_lock sinklock(sink_mutex_);
-        int32_t numsinks = (int32_t) sinks_.size();
-        auto sinks = (aoo::sink_desc *)alloca((numsinks + 1) * sizeof(aoo::sink_desc)); // avoid alloca(0)
-        std::copy(sinks_.begin(), sinks_.end(), sinks);
-        sinklock.unlock();
-
         auto tt = timer_.get_absolute();
 
-        for (int i = 0; i < numsinks; ++i){
-            sinks[i].send_ping(id(), tt);
+        // the send thread can read the sink list without locking
+        for (auto& sink : current_sinks()){
+            sink.send_ping(id(), tt);
         }
 
         lastpingtime_ = elapsed;
@@ -1269,6 +1939,117 @@ bool source::send_ping(){
     }
 }
 
+// Binary search for the largest packet size which reaches the sink,
+// between the source packet size and 'probe_packetsize_'.
+// Probes which don't get an answer within AOO_PROBE_INTERVAL
+// are retried up to AOO_PROBE_ATTEMPTS times before we assume
+// that the packet size is too large for the network path.
+// Every acknowledged size is used immediately for the data sent to the sink.
+bool source::send_probe(){
+    auto maxsize = probe_packetsize_.load();
+    if (maxsize <= 0){
+        return false;
+    }
+    auto packetsize = packetsize_.load();
+    auto generation = probe_generation_.load();
+    auto elapsed = timer_.get_elapsed();
+    const double interval = AOO_PROBE_INTERVAL * 0.001;
+
+    bool didsomething = false;
+
+    // the send thread can read the sink list without locking
+    for (auto& sink : current_sinks()){
+        // multicast sinks always use the source packet size
+        if (!sink.probe.load() || sink.multicast.load() ||
+            !(sink.protocol_flags.load() & AOO_PROTOCOL_FLAG_PROBE)){
+            continue;
+        }
+        if (sink.probe_generation.load() != generation){
+            // (re)start search
+            sink.probe_generation = generation;
+            sink.packetsize = 0;
+            sink.probe_lo = packetsize;
+            sink.probe_hi = maxsize;
+            sink.probe_size = 0;
+            sink.probe_token = 0;
+            LOG_VERBOSE("aoo_source: probe packet size for sink " << sink.id
+                        << " (" << packetsize << " - " << maxsize << " bytes)");
+        }
+        auto lo = sink.probe_lo.load();
+        auto hi = sink.probe_hi.load();
+        if (hi <= 0){
+            continue; // done
+        }
+        if (sink.probe_size > 0){
+            if (sink.probe_ack.load() == sink.probe_token.load()){
+                // success
+                lo = sink.probe_size;
+                sink.probe_lo = lo;
+                sink.packetsize = lo;
+                sink.probe_size = 0;
+                sink.probe_token = 0;
+            } else if ((elapsed - sink.probe_time) >= interval
+                       || elapsed < sink.probe_time) // timer reset
+            {
+                if (++sink.probe_attempts < AOO_PROBE_ATTEMPTS){
+                    // try again
+                    sink.send_probe(id(), sink.probe_size, sink.probe_token);
+                    sink.probe_time = elapsed;
+                    didsomething = true;
+                    continue;
+                }
+                // too large
+                hi = sink.probe_size - 1;
+                sink.probe_hi = hi;
+                sink.probe_size = 0;
+                sink.probe_token = 0;
+            } else {
+                continue; // wait for reply
+            }
+        }
+        if ((hi - lo) < AOO_PROBE_RESOLUTION){
+            sink.probe_hi = 0;
+            LOG_VERBOSE("aoo_source: packet size for sink " << sink.id
+                        << ": " << lo << " bytes");
+            continue;
+        }
+        // OSC messages are always a multiple of 4 bytes
+        // every probe gets a new token (retries keep it),
+        // so we can't mistake a late reply for the current one.
+        if (++probe_token_ <= 0){
+            probe_token_ = 1; // wrap around
+        }
+        sink.probe_size = (lo + (hi - lo + 1) / 2) & ~3;
+        sink.probe_token = probe_token_;
+        sink.probe_attempts = 0;
+        sink.probe_time = elapsed;
+        sink.send_probe(id(), sink.probe_size, probe_token_);
+        didsomething = true;
+    }
+
+    return didsomething;
+}
+
+void source::set_sink_packetsize(sink_desc& sink, int32_t packetsize){
+    if (packetsize > 0){
+        const int32_t minpacketsize = AOO_DATA_HEADERSIZE + 64;
+        packetsize = std::max<int32_t>(minpacketsize,
+                                       std::min<int32_t>(packetsize, AOO_MAXUDPPACKETSIZE));
+        // stop probing
+        sink.probe = false;
+        sink.probe_hi = 0;
+        sink.packetsize = packetsize;
+        LOG_VERBOSE("aoo_source: packet size for sink " << sink.id
+                    << ": " << packetsize << " bytes");
+    } else {
+        // back to the source packet size; probe again (if enabled)
+        sink.packetsize = 0;
+        sink.probe_generation = 0;
+        sink.probe = true;
+        LOG_VERBOSE("aoo_source: default packet size for sink " << sink.id);
+    }
+}
+
 void source::handle_format_request(void *endpoint, aoo_replyfn fn,
                                    const osc::ReceivedMessage& msg)
 {
@@ -1345,15 +2126,13 @@ void source::handle_invite(void *endpoint, aoo_replyfn fn,
 
     if (!sink){
         // push "invite" event
-        if (eventqueue_.write_available()){
-            event e;
-            e.type = AOO_INVITE_EVENT;
-            e.sink.endpoint = endpoint;
-            // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
-            e.sink.id = id;
-            e.sink.flags = flags;
-            eventqueue_.write(e);
-        }
+        event e;
+        e.type = AOO_INVITE_EVENT;
+        e.sink.endpoint = endpoint;
+        // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
+        e.sink.id = id;
+        e.sink.flags = flags;
+        push_event(e);
     } else {
         LOG_VERBOSE("ignoring '" << AOO_MSG_INVITE << "' message: sink already added");
     }
@@ -1373,14 +2152,12 @@ void source::handle_uninvite(void *endpoint, aoo_replyfn fn,
 
     if (sink){
         // push "uninvite" event
-        if (eventqueue_.write_available()){
-            event e;
-            e.type = AOO_UNINVITE_EVENT;
-            e.sink.endpoint = endpoint;
-            // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
-            e.sink.id = id;
-            eventqueue_.write(e);
-        }
+        event e;
+        e.type = AOO_UNINVITE_EVENT;
+        e.sink.endpoint = endpoint;
+        // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
+        e.sink.id = id;
+        push_event(e);
     } else {
         LOG_VERBOSE("ignoring '" << AOO_MSG_UNINVITE << "' message: sink not found");
     }
@@ -1404,27 +2181,52 @@ void source::handle_ping(void *endpoint, aoo_replyfn fn,
 
     if (sink){
         // push "ping" event
-        if (eventqueue_.write_available()){
-            event e;
-            e.type = AOO_PING_EVENT;
-            e.sink.endpoint = endpoint;
-            // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
-            e.sink.id = id;
-            e.ping.tt1 = tt1.to_uint64();
-            e.ping.tt2 = tt2.to_uint64();
-            e.ping.lost_blocks = lost_blocks;
-        #if 0
-            e.ping.tt3 = timer_.get_absolute().to_uint64(); // use last stream time
-        #else
-            e.ping.tt3 = aoo_osctime_get(); // use real system time
-        #endif
-            eventqueue_.write(e);
-        }
+        event e;
+        e.type = AOO_PING_EVENT;
+        e.sink.endpoint = endpoint;
+        // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
+        e.sink.id = id;
+        e.ping.tt1 = tt1.to_uint64();
+        e.ping.tt2 = tt2.to_uint64();
+        e.ping.lost_blocks = lost_blocks;
+    #if 0
+        e.ping.tt3 = timer_.get_absolute().to_uint64(); // use last stream time
+    #else
+        e.ping.tt3 = aoo_osctime_get(); // use real system time
+    #endif
+        push_event(e);
     } else {
         LOG_VERBOSE("ignoring '" << AOO_MSG_PING << "' message: sink not found");
     }
 }
 
+// /aoo/src/<id>/probe <sink> <size> <token>
+
+void source::handle_probe(void *endpoint, aoo_replyfn fn,
+                          const osc::ReceivedMessage& msg)
+{
+    auto it = msg.ArgumentsBegin();
+    auto id = (it++)->AsInt32();
+    auto size = (it++)->AsInt32();
+    auto token = (it++)->AsInt32();
+
+    LOG_DEBUG("handle probe (" << size << " bytes)");
+
+    shared_lock lock(sink_mutex_); // reader lock!
+    auto sink = find_sink(endpoint, id);
+    if (sink){
+        // only accept the reply to the probe in flight, see send_probe()
+        if (token > 0 && token == sink->probe_token.load()
+                && size >= sink->probe_size.load()){
+            sink->probe_ack = token;
+        } else {
+            LOG_DEBUG("ignoring stale probe reply (" << size << " bytes)");
+        }
+    } else {
+        LOG_VERBOSE("ignoring '" << AOO_MSG_PROBE << "' message: sink not found");
+    }
+}
+
 // /aoo/src/<id>/codecchange <sink> <numchannels> <samplerate> <blocksize> <codec> <options...>
 
 void source::handle_codec_change(void *endpoint, aoo_replyfn fn,
@@ -1468,7 +2270,7 @@ void source::handle_codec_change(void *endpoint, aoo_replyfn fn,
     if (sink){
         { // only if the requesting sink exists we will respect this request
             LOG_DEBUG("handle codec change");
-            unique_lock lock(update_mutex_); // writer lock!
+            rt_unique_lock lock(update_mutex_); // writer lock!
             
             if (!encoder_ || strcmp(encoder_->name(), f.codec)){
                 auto codec = aoo::find_codec(f.codec);
@@ -1490,14 +2292,12 @@ void source::handle_codec_change(void *endpoint, aoo_replyfn fn,
                
         
         // push "codec change" event
-        if (eventqueue_.write_available()){
-            event e;
-            e.type = AOO_CHANGECODEC_EVENT;
-            e.sink.endpoint = endpoint;
-            // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
-            e.sink.id = id;
-            eventqueue_.write(e);
-        }
+        event e;
+        e.type = AOO_CHANGECODEC_EVENT;
+        e.sink.endpoint = endpoint;
+        // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
+        e.sink.id = id;
+        push_event(e);
     } else {
         LOG_VERBOSE("ignoring '" << AOO_CHANGECODEC_EVENT << "' message: sink not found");
     }
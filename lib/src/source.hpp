@@ -29,13 +29,20 @@ struct endpoint {
     
     // methods
     void send_data(int32_t src, int32_t salt, const data_packet& data) const;
-    void send_data_compact(int32_t src, int32_t salt, const data_packet& data, bool sendrate=false);
+    void send_data_compact(int32_t src, int32_t salt, const data_packet& data, bool sendrate=false) const;
+    bool send_data_binary(int32_t salt, const data_packet& data, bool sendrate=false) const;
+    // use the most compact data message supported by the sink
+    void send_data(int32_t src, int32_t salt, const data_packet& data,
+                   int32_t flags, bool sendrate) const;
 
     void send_format(int32_t src, int32_t salt, const aoo_format& f,
                      const char *options, int32_t size) const;
 
     void send_ping(int32_t src, time_tag t) const;
 
+    // pad the message to 'size' bytes
+    void send_probe(int32_t src, int32_t size, int32_t token) const;
+
     void send(const char *data, int32_t n) const {
         fn(user, data, n);
     }
@@ -68,12 +75,26 @@ struct invite_request : endpoint {
 
 struct sink_desc : endpoint {
     sink_desc(void *_user, aoo_replyfn _fn, int32_t _id)
-        : endpoint(_user, _fn, _id), channel(0), format_changed(true), protocol_flags(0) {}
+        : endpoint(_user, _fn, _id), channel(0), format_changed(true),
+          protocol_flags(0), tier(0), multicast(false), packetsize(0),
+          probe(true), probe_generation(0), probe_lo(0), probe_hi(0),
+          probe_size(0), probe_token(0), probe_ack(0) {}
+    // NB: a copy doesn't inherit the probe in flight, because the send
+    // thread might still update it in the original; it will send a new
+    // probe (with a new token), so a late reply can't be misattributed.
     sink_desc(const sink_desc& other)
         : endpoint(other.user, other.fn, other.id),
           channel(other.channel.load()),
           format_changed(other.format_changed.load()),
-          protocol_flags(other.protocol_flags.load()){}
+          protocol_flags(other.protocol_flags.load()),
+          tier(other.tier.load()),
+          multicast(other.multicast.load()),
+          packetsize(other.packetsize.load()),
+          probe(other.probe.load()),
+          probe_generation(other.probe_generation.load()),
+          probe_lo(other.probe_lo.load()),
+          probe_hi(other.probe_hi.load()),
+          probe_size(0), probe_token(0), probe_ack(0){}
     sink_desc& operator=(const sink_desc& other){
         user = other.user;
         fn = other.fn;
@@ -81,14 +102,50 @@ struct sink_desc : endpoint {
         channel = other.channel.load();
         format_changed = other.format_changed.load();
         protocol_flags = other.protocol_flags.load();
+        tier = other.tier.load();
+        multicast = other.multicast.load();
+        packetsize = other.packetsize.load();
+        probe = other.probe.load();
+        probe_generation = other.probe_generation.load();
+        probe_lo = other.probe_lo.load();
+        probe_hi = other.probe_hi.load();
+        probe_size = 0;
+        probe_token = 0;
+        probe_ack = 0;
+        probe_attempts = 0;
+        probe_time = 0;
         return *this;
     }
 
+    // The multicast group receives a single stream on channel 0,
+    // so sinks with another channel onset are sent to directly.
+    bool group_member() const {
+        return multicast.load() && channel.load() == 0;
+    }
+
     // data
     std::atomic<int16_t> channel;
     std::atomic<bool> format_changed;
     std::atomic<int8_t> protocol_flags;
-
+    std::atomic<int8_t> tier;
+    std::atomic<bool> multicast;
+    std::atomic<int32_t> packetsize; // 0: source packet size
+    // packet size probing, see source::send_probe()
+    std::atomic<bool> probe; // false: packet size set by the user
+    std::atomic<int32_t> probe_generation;
+    std::atomic<int32_t> probe_lo; // largest acknowledged size
+    std::atomic<int32_t> probe_hi; // upper bound (0: not probing)
+    // current probe; only written by the send thread, see source::handle_probe()
+    std::atomic<int32_t> probe_size; // 0: no probe in flight
+    std::atomic<int32_t> probe_token; // 0: no probe in flight
+    std::atomic<int32_t> probe_ack; // token of the acknowledged probe
+    // resolved tier, multicast state, frame size and probe timing;
+    // only used by the send thread (not copied)
+    int32_t sendtier = 0;
+    bool sendgroup = false;
+    int32_t sendframesize = 0;
+    int32_t probe_attempts = 0;
+    double probe_time = 0;
 };
 
 class source final : public isource {
@@ -132,6 +189,12 @@ class source final : public isource {
 
     int32_t get_sinkoption(void *endpoint, int32_t id,
                            int32_t opt, void *ptr, int32_t size) override;
+
+    int32_t set_tier_format(int32_t tier, aoo_format *f) override;
+
+    int32_t get_tier_format(int32_t tier, aoo_format_storage& f) override;
+
+    int32_t set_multicast(void *group, aoo_replyfn fn) override;
     
     int32_t protocol_flags() const { return protocol_flags_; }
 
@@ -145,6 +208,13 @@ class source final : public isource {
     int32_t samplerate_ = 0;
     // audio encoder
     std::unique_ptr<encoder> encoder_;
+    // additional encoder tiers (tier 0 is 'encoder_')
+    struct encoder_tier {
+        std::unique_ptr<aoo::encoder> encoder;
+        history_buffer history;
+        std::vector<char> sendbuffer;
+    };
+    std::array<encoder_tier, AOO_MAXNUMTIERS - 1> tiers_;
     // state
     int32_t sequence_ = 0;
     std::atomic<int32_t> dropped_{0};
@@ -156,21 +226,56 @@ class source final : public isource {
     timer timer_;
     // buffers and queues
     std::vector<char> sendbuffer_;
+    std::vector<char> resendbuffer_; // only grows, see resend_data()
+    std::vector<aoo_sample> processbuffer_; // interleaved input, see setup()
+    bool blocksize_error_ = false; // only report once, see process()
     dynamic_resampler resampler_;
     lockfree::queue<aoo_sample> audioqueue_;
-    lockfree::queue<double> srqueue_;
-    lockfree::queue<event> eventqueue_;
+    struct block_info {
+        double samplerate;
+        uint64_t time; // capture time stamp
+    };
+    lockfree::queue<block_info> infoqueue_;
+    lockfree::mpsc_queue<event> eventqueue_;
+    void push_event(const event& e){
+        eventqueue_.push(e);
+    }
     lockfree::queue<endpoint> formatrequestqueue_;
     lockfree::queue<data_request> datarequestqueue_;
     history_buffer history_;
-    // sinks
-    std::vector<sink_desc> sinks_;
+    // sinks (copy-on-write, see update_sinks())
+    struct sink_list {
+        std::vector<sink_desc> sinks;
+        endpoint group; // multicast group (fn = nullptr: disabled)
+        sink_list *next = nullptr; // retired lists
+    };
+    std::atomic<sink_list *> sinks_{nullptr};
+    std::atomic<sink_list *> retired_sinks_{nullptr};
+    // multicast (only used by the send thread)
+    struct multicast_stream {
+        int32_t tier;
+        int32_t protocol_flags; // supported by all sinks
+    };
+    std::vector<multicast_stream> multicast_streams_;
+    std::vector<int32_t> framesizes_; // distinct frame sizes of a tier
+    struct resend_request {
+        data_request request;
+        int32_t channel;
+        int32_t framesize; // 0: frame size of the history buffer
+        bool multicast;
+        int32_t protocol_flags; // supported by all requesting sinks
+        int32_t count; // number of identical requests
+    };
+    std::vector<resend_request> resend_requests_;
     // thread synchronization
-    aoo::shared_mutex update_mutex_;
+    aoo::rt_shared_mutex update_mutex_;
     aoo::shared_mutex sink_mutex_;
     // options
     std::atomic<int32_t> buffersize_{ AOO_SOURCE_BUFSIZE };
     std::atomic<int32_t> packetsize_{ AOO_PACKETSIZE };
+    std::atomic<int32_t> probe_packetsize_{ 0 }; // 0: no probing
+    std::atomic<int32_t> probe_generation_{ 1 }; // restarts probing
+    int32_t probe_token_ = 0; // last probe token (only used by the send thread)
     std::atomic<int32_t> resend_buffersize_{ AOO_RESEND_BUFSIZE };
     std::atomic<int32_t> redundancy_{ AOO_SEND_REDUNDANCY };
     std::atomic<int32_t> dynamic_resampling_{ 1 };
@@ -178,24 +283,64 @@ class source final : public isource {
     std::atomic<float> ping_interval_{ AOO_PING_INTERVAL * 0.001 };
     std::atomic<int32_t> protocol_flags_{ 0 };
     std::atomic<int32_t> respect_codec_change_req_{ 0 };
+    std::atomic<int32_t> numa_node_{ -1 };
     // runtime
     double prev_sent_samplerate_ = 0.0;
     std::atomic<int32_t> activeplay_ { 0 };
     std::atomic<int32_t> flushingout_ { 0 };
+    std::atomic<bool> send_pending_{ false }; // see process() and send()
     bool lastplay_ = false;
     int32_t pushing_silent_frames_ = 0;
     
     // helper methods
     sink_desc * find_sink(void *endpoint, int32_t id);
 
+    std::vector<sink_desc>& current_sinks(){
+        return sinks_.load(std::memory_order_acquire)->sinks;
+    }
+
+    sink_list& current_list(){
+        return *sinks_.load(std::memory_order_acquire);
+    }
+
+    template<typename F>
+    void update_sinks(F&& fn);
+
+    void replace_sinks(sink_list *list);
+
+    void reclaim_sinks();
+
     int32_t set_format(aoo_format& f);
 
     int32_t make_salt();
 
+    int32_t get_tier(int32_t tier) const;
+
+    // each tier is a separate stream (with its own salt) for the sink
+    static int32_t tier_salt(int32_t salt, int32_t tier) {
+        return salt ^ tier;
+    }
+
+    encoder * tier_encoder(int32_t tier) {
+        return tier > 0 ? tiers_[tier - 1].encoder.get() : encoder_.get();
+    }
+
+    history_buffer& tier_history(int32_t tier) {
+        return tier > 0 ? tiers_[tier - 1].history : history_;
+    }
+
+    std::vector<char>& tier_sendbuffer(int32_t tier) {
+        return tier > 0 ? tiers_[tier - 1].sendbuffer : sendbuffer_;
+    }
+
+    void update_tiers();
+
     void update();
 
     void update_historybuffer();
 
+    void bind_queues();
+
     bool send_format();
 
     bool send_data();
@@ -204,6 +349,10 @@ class source final : public isource {
 
     bool send_ping();
 
+    bool send_probe();
+
+    void set_sink_packetsize(sink_desc& sink, int32_t packetsize);
+
     void handle_format_request(void *endpoint, aoo_replyfn fn,
                                const osc::ReceivedMessage& msg);
 
@@ -221,6 +370,9 @@ class source final : public isource {
     
     void handle_codec_change(void *endpoint, aoo_replyfn fn,
                                const osc::ReceivedMessage& msg);
+
+    void handle_probe(void *endpoint, aoo_replyfn fn,
+                      const osc::ReceivedMessage& msg);
 };
 
 } // aoo
@@ -10,6 +10,16 @@
 #include <pthread.h>
 #endif
 
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 // for spinlock
 // Intel
 #if defined(__i386__) || defined(_M_IX86) || defined(__x86_64__) || defined(_M_X64)
@@ -23,11 +33,13 @@
          defined(__ARM_ARCH_7S__) || \
          defined(__aarch64__))
   #define CPU_ARM
-#else
-// fallback
-  #include <thread>
 #endif
 
+#include <algorithm>
+#include <thread>
+#include <climits>
+#include <cerrno>
+
 namespace aoo {
 
 void pause_cpu(){
@@ -41,39 +53,120 @@ void pause_cpu(){
 #endif
 }
 
+// block while 'addr' still contains 'value' (might return spuriously)
+static void wait_address(std::atomic<uint32_t>& addr, uint32_t value){
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *)&addr, FUTEX_WAIT_PRIVATE,
+            value, nullptr, nullptr, 0);
+#else
+    // LATER use WaitOnAddress() resp. __ulock_wait()
+    if (addr.load(std::memory_order_relaxed) == value){
+        std::this_thread::yield();
+    }
+#endif
+}
+
+static void wake_address(std::atomic<uint32_t>& addr, bool all){
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *)&addr, FUTEX_WAKE_PRIVATE,
+            all ? INT_MAX : 1, nullptr, nullptr, 0);
+#else
+    (void)addr; (void)all; // waiters only yield
+#endif
+}
+
+// total number of pause instructions before we park the thread;
+// the backoff doubles after every failed attempt.
+static const int32_t spin_count = 1024;
+static const int32_t max_backoff = 64;
+
 /*/////////////////////// spinlock //////////////////////////*/
 
 void spinlock::lock(){
+    if (!try_lock()){
+        lock_slow();
+    }
+}
+
+void spinlock::lock_slow(){
+    contention_.fetch_add(1, std::memory_order_relaxed);
     // only try to modify the shared state if the lock seems to be available.
     // this should prevent unnecessary cache invalidation.
-    do {
-        while (locked_.load(std::memory_order_relaxed)){
+    int32_t backoff = 1;
+    for (int32_t i = 0; i < spin_count; i += backoff){
+        for (int32_t j = 0; j < backoff; ++j){
             pause_cpu();
         }
-    } while (!try_lock());
+        if (!locked_.load(std::memory_order_relaxed) && try_lock()){
+            return;
+        }
+        backoff = std::min<int32_t>(backoff * 2, max_backoff);
+    }
+    // mark the lock as contended and park until it becomes available.
+    // NOTE: once we've parked, we always lock in the contended state,
+    // so that unlock() won't miss any other waiters.
+    while (locked_.exchange(2, std::memory_order_acquire) != 0){
+        wait_address(locked_, 2);
+    }
 }
 
 bool spinlock::try_lock(){
-    // if the previous value was false, it means be could aquire the lock.
-    // this is faster than a CAS loop.
-    return !locked_.exchange(true, std::memory_order_acquire);
+    uint32_t expected = 0;
+    return locked_.compare_exchange_strong(expected, 1, std::memory_order_acquire);
 }
 
 void spinlock::unlock(){
-    locked_.store(false, std::memory_order_release);
+    if (locked_.exchange(0, std::memory_order_release) == 2){
+        wake_address(locked_, false);
+    }
 }
 
 /*//////////////////// shared spinlock ///////////////////////*/
 
+void shared_spinlock::wait(uint32_t mask){
+    // announce ourselves *before* checking the state; this pairs with
+    // the (seq_cst) state change + waiters check in wake().
+    waiters_.fetch_add(1);
+    auto state = state_.load();
+    if (state & mask){
+        wait_address(state_, state);
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void shared_spinlock::wake(){
+    if (waiters_.load() > 0){
+        wake_address(state_, true);
+    }
+}
+
 // exclusive
 void shared_spinlock::lock(){
+    if (try_lock()){
+        return;
+    }
+    contention_.fetch_add(1, std::memory_order_relaxed);
     // only try to modify the shared state if the lock seems to be available.
     // this should prevent unnecessary cache invalidation.
-    do {
-        while (state_.load(std::memory_order_relaxed) != UNLOCKED){
-            pause_cpu();
+    int32_t backoff = 1;
+    int32_t count = 0;
+    for (;;){
+        auto state = state_.load(std::memory_order_relaxed);
+        if (state == UNLOCKED){
+            if (try_lock()){
+                return;
+            }
+        } else if (count < spin_count){
+            for (int32_t j = 0; j < backoff; ++j){
+                pause_cpu();
+            }
+            count += backoff;
+            backoff = std::min<int32_t>(backoff * 2, max_backoff);
+        } else {
+            // wait for the writer resp. all readers
+            wait(~UNLOCKED);
         }
-    } while (!try_lock());
+    }
 }
 
 bool shared_spinlock::try_lock(){
@@ -84,13 +177,29 @@ bool shared_spinlock::try_lock(){
 
 void shared_spinlock::unlock(){
     // set to UNLOCKED
-    state_.store(UNLOCKED, std::memory_order_release);
+    state_.store(UNLOCKED); // seq_cst, see wait()
+    wake();
 }
 
 // shared
 void shared_spinlock::lock_shared(){
+    if (try_lock_shared()){
+        return;
+    }
+    contention_.fetch_add(1, std::memory_order_relaxed);
+    int32_t backoff = 1;
+    int32_t count = 0;
     while (!try_lock_shared()){
-        pause_cpu();
+        if (count < spin_count){
+            for (int32_t j = 0; j < backoff; ++j){
+                pause_cpu();
+            }
+            count += backoff;
+            backoff = std::min<int32_t>(backoff * 2, max_backoff);
+        } else {
+            // wait for the writer
+            wait(LOCKED);
+        }
     }
 }
 
@@ -110,7 +219,8 @@ bool shared_spinlock::try_lock_shared(){
 
 void shared_spinlock::unlock_shared(){
     // decrement the reader count
-    state_.fetch_sub(1, std::memory_order_release);
+    state_.fetch_sub(1); // seq_cst, see wait()
+    wake();
 }
 
 /*////////////////////// shared_mutex //////////////////////*/
@@ -169,4 +279,99 @@ void shared_mutex::unlock_shared() {
 }
 #endif
 
+/*////////////////////// rt_shared_mutex ////////////////////*/
+
+void rt_shared_mutex::lock(){
+    mutex_.lock();
+    // Dekker-style handshake with try_lock_rt(): both sides first store
+    // their own flag and then load the other one (all seq_cst), so at
+    // least one of them will see the other.
+    writing_.store(true);
+    // wait for the RT thread to leave its critical section.
+    // it only runs for the duration of a single audio block.
+    int count = 0;
+    while (rtbusy_.load()){
+        if (++count < 1000){
+            pause_cpu();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void rt_shared_mutex::unlock(){
+    writing_.store(false, std::memory_order_release);
+    mutex_.unlock();
+}
+
+/*////////////////////// semaphore ////////////////////*/
+
+#if defined(_WIN32)
+semaphore::semaphore(){
+    sem_ = (void *)CreateSemaphoreA(0, 0, LONG_MAX, 0);
+}
+semaphore::~semaphore(){
+    CloseHandle(sem_);
+}
+void semaphore::post(){
+    ReleaseSemaphore(sem_, 1, 0);
+}
+void semaphore::wait(){
+    WaitForSingleObject(sem_, INFINITE);
+}
+#elif defined(__APPLE__)
+semaphore::semaphore(){
+    sem_ = (void *)dispatch_semaphore_create(0);
+}
+semaphore::~semaphore(){
+    dispatch_release((dispatch_semaphore_t)sem_);
+}
+void semaphore::post(){
+    dispatch_semaphore_signal((dispatch_semaphore_t)sem_);
+}
+void semaphore::wait(){
+    dispatch_semaphore_wait((dispatch_semaphore_t)sem_, DISPATCH_TIME_FOREVER);
+}
+#elif defined(__linux__)
+semaphore::semaphore(){}
+semaphore::~semaphore(){}
+void semaphore::post(){
+    count_.fetch_add(1); // seq_cst, see wait()
+    // only make a syscall if someone is (about to) sleep
+    if (waiters_.load() > 0){
+        wake_address(count_, false);
+    }
+}
+void semaphore::wait(){
+    for (;;){
+        auto count = count_.load(std::memory_order_relaxed);
+        while (count > 0){
+            if (count_.compare_exchange_weak(count, count - 1,
+                                             std::memory_order_acquire)){
+                return;
+            }
+        }
+        // announce ourselves *before* checking the count again
+        waiters_.fetch_add(1);
+        if (count_.load() == 0){
+            wait_address(count_, 0);
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+#else
+semaphore::semaphore(){
+    sem_init(&sem_, 0, 0);
+}
+semaphore::~semaphore(){
+    sem_destroy(&sem_);
+}
+void semaphore::post(){
+    sem_post(&sem_);
+}
+void semaphore::wait(){
+    while (sem_wait(&sem_) == -1 && errno == EINTR) ;
+}
+#endif
+
 } // aoo
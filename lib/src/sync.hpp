@@ -7,13 +7,22 @@
 #include <inttypes.h>
 #include <atomic>
 
-// for shared_lock
+// for unique_lock and shared_lock
+#include <mutex>
 #include <shared_mutex>
 
+#if !defined(_WIN32) && !defined(__APPLE__) && !defined(__linux__)
+#include <semaphore.h>
+#endif
+
 namespace aoo {
 
 /*////////////////// simple spin lock ////////////////////*/
 
+// Spins with exponential backoff for a bounded time and then
+// parks the thread (on a futex on Linux, otherwise it yields).
+// The uncontended path is a single CAS.
+
 class spinlock {
 public:
     spinlock() = default;
@@ -22,8 +31,15 @@ public:
     void lock();
     bool try_lock();
     void unlock();
+    // number of contended lock attempts (for diagnostics)
+    uint32_t contention() const {
+        return contention_.load(std::memory_order_relaxed);
+    }
 protected:
-    std::atomic<uint32_t> locked_{false};
+    void lock_slow();
+    // 0: unlocked, 1: locked, 2: locked with (possible) waiters
+    std::atomic<uint32_t> locked_{0};
+    std::atomic<uint32_t> contention_{0};
 };
 
 /*/////////////////// shared spin lock /////////////////////////*/
@@ -41,10 +57,18 @@ public:
     void lock_shared();
     bool try_lock_shared();
     void unlock_shared();
+    // number of contended lock attempts (for diagnostics)
+    uint32_t contention() const {
+        return contention_.load(std::memory_order_relaxed);
+    }
 protected:
+    void wait(uint32_t mask);
+    void wake();
     const uint32_t UNLOCKED = 0;
     const uint32_t LOCKED = 0x80000000;
     std::atomic<uint32_t> state_{0};
+    std::atomic<uint32_t> waiters_{0};
+    std::atomic<uint32_t> contention_{0};
 };
 
 // paddeded spin locks
@@ -97,6 +121,71 @@ private:
 using shared_lock = std::shared_lock<shared_mutex>;
 using unique_lock = std::unique_lock<shared_mutex>;
 
+/*//////////////////////// rt_shared_mutex //////////////////////////*/
+
+// A shared_mutex which additionally lets a single real-time thread
+// (i.e. the audio thread) access the protected state without locking.
+//
+// The RT thread only ever stores to its own cache line and loads the
+// writer flag, so it never blocks and never does a read-modify-write on
+// a contended cache line. If a writer is active, try_lock_rt() fails
+// and the RT thread is supposed to skip the current block.
+// Writers, on the other hand, wait until the RT thread has left its
+// critical section. Ordinary readers just take the shared lock.
+
+class rt_shared_mutex {
+public:
+    rt_shared_mutex() = default;
+    rt_shared_mutex(const rt_shared_mutex&) = delete;
+    rt_shared_mutex& operator=(const rt_shared_mutex&) = delete;
+    // exclusive
+    void lock();
+    void unlock();
+    // shared
+    void lock_shared() { mutex_.lock_shared(); }
+    bool try_lock_shared() { return mutex_.try_lock_shared(); }
+    void unlock_shared() { mutex_.unlock_shared(); }
+    // real-time thread (wait-free)
+    bool try_lock_rt(){
+        rtbusy_.store(true); // seq_cst, see lock()
+        if (writing_.load()){
+            rtbusy_.store(false, std::memory_order_release);
+            return false;
+        }
+        return true;
+    }
+    void unlock_rt(){
+        rtbusy_.store(false, std::memory_order_release);
+    }
+private:
+    shared_mutex mutex_;
+    std::atomic<bool> writing_{false};
+    char pad1_[CACHELINE_SIZE];
+    // only written by the RT thread
+    std::atomic<bool> rtbusy_{false};
+    char pad2_[CACHELINE_SIZE];
+};
+
+using rt_shared_lock = std::shared_lock<rt_shared_mutex>;
+using rt_unique_lock = std::unique_lock<rt_shared_mutex>;
+
+class rt_lock {
+public:
+    rt_lock(rt_shared_mutex& mutex)
+        : mutex_(&mutex), owns_(mutex.try_lock_rt()){}
+    rt_lock(const rt_lock&) = delete;
+    rt_lock& operator=(const rt_lock&) = delete;
+    ~rt_lock(){
+        if (owns_){
+            mutex_->unlock_rt();
+        }
+    }
+    bool owns_lock() const { return owns_; }
+private:
+    rt_shared_mutex *mutex_;
+    bool owns_;
+};
+
 template<typename T>
 class scoped_lock {
 public:
@@ -121,4 +210,28 @@ private:
     T* lock_;
 };
 
+/*//////////////////////// semaphore //////////////////////////*/
+
+// counting semaphore; post() never blocks and can be called
+// from the audio thread.
+
+class semaphore {
+public:
+    semaphore();
+    ~semaphore();
+    semaphore(const semaphore&) = delete;
+    semaphore& operator=(const semaphore&) = delete;
+    void post();
+    void wait();
+private:
+#if defined(_WIN32) || defined(__APPLE__)
+    void *sem_; // avoid including platform headers
+#elif defined(__linux__)
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint32_t> waiters_{0};
+#else
+    sem_t sem_;
+#endif
+};
+
 } // aoo
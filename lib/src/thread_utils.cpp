@@ -0,0 +1,131 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#include "thread_utils.hpp"
+#include "aoo/aoo.h"
+#include "aoo/aoo_utils.hpp"
+
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/*//////////////////// AoO threads /////////////////////*/
+
+int32_t aoo_set_thread_affinity(const int32_t *cpus, int32_t n){
+    return aoo::set_thread_affinity(cpus, n);
+}
+
+int32_t aoo_get_numa_node(void){
+    return aoo::get_numa_node();
+}
+
+namespace aoo {
+
+bool set_thread_affinity(const int32_t *cpus, int32_t n){
+    if (n <= 0){
+        return false;
+    }
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int32_t i = 0; i < n; ++i){
+        if (cpus[i] >= 0 && cpus[i] < (int32_t)(sizeof(mask) * 8)){
+            mask |= (DWORD_PTR)1 << cpus[i];
+        }
+    }
+    return mask && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int32_t i = 0; i < n; ++i){
+        if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE){
+            CPU_SET(cpus[i], &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    // not supported (e.g. macOS only has affinity *hints*)
+    return false;
+#endif
+}
+
+bool set_thread_realtime(){
+#if defined(_WIN32)
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST) != 0;
+#else
+    // stay at the bottom of the real-time range, so we never
+    // preempt the audio thread.
+    sched_param param;
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#endif
+}
+
+int32_t get_numa_node(){
+#if defined(_WIN32)
+    UCHAR node;
+    if (GetNumaProcessorNode((UCHAR)GetCurrentProcessorNumber(), &node)
+            && node != 0xff){
+        return node;
+    }
+    return -1;
+#elif defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0){
+        return node;
+    }
+    return -1;
+#else
+    return -1;
+#endif
+}
+
+bool bind_memory(const void *ptr, size_t size, int32_t node){
+    if (node < 0){
+        return false;
+    }
+#if defined(__linux__) && defined(SYS_mbind)
+    // we don't want to depend on libnuma, see <numaif.h>
+    const int mpol_preferred = 1;
+    const unsigned mpol_mf_move = 1 << 1;
+
+    unsigned long mask[256 / (sizeof(unsigned long) * 8)] = { 0 };
+    const int32_t nbits = sizeof(unsigned long) * 8;
+    if (node >= (int32_t)(sizeof(mask) * 8)){
+        LOG_ERROR("bind_memory: NUMA node " << node << " out of range");
+        return false;
+    }
+    mask[node / nbits] = 1UL << (node % nbits);
+    // only bind the pages which are fully covered by the memory region,
+    // so we don't accidentally move any neighboring objects.
+    auto pagesize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    auto start = ((uintptr_t)ptr + pagesize - 1) & ~(pagesize - 1);
+    auto end = ((uintptr_t)ptr + size) & ~(pagesize - 1);
+    if (end <= start){
+        LOG_VERBOSE("bind_memory: region too small (" << size << " bytes)");
+        return false;
+    }
+    // NOTE: the kernel expects the mask size + 1
+    if (syscall(SYS_mbind, start, end - start, mpol_preferred,
+                mask, sizeof(mask) * 8 + 1, mpol_mf_move) != 0){
+        LOG_VERBOSE("bind_memory: mbind() failed (" << errno << ")");
+        return false;
+    }
+    return true;
+#else
+    // not supported
+    return false;
+#endif
+}
+
+} // aoo
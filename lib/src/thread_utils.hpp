@@ -0,0 +1,33 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace aoo {
+
+// pin the calling thread to the given CPUs
+bool set_thread_affinity(const int32_t *cpus, int32_t n);
+
+// run the calling thread with the lowest real-time priority
+bool set_thread_realtime();
+
+// the NUMA node of the CPU the calling thread is running on (-1: unknown)
+int32_t get_numa_node();
+
+// prefer the given NUMA node for all pages of a memory region
+// and migrate the pages which have already been touched.
+// NOTE: only whole pages are affected; returns false if the
+// region doesn't cover a single page.
+bool bind_memory(const void *ptr, size_t size, int32_t node);
+
+template<typename T>
+bool bind_memory(const std::vector<T>& v, int32_t node){
+    return bind_memory(v.data(), v.size() * sizeof(T), node);
+}
+
+} // aoo
@@ -0,0 +1,1051 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#include "transport.hpp"
+#include "source.hpp"
+#include "sink.hpp"
+#include "aoo/aoo_utils.hpp"
+
+#include <algorithm>
+
+#if AOO_TRANSPORT_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/udp.h>
+// not defined by older glibc versions
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+// see UDP_MAX_SEGMENTS in the kernel sources
+#define AOO_GSO_MAXSEGMENTS 64
+// max. UDP payload
+#define AOO_GSO_MAXSIZE 65507
+#endif
+
+// "#bundle" + time tag
+#define AOO_BUNDLE_HEADERSIZE 16
+
+#if AOO_USE_IO_URING
+#include <poll.h>
+
+#define AOO_URING_ENTRIES 256
+// number of provided receive buffers (must be a power of 2)
+#define AOO_URING_BUFFERS 256
+// user data tags, see uring_complete()
+#define AOO_URING_RECEIVE 1
+#define AOO_URING_WAKEUP 2
+#define AOO_URING_SEND 3
+#endif
+
+/*//////////////////// AoO transport /////////////////////*/
+
+aoo_transport * aoo_transport_new(int32_t port, int32_t *err){
+    // make 'any' address
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = INADDR_ANY;
+    sa.sin_port = htons(port);
+
+    // create and bind UDP socket
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0){
+        *err = aoo::net::socket_errno();
+        LOG_ERROR("aoo_transport: couldn't create UDP socket (" << *err << ")");
+        return nullptr;
+    }
+
+    // set non-blocking
+    // (this is not necessary on Windows, because WSAEventSelect will do it automatically)
+#ifndef _WIN32
+    if (aoo::net::socket_set_nonblocking(sock, 1) < 0){
+        *err = aoo::net::socket_errno();
+        LOG_ERROR("aoo_transport: couldn't set socket to non-blocking (" << *err << ")");
+        aoo::net::socket_close(sock);
+        return nullptr;
+    }
+#endif
+
+    if (bind(sock, (sockaddr *)&sa, sizeof(sa)) < 0){
+        *err = aoo::net::socket_errno();
+        LOG_ERROR("aoo_transport: couldn't bind UDP socket (" << *err << ")");
+        aoo::net::socket_close(sock);
+        return nullptr;
+    }
+
+    // increase send buffer size to 64 kB
+    int val = 1 << 16;
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char *)&val, sizeof(val)) < 0){
+        LOG_WARNING("aoo_transport: couldn't set SO_SNDBUF");
+        // ignore
+    }
+    // increase receive buffer size to 2 MB
+    val = 1 << 21;
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char *)&val, sizeof(val)) < 0){
+        LOG_WARNING("aoo_transport: couldn't set SO_RCVBUF");
+        // ignore
+    }
+
+    return new aoo::transport(sock, port);
+}
+
+void aoo_transport_free(aoo_transport *t){
+    delete t;
+}
+
+int32_t aoo_transport_run(aoo_transport *t){
+    return t->run();
+}
+
+void aoo_transport_quit(aoo_transport *t){
+    t->quit();
+}
+
+void aoo_transport_notify(aoo_transport *t){
+    t->notify();
+}
+
+int32_t aoo_transport_add_source(aoo_transport *t, aoo_source *src){
+    return t->add_source(src);
+}
+
+int32_t aoo_transport_remove_source(aoo_transport *t, aoo_source *src){
+    return t->remove_source(src);
+}
+
+int32_t aoo_transport_add_sink(aoo_transport *t, aoo_sink *sink){
+    return t->add_sink(sink);
+}
+
+int32_t aoo_transport_remove_sink(aoo_transport *t, aoo_sink *sink){
+    return t->remove_sink(sink);
+}
+
+void * aoo_transport_get_endpoint(aoo_transport *t,
+                                  const void *address, int32_t addrlen){
+    if (addrlen <= 0 || addrlen > (int32_t)sizeof(sockaddr_storage)){
+        LOG_ERROR("aoo_transport: bad address length");
+        return nullptr;
+    }
+    aoo::net::ip_address addr((const sockaddr *)address, addrlen);
+    return t->get_endpoint(addr);
+}
+
+int32_t aoo_transport_send(void *endpoint, const char *data, int32_t n){
+    return static_cast<aoo::transport::endpoint *>(endpoint)->send(data, n);
+}
+
+int32_t aoo_transport_join_group(aoo_transport *t,
+                                 const void *address, int32_t addrlen){
+    if (addrlen <= 0 || addrlen > (int32_t)sizeof(sockaddr_storage)){
+        LOG_ERROR("aoo_transport: bad address length");
+        return 0;
+    }
+    aoo::net::ip_address addr((const sockaddr *)address, addrlen);
+    return t->join_group(addr);
+}
+
+int32_t aoo_transport_leave_group(aoo_transport *t,
+                                  const void *address, int32_t addrlen){
+    if (addrlen <= 0 || addrlen > (int32_t)sizeof(sockaddr_storage)){
+        LOG_ERROR("aoo_transport: bad address length");
+        return 0;
+    }
+    aoo::net::ip_address addr((const sockaddr *)address, addrlen);
+    return t->leave_group(addr);
+}
+
+void aoo_transport_set_bundling(aoo_transport *t, int32_t maxsize){
+    t->set_bundling(maxsize);
+}
+
+int32_t aoo_transport_set_dontfragment(aoo_transport *t, int32_t b){
+    return t->set_dontfragment(b != 0);
+}
+
+namespace aoo {
+
+// the transport which is running on the calling thread, see send()
+static thread_local transport *current_transport = nullptr;
+
+static int32_t transport_reply(void *endpoint, const char *data, int32_t n){
+    return static_cast<transport::endpoint *>(endpoint)->send(data, n);
+}
+
+/*//////////////////////// transport //////////////////////////*/
+
+transport::transport(int socket, int port)
+    : socket_(socket), port_(port),
+      sendbuffer_(new char[AOO_TRANSPORT_BATCHSIZE * AOO_MAXPACKETSIZE]),
+      sendsizes_(AOO_TRANSPORT_BATCHSIZE),
+      sendaddr_(AOO_TRANSPORT_BATCHSIZE)
+{
+#if defined(_WIN32)
+    sockevent_ = WSACreateEvent();
+    waitevent_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    WSAEventSelect(socket_, sockevent_, FD_READ);
+#elif AOO_TRANSPORT_EPOLL
+    epoll_ = epoll_create1(0);
+    eventfd_ = eventfd(0, EFD_NONBLOCK);
+    if (epoll_ < 0 || eventfd_ < 0){
+        LOG_ERROR("aoo_transport: couldn't create epoll instance (" << errno << ")");
+    } else {
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = socket_;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, socket_, &ev);
+        ev.data.fd = eventfd_;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, eventfd_, &ev);
+    }
+    // Check for UDP GSO (Linux 4.18+), so we can send several equally
+    // sized packets to the same endpoint with a single system call.
+    int val = 0;
+    gso_ = setsockopt(socket_, SOL_UDP, UDP_SEGMENT, &val, sizeof(val)) == 0;
+    // Enable UDP GRO (Linux 5.0+), so the kernel may coalesce
+    // consecutive packets from the same sender; we split them again
+    // in receive_packets(). This needs large enough receive buffers.
+    val = 1;
+    gro_ = setsockopt(socket_, SOL_UDP, UDP_GRO, &val, sizeof(val)) == 0;
+    if (gro_){
+        recvsize_ = AOO_GSO_MAXSIZE;
+    }
+    LOG_VERBOSE("aoo_transport: UDP GSO " << (gso_ ? "enabled" : "not available")
+                << ", UDP GRO " << (gro_ ? "enabled" : "not available"));
+#if AOO_USE_IO_URING
+    if (eventfd_ >= 0 && uring_init()){
+        // the provided receive buffers hold a single packet of up to
+        // AOO_MAXUDPPACKETSIZE bytes; we don't request the GRO segment size.
+        if (gro_){
+            val = 0;
+            setsockopt(socket_, SOL_UDP, UDP_GRO, &val, sizeof(val));
+            gro_ = false;
+            recvsize_ = AOO_MAXUDPPACKETSIZE;
+        }
+        LOG_VERBOSE("aoo_transport: using io_uring");
+    } else {
+        LOG_VERBOSE("aoo_transport: io_uring not available, using epoll");
+    }
+#endif
+#else
+    if (pipe(waitpipe_) != 0){
+        LOG_ERROR("aoo_transport: couldn't create pipe (" << errno << ")");
+    } else {
+        net::socket_set_nonblocking(waitpipe_[0], 1);
+        net::socket_set_nonblocking(waitpipe_[1], 1);
+    }
+#endif
+    recvbuffer_.reset(new char[AOO_TRANSPORT_BATCHSIZE * recvsize_]);
+    LOG_VERBOSE("aoo_transport: listening on port " << port_);
+}
+
+transport::~transport(){
+#if defined(_WIN32)
+    WSACloseEvent(sockevent_);
+    CloseHandle(waitevent_);
+#elif AOO_TRANSPORT_EPOLL
+#if AOO_USE_IO_URING
+    // cancels all pending requests
+    uring_.reset();
+#endif
+    if (epoll_ >= 0){
+        close(epoll_);
+    }
+    if (eventfd_ >= 0){
+        close(eventfd_);
+    }
+#else
+    close(waitpipe_[0]);
+    close(waitpipe_[1]);
+#endif
+    net::socket_close(socket_);
+}
+
+int32_t transport::run(){
+    if (current_transport){
+        LOG_ERROR("aoo_transport: already running on this thread");
+        return 0;
+    }
+    current_transport = this;
+    // serialize outgoing packets directly into the send batch
+    set_packet_buffer_hook([](void *user, int32_t minsize, int32_t& size){
+        return static_cast<transport *>(user)->get_send_buffer(minsize, size);
+    }, this);
+    while (!quit_.load()){
+        wait_for_event();
+        // always do a send round, so that we can reply to incoming
+        // messages and send pings/resend requests on time.
+        send_packets();
+    }
+    set_packet_buffer_hook(nullptr, nullptr);
+    current_transport = nullptr;
+    return 1;
+}
+
+void transport::quit(){
+    quit_.store(true);
+    notified_.store(true);
+#if defined(_WIN32)
+    SetEvent(waitevent_);
+#elif AOO_TRANSPORT_EPOLL
+    uint64_t one = 1;
+    write(eventfd_, &one, sizeof(one));
+#else
+    char c = 0;
+    write(waitpipe_[1], &c, 1);
+#endif
+}
+
+void transport::notify(){
+    // only wake up the network thread once per send round
+    if (!notified_.exchange(true, std::memory_order_acq_rel)){
+    #if defined(_WIN32)
+        SetEvent(waitevent_);
+    #elif AOO_TRANSPORT_EPOLL
+        uint64_t one = 1;
+        write(eventfd_, &one, sizeof(one));
+    #else
+        char c = 0;
+        write(waitpipe_[1], &c, 1);
+    #endif
+    }
+}
+
+bool transport::add_source(isource *src){
+    unique_lock lock(client_mutex_);
+    if (std::find(sources_.begin(), sources_.end(), src) != sources_.end()){
+        LOG_ERROR("aoo_transport: source already added");
+        return false;
+    }
+    sources_.push_back(src);
+    return true;
+}
+
+bool transport::remove_source(isource *src){
+    unique_lock lock(client_mutex_);
+    auto it = std::find(sources_.begin(), sources_.end(), src);
+    if (it != sources_.end()){
+        sources_.erase(it);
+        return true;
+    } else {
+        LOG_ERROR("aoo_transport: source not found");
+        return false;
+    }
+}
+
+bool transport::add_sink(isink *sink){
+    unique_lock lock(client_mutex_);
+    if (std::find(sinks_.begin(), sinks_.end(), sink) != sinks_.end()){
+        LOG_ERROR("aoo_transport: sink already added");
+        return false;
+    }
+    sinks_.push_back(sink);
+    return true;
+}
+
+bool transport::remove_sink(isink *sink){
+    unique_lock lock(client_mutex_);
+    auto it = std::find(sinks_.begin(), sinks_.end(), sink);
+    if (it != sinks_.end()){
+        sinks_.erase(it);
+        return true;
+    } else {
+        LOG_ERROR("aoo_transport: sink not found");
+        return false;
+    }
+}
+
+transport::endpoint * transport::get_endpoint(const net::ip_address& addr){
+    {
+        shared_lock lock(endpoint_mutex_);
+        for (auto& e : endpoints_){
+            if (e->address == addr){
+                return e.get();
+            }
+        }
+    }
+    unique_lock lock(endpoint_mutex_);
+    // check again, another thread might have added it in the meantime
+    for (auto& e : endpoints_){
+        if (e->address == addr){
+            return e.get();
+        }
+    }
+    endpoints_.push_back(std::make_unique<endpoint>(*this, addr));
+    LOG_VERBOSE("aoo_transport: new endpoint " << addr.name() << ":" << addr.port());
+    return endpoints_.back().get();
+}
+
+bool transport::join_group(const net::ip_address& addr){
+    if (net::socket_join_group(socket_, addr) < 0){
+        LOG_ERROR("aoo_transport: couldn't join multicast group " << addr.name()
+                  << " (" << net::socket_errno() << ")");
+        return false;
+    }
+    LOG_VERBOSE("aoo_transport: joined multicast group " << addr.name());
+    return true;
+}
+
+bool transport::leave_group(const net::ip_address& addr){
+    if (net::socket_leave_group(socket_, addr) < 0){
+        LOG_ERROR("aoo_transport: couldn't leave multicast group " << addr.name()
+                  << " (" << net::socket_errno() << ")");
+        return false;
+    }
+    LOG_VERBOSE("aoo_transport: left multicast group " << addr.name());
+    return true;
+}
+
+void transport::set_bundling(int32_t maxsize){
+    maxsize = std::min<int32_t>(std::max<int32_t>(0, maxsize), AOO_MAXPACKETSIZE);
+    bundlesize_.store(maxsize);
+    LOG_VERBOSE("aoo_transport: bundle size " << maxsize);
+}
+
+bool transport::set_dontfragment(bool b){
+    if (net::socket_set_dontfragment(socket_, b) < 0){
+        LOG_ERROR("aoo_transport: couldn't set 'don't fragment' option ("
+                  << net::socket_errno() << ")");
+        return false;
+    }
+    LOG_VERBOSE("aoo_transport: don't fragment " << (b ? "on" : "off"));
+    return true;
+}
+
+void transport::wait_for_event(){
+#if defined(_WIN32)
+    HANDLE events[2] = { sockevent_, waitevent_ };
+    DWORD result = WaitForMultipleObjects(2, events, FALSE, AOO_TRANSPORT_INTERVAL);
+    if (result == WAIT_OBJECT_0){
+        WSANETWORKEVENTS ne;
+        memset(&ne, 0, sizeof(ne));
+        WSAEnumNetworkEvents(socket_, sockevent_, &ne);
+        if (ne.lNetworkEvents & FD_READ){
+            receive_packets();
+        }
+    } else if (result == WAIT_OBJECT_0 + 1){
+        notified_.store(false);
+    }
+#elif AOO_TRANSPORT_EPOLL
+#if AOO_USE_IO_URING
+    if (uring_){
+        uring_wait();
+        return;
+    }
+#endif
+    epoll_event events[2];
+    int result = epoll_wait(epoll_, events, 2, AOO_TRANSPORT_INTERVAL);
+    if (result < 0){
+        int err = errno;
+        if (err != EINTR){
+            LOG_ERROR("aoo_transport: epoll_wait() failed (" << err << ")");
+        }
+        return;
+    }
+    for (int i = 0; i < result; ++i){
+        if (events[i].data.fd == eventfd_){
+            // clear eventfd
+            uint64_t count;
+            read(eventfd_, &count, sizeof(count));
+            notified_.store(false);
+        } else if (events[i].events & EPOLLIN){
+            receive_packets();
+        }
+    }
+#else
+    struct pollfd fds[2];
+    fds[0].fd = socket_;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = waitpipe_[0];
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    int result = poll(fds, 2, AOO_TRANSPORT_INTERVAL);
+    if (result < 0){
+        int err = errno;
+        if (err != EINTR){
+            LOG_ERROR("aoo_transport: poll() failed (" << err << ")");
+        }
+        return;
+    }
+    if (fds[1].revents & POLLIN){
+        // clear pipe
+        char buf[64];
+        while (read(waitpipe_[0], buf, sizeof(buf)) > 0) ;
+        notified_.store(false);
+    }
+    if (fds[0].revents & POLLIN){
+        receive_packets();
+    }
+#endif
+}
+
+void transport::receive_packets(){
+    // read as much data as possible until recv() would block
+#if AOO_TRANSPORT_EPOLL
+    mmsghdr msgs[AOO_TRANSPORT_BATCHSIZE];
+    iovec iov[AOO_TRANSPORT_BATCHSIZE];
+    sockaddr_storage addr[AOO_TRANSPORT_BATCHSIZE];
+    // for the UDP_GRO segment size
+    char control[AOO_TRANSPORT_BATCHSIZE][CMSG_SPACE(sizeof(int))];
+    while (true){
+        for (int i = 0; i < AOO_TRANSPORT_BATCHSIZE; ++i){
+            iov[i].iov_base = recvbuffer_.get() + i * recvsize_;
+            iov[i].iov_len = recvsize_;
+            memset(&msgs[i], 0, sizeof(mmsghdr));
+            msgs[i].msg_hdr.msg_name = &addr[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if (gro_){
+                msgs[i].msg_hdr.msg_control = control[i];
+                msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+            }
+        }
+        int result = recvmmsg(socket_, msgs, AOO_TRANSPORT_BATCHSIZE,
+                              MSG_DONTWAIT, nullptr);
+        if (result < 0){
+            int err = errno;
+            if (err == EINTR){
+                continue;
+            } else if (err != EWOULDBLOCK && err != EAGAIN){
+                LOG_ERROR("aoo_transport: recvmmsg() failed (" << err << ")");
+            }
+            return;
+        }
+        for (int i = 0; i < result; ++i){
+            net::ip_address address((const sockaddr *)&addr[i],
+                                    msgs[i].msg_hdr.msg_namelen);
+            auto data = (const char *)iov[i].iov_base;
+            int32_t size = msgs[i].msg_len;
+            // with GRO, the kernel might have coalesced several packets;
+            // the segment size is passed as a control message.
+            int32_t segsize = size;
+            if (gro_){
+                for (auto cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm;
+                     cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm)){
+                    if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO){
+                        int gsosize;
+                        memcpy(&gsosize, CMSG_DATA(cm), sizeof(gsosize));
+                        if (gsosize > 0){
+                            segsize = gsosize;
+                        }
+                        break;
+                    }
+                }
+            }
+            for (int32_t onset = 0; onset < size; onset += segsize){
+                handle_packet(data + onset, std::min(segsize, size - onset), address);
+            }
+        }
+        if (result < AOO_TRANSPORT_BATCHSIZE){
+            return; // socket is drained
+        }
+    }
+#else
+    while (true){
+        char *buf = recvbuffer_.get();
+        net::ip_address address;
+        int32_t result = recvfrom(socket_, buf, recvsize_, 0,
+                                  (struct sockaddr *)&address.address,
+                                  &address.length);
+        if (result > 0){
+            handle_packet(buf, result, address);
+        } else if (result < 0){
+            int err = net::socket_errno();
+        #ifdef _WIN32
+            // ignore ICMP "port unreachable" errors
+            if (err != WSAEWOULDBLOCK && err != WSAECONNRESET)
+        #else
+            if (err != EWOULDBLOCK)
+        #endif
+            {
+                LOG_ERROR("aoo_transport: recv() failed (" << err << ")");
+            }
+            return;
+        }
+    }
+#endif
+}
+
+void transport::handle_packet(const char *data, int32_t n,
+                              const net::ip_address& addr)
+{
+    if (n >= AOO_BUNDLE_HEADERSIZE && !memcmp(data, "#bundle", 8)){
+        // several messages which have been bundled by the sender, see send()
+        auto p = data + AOO_BUNDLE_HEADERSIZE;
+        auto end = data + n;
+        while ((end - p) >= 4){
+            auto size = aoo::from_bytes<int32_t>(p);
+            p += 4;
+            if (size <= 0 || size > (end - p)){
+                LOG_WARNING("aoo_transport: bad bundle element size");
+                return;
+            }
+            handle_packet(p, size, addr);
+            p += size;
+        }
+        return;
+    }
+
+    int32_t type, id;
+    if (aoo_parse_pattern(data, n, &type, &id) <= 0){
+        LOG_VERBOSE("aoo_transport: not an AoO message");
+        return;
+    }
+    auto e = get_endpoint(addr);
+
+    shared_lock lock(client_mutex_);
+    if (type == AOO_TYPE_SOURCE){
+        for (auto& src : sources_){
+            if (id == AOO_ID_WILDCARD || id == static_cast<source *>(src)->id()){
+                src->handle_message(data, n, e, transport_reply);
+                if (id != AOO_ID_WILDCARD){
+                    break;
+                }
+            }
+        }
+    } else if (type == AOO_TYPE_SINK){
+        // NOTE: compact data messages don't have an ID (AOO_ID_NONE),
+        // the sinks look up the source by its salt.
+        for (auto& sink : sinks_){
+            if (id == AOO_ID_WILDCARD || id == AOO_ID_NONE
+                    || id == static_cast<aoo::sink *>(sink)->id()){
+                sink->handle_message(data, n, e, transport_reply);
+                if (id != AOO_ID_WILDCARD && id != AOO_ID_NONE){
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void transport::send_packets(){
+    {
+        shared_lock lock(client_mutex_);
+        for (auto& src : sources_){
+            src->send();
+        }
+        for (auto& sink : sinks_){
+            sink->send();
+        }
+    }
+    flush();
+}
+
+int32_t transport::send(const char *data, int32_t n, const net::ip_address& addr){
+    if (current_transport == this && n <= AOO_MAXPACKETSIZE){
+        // called on the network thread: add to batch
+        auto bundlesize = bundlesize_.load(std::memory_order_relaxed);
+        if (bundlesize > 0 && add_to_bundle(data, n, addr, bundlesize)){
+            return n;
+        }
+        auto slot = sendbuffer_.get() + numsend_ * AOO_MAXPACKETSIZE;
+        // no need to copy if the packet has been written
+        // into the send batch, see get_send_buffer().
+        if (data != slot){
+            if (numsend_ == AOO_TRANSPORT_BATCHSIZE){
+                flush();
+                slot = sendbuffer_.get();
+            }
+            memcpy(slot, data, n);
+        }
+        sendsizes_[numsend_] = n;
+        sendaddr_[numsend_] = &addr; // endpoints are never freed
+        numsend_++;
+        return n;
+    } else {
+        if (current_transport == this){
+            // jumbo packet: send pending packets first to keep the order
+            flush();
+        }
+        return do_send(data, n, addr);
+    }
+}
+
+int32_t transport::do_send(const char *data, int32_t n, const net::ip_address& addr){
+    auto result = ::sendto(socket_, data, n, 0,
+                           (const struct sockaddr *)&addr.address, addr.length);
+    if (result < 0){
+        int err = net::socket_errno();
+    #ifdef _WIN32
+        if (err == WSAEMSGSIZE)
+    #else
+        if (err == EMSGSIZE)
+    #endif
+        {
+            // e.g. a packet size probe with the DF bit set
+            LOG_VERBOSE("aoo_transport: packet too large (" << n << " bytes)");
+        }
+    #ifdef _WIN32
+        else if (err != WSAEWOULDBLOCK)
+    #else
+        else if (err != EWOULDBLOCK)
+    #endif
+        {
+            LOG_ERROR("aoo_transport: send() failed (" << err << ")");
+        } else {
+            LOG_VERBOSE("aoo_transport: send() would block");
+        }
+    }
+    return result;
+}
+
+// called on the network thread, see run() and get_packet_buffer()
+char * transport::get_send_buffer(int32_t minsize, int32_t& size){
+    if (minsize > AOO_MAXPACKETSIZE){
+        return nullptr; // jumbo packet, see send()
+    }
+    if (numsend_ == AOO_TRANSPORT_BATCHSIZE){
+        flush();
+    }
+    size = AOO_MAXPACKETSIZE;
+    return sendbuffer_.get() + numsend_ * AOO_MAXPACKETSIZE;
+}
+
+// Append the message to the last pending packet for the same endpoint,
+// so that the order of messages per endpoint is preserved. The packet
+// is converted into an OSC bundle if necessary:
+// #bundle <time tag> <size> <message> <size> <message> ...
+// NOTE: the elements are not necessarily valid OSC messages,
+// see AOO_PROTOCOL_FLAG_BINARY_DATA.
+bool transport::add_to_bundle(const char *data, int32_t n,
+                              const net::ip_address& addr, int32_t maxsize){
+    for (int32_t i = numsend_ - 1; i >= 0; --i){
+        if (!(*sendaddr_[i] == addr)){
+            continue;
+        }
+        auto buf = sendbuffer_.get() + i * AOO_MAXPACKETSIZE;
+        auto size = sendsizes_[i];
+        bool bundle = size >= AOO_BUNDLE_HEADERSIZE && !memcmp(buf, "#bundle", 8);
+        auto newsize = size + 4 + n;
+        if (!bundle){
+            newsize += AOO_BUNDLE_HEADERSIZE + 4;
+        }
+        if (newsize > maxsize){
+            return false;
+        }
+        if (!bundle){
+            // make bundle and move the packet into the first element
+            memmove(buf + AOO_BUNDLE_HEADERSIZE + 4, buf, size);
+            memcpy(buf, "#bundle", 8);
+            aoo::to_bytes<uint64_t>(1, buf + 8); // immediately
+            aoo::to_bytes<int32_t>(size, buf + AOO_BUNDLE_HEADERSIZE);
+            size += AOO_BUNDLE_HEADERSIZE + 4;
+        }
+        aoo::to_bytes<int32_t>(n, buf + size);
+        memcpy(buf + size + 4, data, n);
+        sendsizes_[i] = newsize;
+        return true;
+    }
+    return false;
+}
+
+void transport::flush(){
+    if (!numsend_){
+        return;
+    }
+#if AOO_TRANSPORT_EPOLL
+    mmsghdr msgs[AOO_TRANSPORT_BATCHSIZE];
+    iovec iov[AOO_TRANSPORT_BATCHSIZE];
+    // for the UDP_SEGMENT size
+    char control[AOO_TRANSPORT_BATCHSIZE][CMSG_SPACE(sizeof(uint16_t))];
+    int first[AOO_TRANSPORT_BATCHSIZE]; // first packet of each message
+    int nmsgs = 0;
+    for (int i = 0; i < numsend_; ){
+        // With GSO, we can merge consecutive packets to the same endpoint,
+        // as long as they have the same size; only the last packet may be
+        // shorter. This is typically the case for the frames of a block,
+        // see source::send_data().
+        int count = 1;
+        int32_t total = sendsizes_[i];
+        if (gso_){
+            while (i + count < numsend_ && count < AOO_GSO_MAXSEGMENTS
+                   && sendaddr_[i + count] == sendaddr_[i]
+                   && sendsizes_[i + count - 1] == sendsizes_[i]
+                   && sendsizes_[i + count] <= sendsizes_[i]
+                   && total + sendsizes_[i + count] <= AOO_GSO_MAXSIZE){
+                total += sendsizes_[i + count];
+                count++;
+            }
+        }
+        for (int k = i; k < i + count; ++k){
+            iov[k].iov_base = sendbuffer_.get() + k * AOO_MAXPACKETSIZE;
+            iov[k].iov_len = sendsizes_[k];
+        }
+        auto& msg = msgs[nmsgs];
+        memset(&msg, 0, sizeof(mmsghdr));
+        msg.msg_hdr.msg_name = (void *)&sendaddr_[i]->address;
+        msg.msg_hdr.msg_namelen = sendaddr_[i]->length;
+        msg.msg_hdr.msg_iov = &iov[i];
+        msg.msg_hdr.msg_iovlen = count;
+        if (count > 1){
+            msg.msg_hdr.msg_control = control[nmsgs];
+            msg.msg_hdr.msg_controllen = sizeof(control[nmsgs]);
+            auto cm = CMSG_FIRSTHDR(&msg.msg_hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segsize = sendsizes_[i];
+            memcpy(CMSG_DATA(cm), &segsize, sizeof(segsize));
+        }
+        first[nmsgs] = i;
+        nmsgs++;
+        i += count;
+    }
+#if AOO_USE_IO_URING
+    if (uring_){
+        uring_flush(msgs, nmsgs, first);
+        numsend_ = 0;
+        return;
+    }
+#endif
+    int onset = 0;
+    while (onset < nmsgs){
+        int result = sendmmsg(socket_, msgs + onset, nmsgs - onset, 0);
+        if (result < 0){
+            int err = errno;
+            if (err == EINTR){
+                continue;
+            }
+            send_failed(msgs[onset], first[onset], err);
+            // skip the message which caused the error and try the rest
+            onset++;
+        } else {
+            onset += result;
+        }
+    }
+#else
+    for (int i = 0; i < numsend_; ++i){
+        do_send(sendbuffer_.get() + i * AOO_MAXPACKETSIZE,
+                sendsizes_[i], *sendaddr_[i]);
+    }
+#endif
+    numsend_ = 0;
+}
+
+#if AOO_TRANSPORT_EPOLL
+void transport::send_failed(const mmsghdr& msg, int first, int err){
+    if (msg.msg_hdr.msg_iovlen > 1 && (err == EIO || err == EINVAL)){
+        // GSO is not supported by the network device (e.g. no
+        // checksum offloading); disable it and send the packets
+        // one by one.
+        LOG_WARNING("aoo_transport: UDP GSO failed (" << err << "), disabling");
+        gso_ = false;
+        for (int k = 0; k < (int)msg.msg_hdr.msg_iovlen; ++k){
+            int index = first + k;
+            do_send(sendbuffer_.get() + index * AOO_MAXPACKETSIZE,
+                    sendsizes_[index], *sendaddr_[index]);
+        }
+    } else if (err == EWOULDBLOCK || err == EAGAIN){
+        LOG_VERBOSE("aoo_transport: sendmsg() would block");
+    } else if (err == EMSGSIZE){
+        // e.g. a packet size probe with the DF bit set
+        LOG_VERBOSE("aoo_transport: packet too large (" << sendsizes_[first] << " bytes)");
+    } else {
+        LOG_ERROR("aoo_transport: sendmsg() failed (" << err << ")");
+    }
+}
+#endif
+
+#if AOO_USE_IO_URING
+bool transport::uring_init(){
+    uring_ = std::make_unique<uring>();
+    if (uring_->init(AOO_URING_ENTRIES)){
+        // each buffer holds the recvmsg header, the source address and
+        // the packet, which may be as large as the max. UDP payload size.
+        auto size = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_storage)
+                + AOO_MAXUDPPACKETSIZE;
+        if (uring_->register_buffers(0, AOO_URING_BUFFERS, size)){
+            memset(&uring_msg_, 0, sizeof(uring_msg_));
+            uring_msg_.msg_namelen = sizeof(sockaddr_storage);
+            uring_pending_.reserve(AOO_URING_ENTRIES * 2);
+            if (uring_arm_receive() && uring_arm_wakeup()
+                    && uring_->submit() >= 0){
+                // Multishot receive needs Linux 6.0+; older kernels
+                // reject the request immediately.
+                io_uring_cqe cqe;
+                bool ok = true;
+                while (uring_->pop_cqe(cqe)){
+                    if (cqe.user_data == AOO_URING_RECEIVE && cqe.res < 0){
+                        LOG_VERBOSE("aoo_transport: multishot receive failed ("
+                                    << -cqe.res << ")");
+                        ok = false;
+                    } else {
+                        uring_pending_.push_back(cqe);
+                    }
+                }
+                if (ok){
+                    return true;
+                }
+            }
+        }
+    }
+    uring_.reset();
+    uring_pending_.clear();
+    return false;
+}
+
+bool transport::uring_arm_receive(){
+    auto sqe = uring_->get_sqe();
+    if (!sqe){
+        uring_->submit();
+        if (!(sqe = uring_->get_sqe())){
+            LOG_ERROR("aoo_transport: io_uring submission queue full");
+            return false;
+        }
+    }
+    // keeps posting completions until it fails or runs out of buffers;
+    // the kernel picks a buffer from our buffer ring for each packet.
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = socket_;
+    sqe->addr = (uint64_t)(uintptr_t)&uring_msg_;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = AOO_URING_RECEIVE;
+    return true;
+}
+
+bool transport::uring_arm_wakeup(){
+    auto sqe = uring_->get_sqe();
+    if (!sqe){
+        uring_->submit();
+        if (!(sqe = uring_->get_sqe())){
+            LOG_ERROR("aoo_transport: io_uring submission queue full");
+            return false;
+        }
+    }
+    // wait for quit() resp. notify()
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = eventfd_;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = AOO_URING_WAKEUP;
+    return true;
+}
+
+void transport::uring_wait(){
+    // submit pending requests (e.g. re-armed receive) and wait for events,
+    // unless there are still completions left over from uring_flush().
+    int result = uring_->submit(uring_pending_.empty() ? 1 : 0,
+                                AOO_TRANSPORT_INTERVAL);
+    if (result < 0 && result != -ETIME && result != -EINTR){
+        LOG_ERROR("aoo_transport: io_uring_enter() failed (" << -result << ")");
+    }
+    io_uring_cqe cqe;
+    while (uring_->pop_cqe(cqe)){
+        uring_pending_.push_back(cqe);
+    }
+    // NOTE: handle_packet() might call flush(), which can add
+    // more completions, so we must not use iterators!
+    for (size_t i = 0; i < uring_pending_.size(); ++i){
+        auto c = uring_pending_[i];
+        uring_complete(c);
+    }
+    uring_pending_.clear();
+}
+
+void transport::uring_complete(const io_uring_cqe& cqe){
+    switch (cqe.user_data & 0xff){
+    case AOO_URING_RECEIVE:
+        uring_receive(cqe);
+        break;
+    case AOO_URING_WAKEUP:
+    {
+        // clear eventfd
+        uint64_t count;
+        read(eventfd_, &count, sizeof(count));
+        notified_.store(false);
+        uring_arm_wakeup();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void transport::uring_receive(const io_uring_cqe& cqe){
+    if (cqe.res < 0){
+        // ENOBUFS: all buffers are in use, we'll just rearm.
+        if (cqe.res != -ENOBUFS){
+            LOG_ERROR("aoo_transport: io_uring receive failed (" << -cqe.res << ")");
+        }
+    } else if (cqe.flags & IORING_CQE_F_BUFFER){
+        uint16_t id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        auto buf = uring_->buffer(id);
+        // the buffer starts with the header, followed by the
+        // source address, the control data and the payload.
+        io_uring_recvmsg_out out;
+        memcpy(&out, buf, sizeof(out));
+        auto name = buf + sizeof(out);
+        auto payload = name + uring_msg_.msg_namelen + uring_msg_.msg_controllen;
+        if (out.flags & MSG_TRUNC){
+            // can't happen, the buffers can hold any UDP packet
+            LOG_ERROR("aoo_transport: packet truncated (" << out.payloadlen
+                      << " bytes), ignoring");
+        } else {
+            net::ip_address address((const sockaddr *)name,
+                                    std::min(out.namelen, uring_msg_.msg_namelen));
+            handle_packet(payload, out.payloadlen, address);
+        }
+        uring_->recycle_buffer(id);
+    }
+    if (!(cqe.flags & IORING_CQE_F_MORE)){
+        uring_arm_receive();
+    }
+}
+
+void transport::uring_flush(const mmsghdr *msgs, int nmsgs, const int *first){
+    for (int i = 0; i < nmsgs; ++i){
+        auto sqe = uring_->get_sqe();
+        if (!sqe){
+            uring_->submit();
+            if (!(sqe = uring_->get_sqe())){
+                // should never happen...
+                LOG_ERROR("aoo_transport: io_uring submission queue full");
+                nmsgs = i;
+                break;
+            }
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = socket_;
+        sqe->addr = (uint64_t)(uintptr_t)&msgs[i].msg_hdr;
+        sqe->len = 1;
+        sqe->user_data = ((uint64_t)i << 8) | AOO_URING_SEND;
+    }
+    // Submit everything with a single system call and wait for the
+    // completions, because the messages and the send buffer are reused.
+    // All other completions are handled later in uring_wait().
+    int remaining = nmsgs;
+    while (remaining > 0){
+        int result = uring_->submit(1);
+        if (result < 0 && result != -EINTR && result != -EAGAIN
+                && result != -EBUSY){
+            LOG_ERROR("aoo_transport: io_uring_enter() failed (" << -result << ")");
+            break;
+        }
+        io_uring_cqe cqe;
+        while (uring_->pop_cqe(cqe)){
+            if ((cqe.user_data & 0xff) == AOO_URING_SEND){
+                if (cqe.res < 0){
+                    int index = cqe.user_data >> 8;
+                    send_failed(msgs[index], first[index], -cqe.res);
+                }
+                remaining--;
+            } else {
+                uring_pending_.push_back(cqe);
+            }
+        }
+    }
+}
+#endif
+
+} // aoo
@@ -0,0 +1,146 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#pragma once
+
+#include "aoo/aoo.hpp"
+
+#include "net_utils.hpp"
+#include "sync.hpp"
+#include "uring.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#ifdef __linux__
+#define AOO_TRANSPORT_EPOLL 1
+#endif
+
+namespace aoo {
+
+/*//////////////////////// transport //////////////////////////*/
+
+class transport {
+public:
+    struct endpoint {
+        endpoint(transport& t, const net::ip_address& a)
+            : owner(t), address(a) {}
+
+        int32_t send(const char *data, int32_t n){
+            return owner.send(data, n, address);
+        }
+
+        transport& owner;
+        const net::ip_address address;
+    };
+
+    transport(int socket, int port);
+    ~transport();
+    transport(const transport&) = delete;
+    transport& operator=(const transport&) = delete;
+
+    int port() const { return port_; }
+
+    int32_t run();
+
+    void quit();
+
+    void notify();
+
+    bool add_source(isource *src);
+
+    bool remove_source(isource *src);
+
+    bool add_sink(isink *sink);
+
+    bool remove_sink(isink *sink);
+
+    endpoint * get_endpoint(const net::ip_address& addr);
+
+    bool join_group(const net::ip_address& addr);
+
+    bool leave_group(const net::ip_address& addr);
+
+    void set_bundling(int32_t maxsize);
+
+    bool set_dontfragment(bool b);
+private:
+    void wait_for_event();
+
+    void receive_packets();
+
+    void handle_packet(const char *data, int32_t n,
+                       const net::ip_address& addr);
+
+    void send_packets();
+
+    int32_t send(const char *data, int32_t n, const net::ip_address& addr);
+
+    int32_t do_send(const char *data, int32_t n, const net::ip_address& addr);
+
+    char * get_send_buffer(int32_t minsize, int32_t& size);
+
+    bool add_to_bundle(const char *data, int32_t n, const net::ip_address& addr,
+                       int32_t maxsize);
+
+    void flush();
+#if AOO_TRANSPORT_EPOLL
+    void send_failed(const mmsghdr& msg, int first, int err);
+#endif
+#if AOO_USE_IO_URING
+    bool uring_init();
+
+    bool uring_arm_receive();
+
+    bool uring_arm_wakeup();
+
+    void uring_wait();
+
+    void uring_complete(const io_uring_cqe& cqe);
+
+    void uring_receive(const io_uring_cqe& cqe);
+
+    void uring_flush(const mmsghdr *msgs, int nmsgs, const int *first);
+#endif
+
+    int socket_;
+    int port_;
+    std::atomic<bool> quit_{false};
+    std::atomic<bool> notified_{false};
+#if defined(_WIN32)
+    HANDLE sockevent_;
+    HANDLE waitevent_;
+#elif AOO_TRANSPORT_EPOLL
+    int epoll_ = -1;
+    int eventfd_ = -1;
+    // UDP segmentation offload
+    bool gso_ = false;
+    bool gro_ = false;
+#if AOO_USE_IO_URING
+    std::unique_ptr<uring> uring_; // null if not available
+    msghdr uring_msg_; // for multishot receive
+    std::vector<io_uring_cqe> uring_pending_;
+#endif
+#else
+    int waitpipe_[2];
+#endif
+    // sources and sinks
+    std::vector<isource *> sources_;
+    std::vector<isink *> sinks_;
+    shared_mutex client_mutex_;
+    // endpoints
+    std::vector<std::unique_ptr<endpoint>> endpoints_;
+    shared_mutex endpoint_mutex_;
+    // packet buffers
+    std::unique_ptr<char[]> recvbuffer_;
+    int32_t recvsize_ = AOO_MAXUDPPACKETSIZE; // per packet
+    std::unique_ptr<char[]> sendbuffer_;
+    std::vector<int32_t> sendsizes_;
+    std::vector<const net::ip_address *> sendaddr_;
+    int32_t numsend_ = 0;
+    std::atomic<int32_t> bundlesize_{0}; // 0: no bundling
+};
+
+} // aoo
@@ -0,0 +1,248 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#include "uring.hpp"
+
+#if AOO_USE_IO_URING
+
+#include "aoo/aoo_utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// not defined by older glibc versions
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+
+namespace aoo {
+
+static inline uint32_t load_acquire(const uint32_t *p){
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(uint32_t *p, uint32_t v){
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+/*//////////////////////// uring //////////////////////////*/
+
+uring::~uring(){
+    if (bufdata_){
+        munmap(bufdata_, bufdatasize_);
+    }
+    if (bufring_){
+        munmap(bufring_, bufringsize_);
+    }
+    if (sqes_){
+        munmap(sqes_, sqessize_);
+    }
+    if (cqring_ && cqring_ != sqring_){
+        munmap(cqring_, cqringsize_);
+    }
+    if (sqring_){
+        munmap(sqring_, sqringsize_);
+    }
+    if (fd_ >= 0){
+        close(fd_);
+    }
+}
+
+bool uring::init(uint32_t entries){
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0){
+        LOG_VERBOSE("io_uring_setup() failed (" << errno << ")");
+        return false;
+    }
+    // we need the timeout argument for io_uring_enter() (Linux 5.11+)
+    if (!(p.features & IORING_FEAT_EXT_ARG)){
+        LOG_VERBOSE("io_uring: IORING_FEAT_EXT_ARG not supported");
+        close(fd);
+        return false;
+    }
+    fd_ = fd;
+    features_ = p.features;
+    // map rings
+    sqringsize_ = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    cqringsize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (features_ & IORING_FEAT_SINGLE_MMAP){
+        sqringsize_ = cqringsize_ = std::max(sqringsize_, cqringsize_);
+    }
+    auto sq = mmap(nullptr, sqringsize_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED){
+        LOG_ERROR("io_uring: couldn't map submission queue (" << errno << ")");
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    sqring_ = sq;
+    if (features_ & IORING_FEAT_SINGLE_MMAP){
+        cqring_ = sqring_;
+    } else {
+        auto cq = mmap(nullptr, cqringsize_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED){
+            LOG_ERROR("io_uring: couldn't map completion queue (" << errno << ")");
+            close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        cqring_ = cq;
+    }
+    sqessize_ = p.sq_entries * sizeof(io_uring_sqe);
+    auto sqes = mmap(nullptr, sqessize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED){
+        LOG_ERROR("io_uring: couldn't map SQEs (" << errno << ")");
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    sqes_ = (io_uring_sqe *)sqes;
+
+    auto sqbase = (char *)sqring_;
+    sqhead_ = (uint32_t *)(sqbase + p.sq_off.head);
+    sqtail_ = (uint32_t *)(sqbase + p.sq_off.tail);
+    sqmask_ = *(uint32_t *)(sqbase + p.sq_off.ring_mask);
+    sqentries_ = p.sq_entries;
+    sqarray_ = (uint32_t *)(sqbase + p.sq_off.array);
+    sqlocaltail_ = sqsubmitted_ = *sqtail_;
+
+    auto cqbase = (char *)cqring_;
+    cqhead_ = (uint32_t *)(cqbase + p.cq_off.head);
+    cqtail_ = (uint32_t *)(cqbase + p.cq_off.tail);
+    cqmask_ = *(uint32_t *)(cqbase + p.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe *)(cqbase + p.cq_off.cqes);
+
+    return true;
+}
+
+io_uring_sqe * uring::get_sqe(){
+    if (sqlocaltail_ - load_acquire(sqhead_) >= sqentries_){
+        return nullptr; // full
+    }
+    auto index = sqlocaltail_ & sqmask_;
+    auto sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    sqarray_[index] = index;
+    sqlocaltail_++;
+    return sqe;
+}
+
+int uring::submit(uint32_t wait, int32_t timeout){
+    // publish new SQEs
+    store_release(sqtail_, sqlocaltail_);
+    uint32_t count = sqlocaltail_ - sqsubmitted_;
+    unsigned flags = 0;
+    void *arg = nullptr;
+    size_t argsize = 0;
+    __kernel_timespec ts;
+    io_uring_getevents_arg ga;
+    if (wait > 0){
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout >= 0){
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000;
+            memset(&ga, 0, sizeof(ga));
+            ga.ts = (uint64_t)(uintptr_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+            arg = &ga;
+            argsize = sizeof(ga);
+        }
+    } else if (count == 0){
+        return 0; // nothing to do
+    }
+    int result = syscall(__NR_io_uring_enter, fd_, count, wait,
+                         flags, arg, argsize);
+    if (result < 0){
+        return -errno;
+    }
+    sqsubmitted_ += result;
+    return result;
+}
+
+bool uring::pop_cqe(io_uring_cqe& cqe){
+    auto head = *cqhead_; // only written by us
+    if (head == load_acquire(cqtail_)){
+        return false;
+    }
+    cqe = cqes_[head & cqmask_];
+    store_release(cqhead_, head + 1);
+    return true;
+}
+
+bool uring::register_buffers(uint16_t group, uint32_t count, uint32_t size){
+    if (count == 0 || (count & (count - 1)) != 0 || count > 32768){
+        LOG_ERROR("io_uring: buffer count must be a power of 2");
+        return false;
+    }
+    // the buffer ring must be page aligned
+    bufringsize_ = count * sizeof(io_uring_buf);
+    auto ring = mmap(nullptr, bufringsize_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED){
+        LOG_ERROR("io_uring: couldn't allocate buffer ring (" << errno << ")");
+        return false;
+    }
+    bufring_ = (io_uring_buf_ring *)ring;
+    bufdatasize_ = (size_t)count * size;
+    // NOTE: don't prefault the buffers; they are large enough for the
+    // largest UDP packet, but typically only the first few pages are used.
+    auto data = mmap(nullptr, bufdatasize_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED){
+        LOG_ERROR("io_uring: couldn't allocate buffers (" << errno << ")");
+        return false;
+    }
+    bufdata_ = (char *)data;
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bufring_;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    // Linux 5.19+
+    if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PBUF_RING,
+                &reg, 1) != 0){
+        LOG_VERBOSE("io_uring: couldn't register buffer ring (" << errno << ")");
+        return false;
+    }
+    bufcount_ = count;
+    bufsize_ = size;
+    buftail_ = 0;
+    for (uint32_t i = 0; i < count; ++i){
+        recycle_buffer(i);
+    }
+    return true;
+}
+
+void uring::recycle_buffer(uint16_t id){
+    // NOTE: don't use the 'bufs' member, because __DECLARE_FLEX_ARRAY
+    // adds an empty struct in C++, which would shift the array!
+    auto bufs = reinterpret_cast<io_uring_buf *>(bufring_);
+    auto& buf = bufs[buftail_ & (bufcount_ - 1)];
+    buf.addr = (uint64_t)(uintptr_t)buffer(id);
+    buf.len = bufsize_;
+    buf.bid = id;
+    buftail_++;
+    // publish the buffer
+    __atomic_store_n(&bufring_->tail, buftail_, __ATOMIC_RELEASE);
+}
+
+} // aoo
+
+#endif // AOO_USE_IO_URING
@@ -0,0 +1,101 @@
+/* Copyright (c) 2010-Now Christof Ressi, Winfried Ritsch and others.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+#pragma once
+
+#ifndef AOO_USE_IO_URING
+#define AOO_USE_IO_URING 0
+#endif
+
+#if AOO_USE_IO_URING
+
+#ifndef __linux__
+#error "io_uring is only available on Linux"
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+namespace aoo {
+
+/*//////////////////////// uring //////////////////////////*/
+
+// A minimal io_uring wrapper on top of the raw system calls,
+// so we don't have to depend on liburing.
+// NOTE: not thread safe, should only be used by a single thread.
+class uring {
+public:
+    uring() = default;
+    ~uring();
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+
+    // create the rings; returns false if io_uring is not available
+    // (e.g. old kernel or disabled by seccomp)
+    bool init(uint32_t entries);
+
+    bool valid() const { return fd_ >= 0; }
+
+    // get the next free submission queue entry (zeroed);
+    // returns nullptr if the submission queue is full.
+    io_uring_sqe * get_sqe();
+
+    // submit all pending SQEs and wait for at least 'wait' completions.
+    // 'timeout' is in milliseconds; a negative value waits forever.
+    // returns the number of submitted SQEs or -errno (-ETIME on timeout).
+    int submit(uint32_t wait = 0, int32_t timeout = -1);
+
+    // get the next completion; returns false if the queue is empty.
+    // the CQE is copied and immediately consumed.
+    bool pop_cqe(io_uring_cqe& cqe);
+
+    // register a ring of provided buffers which the kernel can pick
+    // from (IOSQE_BUFFER_SELECT). 'count' must be a power of 2.
+    // The buffer memory is only committed when it's actually used.
+    bool register_buffers(uint16_t group, uint32_t count, uint32_t size);
+
+    char * buffer(uint16_t id) {
+        return bufdata_ + (size_t)id * bufsize_;
+    }
+
+    uint32_t buffer_size() const { return bufsize_; }
+
+    // give a buffer back to the kernel
+    void recycle_buffer(uint16_t id);
+private:
+    int fd_ = -1;
+    uint32_t features_ = 0;
+    // submission queue
+    void *sqring_ = nullptr;
+    size_t sqringsize_ = 0;
+    uint32_t *sqhead_ = nullptr;
+    uint32_t *sqtail_ = nullptr;
+    uint32_t sqmask_ = 0;
+    uint32_t sqentries_ = 0;
+    uint32_t *sqarray_ = nullptr;
+    io_uring_sqe *sqes_ = nullptr;
+    size_t sqessize_ = 0;
+    uint32_t sqlocaltail_ = 0;
+    uint32_t sqsubmitted_ = 0;
+    // completion queue
+    void *cqring_ = nullptr;
+    size_t cqringsize_ = 0;
+    uint32_t *cqhead_ = nullptr;
+    uint32_t *cqtail_ = nullptr;
+    uint32_t cqmask_ = 0;
+    io_uring_cqe *cqes_ = nullptr;
+    // provided buffers
+    io_uring_buf_ring *bufring_ = nullptr;
+    size_t bufringsize_ = 0;
+    uint32_t bufcount_ = 0;
+    uint32_t bufsize_ = 0;
+    uint16_t buftail_ = 0;
+    char *bufdata_ = nullptr;
+    size_t bufdatasize_ = 0;
+};
+
+} // aoo
+
+#endif // AOO_USE_IO_URING
@@ -183,6 +183,60 @@ static int aoo_getarg(const char *name, void *x, int which,
     return 1;
 }
 
+// parse (and remove) leading creation flags:
+// -cpu <n...>: pin the network threads to the given CPUs
+// -rt: run the network threads with real-time priority
+//      (must be given to the first object)
+// -numa <n>|auto: allocate the audio queues on the given NUMA node;
+// 'auto' returns AOO_NUMA_AUTO: the object has to query the node of
+// the audio thread in its "dsp" method (we're not necessarily called
+// on the audio thread).
+void aoo_parseflags(void *x, int *argc, t_atom **argv, int32_t *numa)
+{
+    *numa = -1;
+    while (*argc && (*argv)->a_type == A_SYMBOL
+           && *(*argv)->a_w.w_symbol->s_name == '-'){
+        t_symbol *flag = (*argv)->a_w.w_symbol;
+        (*argc)--; (*argv)++;
+        if (flag == gensym("-cpu")){
+            int32_t cpus[64];
+            int n = 0;
+            while (*argc && (*argv)->a_type == A_FLOAT){
+                if (n < 64){
+                    cpus[n++] = (*argv)->a_w.w_float;
+                }
+                (*argc)--; (*argv)++;
+            }
+            if (!n){
+                pd_error(x, "%s: missing argument for -cpu flag", classname(x));
+                return;
+            }
+            if (!aoo_node_set_affinity(cpus, n)){
+                pd_error(x, "%s: couldn't set CPU affinity", classname(x));
+            }
+        } else if (flag == gensym("-rt")){
+            if (!aoo_node_set_realtime()){
+                pd_error(x, "%s: couldn't enable real-time priority "
+                         "(must be given to the first aoo object)", classname(x));
+            }
+        } else if (flag == gensym("-numa")){
+            if (!*argc){
+                pd_error(x, "%s: missing argument for -numa flag", classname(x));
+                return;
+            }
+            if ((*argv)->a_type == A_SYMBOL
+                    && (*argv)->a_w.w_symbol == gensym("auto")){
+                *numa = AOO_NUMA_AUTO;
+            } else {
+                *numa = atom_getfloat(*argv);
+            }
+            (*argc)--; (*argv)++;
+        } else {
+            pd_error(x, "%s: unknown flag '%s'", classname(x), flag->s_name);
+        }
+    }
+}
+
 int aoo_parseresend(void *x, int argc, const t_atom *argv,
                     int32_t *limit, int32_t *interval,
                     int32_t *maxnumframes)
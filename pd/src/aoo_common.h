@@ -61,6 +61,20 @@ void aoo_node_remove_all_peers(t_aoo_node *node);
 
 void aoo_node_notify(t_aoo_node *node);
 
+int aoo_node_joingroup(t_aoo_node *node, const struct sockaddr_storage *sa);
+
+int aoo_node_leavegroup(t_aoo_node *node, const struct sockaddr_storage *sa);
+
+int aoo_node_set_dontfragment(t_aoo_node *node, int dontfragment);
+
+// bundle outgoing messages up to 'maxsize' bytes (0 = off);
+// affects all objects on the same port!
+int aoo_node_set_bundling(t_aoo_node *node, int maxsize);
+
+int aoo_node_set_affinity(const int32_t *cpus, int n);
+
+int aoo_node_set_realtime(void);
+
 /*///////////////////////////// aoo_lock /////////////////////////////*/
 
 #ifdef _WIN32
@@ -91,6 +105,11 @@ int aoo_getsinkarg(void *x, t_aoo_node *node, int argc, t_atom *argv,
 int aoo_getsourcearg(void *x, t_aoo_node *node, int argc, t_atom *argv,
                      struct sockaddr_storage *sa, socklen_t *len, int32_t *id);
 
+// see aoo_parseflags()
+#define AOO_NUMA_AUTO -2
+
+void aoo_parseflags(void *x, int *argc, t_atom **argv, int32_t *numa);
+
 int aoo_parseresend(void *x, int argc, const t_atom *argv,
                     int32_t *limit, int32_t *interval,
                     int32_t *maxnumframes);
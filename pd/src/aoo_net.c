@@ -6,6 +6,7 @@
 
 #ifdef _WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h>
 typedef int socklen_t;
 #else
 #include <sys/socket.h>
@@ -206,6 +207,45 @@ int socket_signal(int socket, int port)
     }
 }
 
+static int socket_membership(int socket, const struct sockaddr_storage *sa, int option)
+{
+    if (sa->ss_family != AF_INET){
+        return -1; // not supported yet
+    }
+    struct ip_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr = ((const struct sockaddr_in *)sa)->sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    return setsockopt(socket, IPPROTO_IP, option, (const char *)&mreq, sizeof(mreq));
+}
+
+int socket_joingroup(int socket, const struct sockaddr_storage *sa)
+{
+    return socket_membership(socket, sa, IP_ADD_MEMBERSHIP);
+}
+
+int socket_leavegroup(int socket, const struct sockaddr_storage *sa)
+{
+    return socket_membership(socket, sa, IP_DROP_MEMBERSHIP);
+}
+
+int socket_setdontfragment(int socket, int dontfragment)
+{
+#if defined(_WIN32)
+    DWORD val = dontfragment != 0;
+    return setsockopt(socket, IPPROTO_IP, IP_DONTFRAGMENT, (const char *)&val, sizeof(val));
+#elif defined(IP_MTU_DISCOVER)
+    // set the DF bit but ignore the cached path MTU, see aoo_opt_probe_packetsize
+    int val = dontfragment ? IP_PMTUDISC_PROBE : IP_PMTUDISC_DONT;
+    return setsockopt(socket, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val));
+#elif defined(IP_DONTFRAG)
+    int val = dontfragment != 0;
+    return setsockopt(socket, IPPROTO_IP, IP_DONTFRAG, &val, sizeof(val));
+#else
+    return -1; // not supported
+#endif
+}
+
 int socket_getaddr(const char *hostname, int port,
                    struct sockaddr_storage *sa, socklen_t *len)
 {
@@ -257,7 +297,7 @@ void endpoint_free(t_endpoint *e)
     freebytes(e, sizeof(t_endpoint));
 }
 
-int endpoint_send(t_endpoint *e, const char *data, int size)
+static int endpoint_dosend(t_endpoint *e, const char *data, int size)
 {
     int socket = *((int *)e->owner);
     int result = sendto(socket, data, size, 0,
@@ -268,6 +308,155 @@ int endpoint_send(t_endpoint *e, const char *data, int size)
     return result;
 }
 
+/*//////////////////// bundler ///////////////////////*/
+
+#ifdef _MSC_VER
+#define AOO_THREAD_LOCAL __declspec(thread)
+#else
+#define AOO_THREAD_LOCAL __thread
+#endif
+
+typedef struct _bundle {
+    t_endpoint *endpoint;
+    char *data; // bufsize
+    int size;
+    int count;
+} t_bundle;
+
+struct _bundler {
+    t_bundle *bundles;
+    int numbundles; // in use
+    int capacity; // allocated
+    int bufsize;
+    int maxsize;
+};
+
+// only the thread which is running the send round collects messages
+static AOO_THREAD_LOCAL t_bundler *current_bundler;
+
+t_bundler * bundler_new(int bufsize)
+{
+    t_bundler *b = (t_bundler *)getbytes(sizeof(t_bundler));
+    if (b){
+        b->bundles = 0;
+        b->numbundles = 0;
+        b->capacity = 0;
+        b->bufsize = bufsize;
+        b->maxsize = bufsize;
+    }
+    return b;
+}
+
+void bundler_free(t_bundler *b)
+{
+    for (int i = 0; i < b->capacity; ++i){
+        freebytes(b->bundles[i].data, b->bufsize);
+    }
+    if (b->bundles){
+        freebytes(b->bundles, sizeof(t_bundle) * b->capacity);
+    }
+    freebytes(b, sizeof(t_bundler));
+}
+
+static void bundle_flush(t_bundle *bundle)
+{
+    if (bundle->count == 1){
+        // a single message doesn't need a bundle
+        endpoint_dosend(bundle->endpoint,
+                        bundle->data + AOO_BUNDLE_HEADERSIZE + 4,
+                        bundle->size - AOO_BUNDLE_HEADERSIZE - 4);
+    } else if (bundle->count > 1){
+        endpoint_dosend(bundle->endpoint, bundle->data, bundle->size);
+    }
+    bundle->size = AOO_BUNDLE_HEADERSIZE;
+    bundle->count = 0;
+}
+
+static t_bundle * bundler_get(t_bundler *b, t_endpoint *e)
+{
+    for (int i = 0; i < b->numbundles; ++i){
+        if (b->bundles[i].endpoint == e){
+            return &b->bundles[i];
+        }
+    }
+    if (b->numbundles == b->capacity){
+        int newcap = b->capacity ? b->capacity * 2 : 4;
+        t_bundle *bundles = (t_bundle *)resizebytes(b->bundles,
+            sizeof(t_bundle) * b->capacity, sizeof(t_bundle) * newcap);
+        if (!bundles){
+            return 0;
+        }
+        for (int i = b->capacity; i < newcap; ++i){
+            bundles[i].data = 0;
+        }
+        b->bundles = bundles;
+        b->capacity = newcap;
+    }
+    t_bundle *bundle = &b->bundles[b->numbundles];
+    if (!bundle->data){
+        if (!(bundle->data = (char *)getbytes(b->bufsize))){
+            return 0;
+        }
+        // OSC bundle header with timetag 1 (= immediately)
+        memcpy(bundle->data, "#bundle\0", 8);
+        memset(bundle->data + 8, 0, 7);
+        bundle->data[15] = 1;
+    }
+    bundle->endpoint = e;
+    bundle->size = AOO_BUNDLE_HEADERSIZE;
+    bundle->count = 0;
+    b->numbundles++;
+    return bundle;
+}
+
+void endpoint_bundle_begin(t_bundler *b, int maxsize)
+{
+    b->numbundles = 0;
+    b->maxsize = maxsize < b->bufsize ? maxsize : b->bufsize;
+    current_bundler = b;
+}
+
+void endpoint_bundle_end(t_bundler *b)
+{
+    current_bundler = 0;
+    for (int i = 0; i < b->numbundles; ++i){
+        bundle_flush(&b->bundles[i]);
+    }
+    b->numbundles = 0;
+}
+
+int endpoint_send(t_endpoint *e, const char *data, int size)
+{
+    t_bundler *b = current_bundler;
+    if (b && (AOO_BUNDLE_HEADERSIZE + 4 + size) <= b->maxsize){
+        t_bundle *bundle = bundler_get(b, e);
+        if (bundle){
+            if (bundle->size + 4 + size > b->maxsize){
+                bundle_flush(bundle);
+            }
+            // element size (big endian) + message
+            char *ptr = bundle->data + bundle->size;
+            ptr[0] = (size >> 24) & 0xff;
+            ptr[1] = (size >> 16) & 0xff;
+            ptr[2] = (size >> 8) & 0xff;
+            ptr[3] = size & 0xff;
+            memcpy(ptr + 4, data, size);
+            bundle->size += 4 + size;
+            bundle->count++;
+            return size;
+        }
+    } else if (b){
+        // too large for a bundle; flush pending messages first to keep the order
+        for (int i = 0; i < b->numbundles; ++i){
+            if (b->bundles[i].endpoint == e){
+                bundle_flush(&b->bundles[i]);
+                break;
+            }
+        }
+    }
+    return endpoint_dosend(e, data, size);
+}
+
 int endpoint_getaddress(const t_endpoint *e, t_symbol **hostname, int *port)
 {
     struct sockaddr_in *addr = (struct sockaddr_in *)&e->addr;
@@ -31,6 +31,12 @@ int socket_setrecvbufsize(int socket, int bufsize);
 
 int socket_signal(int socket, int port);
 
+int socket_joingroup(int socket, const struct sockaddr_storage *sa);
+
+int socket_leavegroup(int socket, const struct sockaddr_storage *sa);
+
+int socket_setdontfragment(int socket, int dontfragment);
+
 int socket_getaddr(const char *hostname, int port,
                    struct sockaddr_storage *sa, socklen_t *len);
 
@@ -61,3 +67,20 @@ int endpoint_getaddress(const t_endpoint *e, t_symbol **hostname, int *port);
 t_endpoint * endpoint_find(t_endpoint *e, const struct sockaddr_storage *sa);
 
 int endpoint_match(t_endpoint *e, const struct sockaddr_storage *sa);
+
+// "#bundle\0" + timetag
+#define AOO_BUNDLE_HEADERSIZE 16
+
+// collect messages per endpoint into OSC bundles;
+// between endpoint_bundle_begin() and endpoint_bundle_end(),
+// endpoint_send() on the calling thread appends to the bundle
+// of the given endpoint instead of sending immediately.
+typedef struct _bundler t_bundler;
+
+t_bundler * bundler_new(int bufsize);
+
+void bundler_free(t_bundler *b);
+
+void endpoint_bundle_begin(t_bundler *b, int maxsize);
+
+void endpoint_bundle_end(t_bundler *b);
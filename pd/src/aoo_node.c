@@ -73,6 +73,22 @@ static void lower_thread_priority(void)
 
 static t_class *aoo_node_class;
 
+#if !AOO_NODE_POLL
+// shared by all nodes
+static aoo_scheduler *aoo_node_scheduler;
+#endif
+
+// CPU affinity of the network threads (shared by all nodes)
+#define AOO_NODE_MAXCPUS 64
+
+static int32_t aoo_node_cpus[AOO_NODE_MAXCPUS];
+static int aoo_node_numcpus;
+static int aoo_node_affinity; // generation (protected by aoo_node_affinitylock)
+static pthread_mutex_t aoo_node_affinitylock = PTHREAD_MUTEX_INITIALIZER;
+
+// real-time priority for the scheduler, see aoo_node_set_realtime()
+static int aoo_node_realtime;
+
 typedef struct _client
 {
     t_pd *c_obj;
@@ -100,16 +116,18 @@ typedef struct _aoo_node
     // socket
     int x_socket;
     int x_port;
+    char *x_recvbuf; // AOO_MAXUDPPACKETSIZE
     t_endpoint *x_endpoints;
     pthread_mutex_t x_endpointlock;
+    // bundling (protected by x_clientlock)
+    t_bundler *x_bundler;
+    int x_bundlesize;
     // threading
 #if AOO_NODE_POLL
     pthread_t x_thread;
 #else
-    pthread_t x_sendthread;
     pthread_t x_receivethread;
-    pthread_mutex_t x_mutex;
-    pthread_cond_t x_condition;
+    int32_t x_sendtask;
 #endif
     int x_quit; // should be atomic, but works anyway
 } t_aoo_node;
@@ -235,10 +253,46 @@ int aoo_node_port(t_aoo_node *x)
 void aoo_node_notify(t_aoo_node *x)
 {
 #if !AOO_NODE_POLL
-    pthread_cond_signal(&x->x_condition);
+    aoo_scheduler_notify(aoo_node_scheduler, x->x_sendtask);
 #endif
 }
 
+int aoo_node_joingroup(t_aoo_node *x, const struct sockaddr_storage *sa)
+{
+    if (socket_joingroup(x->x_socket, sa) < 0){
+        // several receivers on the same port might join the same group
+    #ifdef _WIN32
+        if (socket_errno() != WSAEADDRINUSE)
+    #else
+        if (socket_errno() != EADDRINUSE)
+    #endif
+        {
+            socket_error_print("joingroup");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int aoo_node_leavegroup(t_aoo_node *x, const struct sockaddr_storage *sa)
+{
+    if (socket_leavegroup(x->x_socket, sa) < 0){
+        socket_error_print("leavegroup");
+        return 0;
+    }
+    return 1;
+}
+
+// NOTE: this affects all objects on the same port
+int aoo_node_set_dontfragment(t_aoo_node *x, int dontfragment)
+{
+    if (socket_setdontfragment(x->x_socket, dontfragment) < 0){
+        socket_error_print("dontfragment");
+        return 0;
+    }
+    return 1;
+}
+
 int32_t aoo_node_sendto(t_aoo_node *x, const char *buf, int32_t size,
                         const struct sockaddr *addr)
 {
@@ -246,10 +300,31 @@ int32_t aoo_node_sendto(t_aoo_node *x, const char *buf, int32_t size,
     return result;
 }
 
+int aoo_node_set_bundling(t_aoo_node *x, int maxsize)
+{
+    if (maxsize > AOO_MAXPACKETSIZE){
+        maxsize = AOO_MAXPACKETSIZE;
+    } else if (maxsize < 0){
+        maxsize = 0;
+    }
+    aoo_lock_lock(&x->x_clientlock);
+    if (maxsize > 0 && !x->x_bundler){
+        x->x_bundler = bundler_new(AOO_MAXPACKETSIZE);
+    }
+    x->x_bundlesize = x->x_bundler ? maxsize : 0;
+    aoo_lock_unlock(&x->x_clientlock);
+    return maxsize;
+}
+
 void aoo_node_dosend(t_aoo_node *x)
 {
     aoo_lock_lock_shared(&x->x_clientlock);
 
+    // collect the messages of all clients per endpoint
+    if (x->x_bundlesize > 0){
+        endpoint_bundle_begin(x->x_bundler, x->x_bundlesize);
+    }
+
     for (int i = 0; i < x->x_numclients; ++i){
         t_client *c = &x->x_clients[i];
         if (pd_class(c->c_obj) == aoo_receive_class){
@@ -264,15 +339,86 @@ void aoo_node_dosend(t_aoo_node *x)
         }
     }
 
+    if (x->x_bundlesize > 0){
+        endpoint_bundle_end(x->x_bundler);
+    }
+
     aoo_lock_unlock_shared(&x->x_clientlock);
 }
 
+static void aoo_node_handle_packet(t_aoo_node *x, const char *buf,
+                                   int nbytes, t_endpoint *ep)
+{
+    // get sink ID
+    int32_t type, id;
+    if ((aoo_parse_pattern(buf, nbytes, &type, &id) > 0)
+        || (aoonet_parse_pattern(buf, nbytes, &type) > 0))
+    {
+        aoo_lock_lock_shared(&x->x_clientlock);
+        if (type == AOO_TYPE_SINK){
+            // forward OSC packet to matching receiver(s)
+            // NOTE: compact data messages don't have an ID (AOO_ID_NONE),
+            // the receivers look up the source by its salt.
+            for (int i = 0; i < x->x_numclients; ++i){
+                if ((pd_class(x->x_clients[i].c_obj) == aoo_receive_class) &&
+                    ((id == AOO_ID_WILDCARD) || (id == AOO_ID_NONE) ||
+                     (id == x->x_clients[i].c_id)))
+                {
+                    t_aoo_receive *rcv = (t_aoo_receive *)x->x_clients[i].c_obj;
+                    aoo_receive_handle_message(rcv, buf, nbytes,
+                        ep, (aoo_replyfn)endpoint_send);
+                    if (id != AOO_ID_WILDCARD && id != AOO_ID_NONE)
+                        break;
+                }
+            }
+        } else if (type == AOO_TYPE_SOURCE){
+            // forward OSC packet to matching senders(s)
+            for (int i = 0; i < x->x_numclients; ++i){
+                if ((pd_class(x->x_clients[i].c_obj) == aoo_send_class) &&
+                    ((id == AOO_ID_WILDCARD) || (id == x->x_clients[i].c_id)))
+                {
+                    t_aoo_send *snd = (t_aoo_send *)x->x_clients[i].c_obj;
+                    aoo_send_handle_message(snd, buf, nbytes,
+                        ep, (aoo_replyfn)endpoint_send);
+                    if (id != AOO_ID_WILDCARD)
+                        break;
+                }
+            }
+        } else if (type == AOO_TYPE_CLIENT || type == AOO_TYPE_PEER){
+            // forward OSC packet to matching client
+            for (int i = 0; i < x->x_numclients; ++i){
+                if (pd_class(x->x_clients[i].c_obj) == aoo_client_class)
+                {
+                    t_aoo_client *c = (t_aoo_client *)x->x_clients[i].c_obj;
+                    aoo_client_handle_message(c, buf, nbytes,
+                        ep, (aoo_replyfn)endpoint_send);
+                    break;
+                }
+            }
+        } else if (type == AOO_TYPE_SERVER){
+            // ignore
+        } else {
+            fprintf(stderr, "bug: unknown aoo type\n");
+            fflush(stderr);
+        }
+        aoo_lock_unlock_shared(&x->x_clientlock);
+    #if !AOO_NODE_POLL
+        // schedule send task
+        aoo_scheduler_notify(aoo_node_scheduler, x->x_sendtask);
+    #endif
+    } else {
+        // not a valid AoO OSC message
+        fprintf(stderr, "aoo_node: not a valid AOO message!\n");
+        fflush(stderr);
+    }
+}
+
 void aoo_node_doreceive(t_aoo_node *x)
 {
     struct sockaddr_storage sa;
     socklen_t len;
-    char buf[AOO_MAXPACKETSIZE];
-    int nbytes = socket_receive(x->x_socket, buf, AOO_MAXPACKETSIZE, &sa, &len, 0);
+    char *buf = x->x_recvbuf;
+    int nbytes = socket_receive(x->x_socket, buf, AOO_MAXUDPPACKETSIZE, &sa, &len, 0);
     if (nbytes > 0){
         // try to find endpoint
         pthread_mutex_lock(&x->x_endpointlock);
@@ -284,64 +430,26 @@ void aoo_node_doreceive(t_aoo_node *x)
             x->x_endpoints = ep;
         }
         pthread_mutex_unlock(&x->x_endpointlock);
-        // get sink ID
-        int32_t type, id;
-        if ((aoo_parse_pattern(buf, nbytes, &type, &id) > 0)
-            || (aoonet_parse_pattern(buf, nbytes, &type) > 0))
-        {
-            aoo_lock_lock_shared(&x->x_clientlock);
-            if (type == AOO_TYPE_SINK){
-                // forward OSC packet to matching receiver(s)
-                for (int i = 0; i < x->x_numclients; ++i){
-                    if ((pd_class(x->x_clients[i].c_obj) == aoo_receive_class) &&
-                        ((id == AOO_ID_WILDCARD) || (id == x->x_clients[i].c_id)))
-                    {
-                        t_aoo_receive *rcv = (t_aoo_receive *)x->x_clients[i].c_obj;
-                        aoo_receive_handle_message(rcv, buf, nbytes,
-                            ep, (aoo_replyfn)endpoint_send);
-                        if (id != AOO_ID_WILDCARD)
-                            break;
-                    }
-                }
-            } else if (type == AOO_TYPE_SOURCE){
-                // forward OSC packet to matching senders(s)
-                for (int i = 0; i < x->x_numclients; ++i){
-                    if ((pd_class(x->x_clients[i].c_obj) == aoo_send_class) &&
-                        ((id == AOO_ID_WILDCARD) || (id == x->x_clients[i].c_id)))
-                    {
-                        t_aoo_send *snd = (t_aoo_send *)x->x_clients[i].c_obj;
-                        aoo_send_handle_message(snd, buf, nbytes,
-                            ep, (aoo_replyfn)endpoint_send);
-                        if (id != AOO_ID_WILDCARD)
-                            break;
-                    }
-                }
-            } else if (type == AOO_TYPE_CLIENT || type == AOO_TYPE_PEER){
-                // forward OSC packet to matching client
-                for (int i = 0; i < x->x_numclients; ++i){
-                    if (pd_class(x->x_clients[i].c_obj) == aoo_client_class)
-                    {
-                        t_aoo_client *c = (t_aoo_client *)x->x_clients[i].c_obj;
-                        aoo_client_handle_message(c, buf, nbytes,
-                            ep, (aoo_replyfn)endpoint_send);
-                        break;
-                    }
+        if (nbytes >= 16 && !memcmp(buf, "#bundle", 8)){
+            // several messages which have been bundled by the sender,
+            // see aoo_transport_set_bundling()
+            const char *p = buf + 16; // skip time tag
+            const char *end = buf + nbytes;
+            while ((end - p) >= 4){
+                const unsigned char *b = (const unsigned char *)p;
+                int32_t size = ((int32_t)b[0] << 24) | ((int32_t)b[1] << 16)
+                        | ((int32_t)b[2] << 8) | (int32_t)b[3];
+                p += 4;
+                if (size <= 0 || size > (end - p)){
+                    fprintf(stderr, "aoo_node: bad bundle element size!\n");
+                    fflush(stderr);
+                    break;
                 }
-            } else if (type == AOO_TYPE_SERVER){
-                // ignore
-            } else {
-                fprintf(stderr, "bug: unknown aoo type\n");
-                fflush(stderr);
+                aoo_node_handle_packet(x, p, size, ep);
+                p += size;
             }
-            aoo_lock_unlock_shared(&x->x_clientlock);
-        #if !AOO_NODE_POLL
-            // notify send thread
-            pthread_cond_signal(&x->x_condition);
-        #endif
         } else {
-            // not a valid AoO OSC message
-            fprintf(stderr, "aoo_node: not a valid AOO message!\n");
-            fflush(stderr);
+            aoo_node_handle_packet(x, buf, nbytes, ep);
         }
     } else if (nbytes < 0){
         // ignore errors when quitting
@@ -351,15 +459,75 @@ void aoo_node_doreceive(t_aoo_node *x)
     }
 }
 
+// called on the network thread(s)
+static void aoo_node_update_affinity(int *generation)
+{
+    // don't block the network thread; if the lock is taken,
+    // we simply try again in the next iteration.
+    if (pthread_mutex_trylock(&aoo_node_affinitylock) == 0){
+        if (*generation != aoo_node_affinity){
+            if (!aoo_set_thread_affinity(aoo_node_cpus, aoo_node_numcpus)){
+                fprintf(stderr, "aoo_node: couldn't set CPU affinity\n");
+            }
+            *generation = aoo_node_affinity;
+        }
+        pthread_mutex_unlock(&aoo_node_affinitylock);
+    }
+}
+
+// pin the network threads of all nodes to the given CPUs
+int aoo_node_set_affinity(const int32_t *cpus, int n)
+{
+    if (n <= 0){
+        return 0;
+    }
+    if (n > AOO_NODE_MAXCPUS){
+        n = AOO_NODE_MAXCPUS;
+    }
+    pthread_mutex_lock(&aoo_node_affinitylock);
+    memcpy(aoo_node_cpus, cpus, n * sizeof(int32_t));
+    aoo_node_numcpus = n;
+    // the threads update themselves, see aoo_node_update_affinity()
+    aoo_node_affinity++;
+    pthread_mutex_unlock(&aoo_node_affinitylock);
+#if AOO_NODE_POLL
+    return 1;
+#else
+    if (aoo_node_scheduler){
+        return aoo_scheduler_set_affinity(aoo_node_scheduler, cpus, n);
+    } else {
+        return 1; // see aoo_node_get_scheduler()
+    }
+#endif
+}
+
+// run the network threads with real-time priority;
+// only possible before the first node has been created.
+int aoo_node_set_realtime(void)
+{
+#if AOO_NODE_POLL
+    return 0; // not supported
+#else
+    if (aoo_node_scheduler){
+        return aoo_node_realtime;
+    }
+    aoo_node_realtime = 1;
+    return 1;
+#endif
+}
+
 #if AOO_NODE_POLL
 
 static void* aoo_node_thread(void *y)
 {
     t_aoo_node *x = (t_aoo_node *)y;
+    int affinity = 0;
 
     lower_thread_priority();
 
     while (!x->x_quit){
+        aoo_node_update_affinity(&affinity);
+
         struct pollfd p;
         p.fd = x->x_socket;
         p.revents = 0;
@@ -381,30 +549,42 @@ static void* aoo_node_thread(void *y)
 }
 
 #else
-static void* aoo_node_send(void *y)
+// The scheduler is created together with the first node,
+// so that the creation flags of the first object can take effect.
+static aoo_scheduler * aoo_node_get_scheduler(void)
 {
-    t_aoo_node *x = (t_aoo_node *)y;
-
-    lower_thread_priority();
-
-    pthread_mutex_lock(&x->x_mutex);
-    while (!x->x_quit){
-        pthread_cond_wait(&x->x_condition, &x->x_mutex);
+    if (!aoo_node_scheduler){
+        // NOTE: never freed
+        aoo_node_scheduler = aoo_scheduler_new(0,
+            aoo_node_realtime ? AOO_SCHEDULER_REALTIME : 0);
+        pthread_mutex_lock(&aoo_node_affinitylock);
+        if (aoo_node_numcpus > 0){
+            aoo_scheduler_set_affinity(aoo_node_scheduler,
+                                       aoo_node_cpus, aoo_node_numcpus);
+        }
+        pthread_mutex_unlock(&aoo_node_affinitylock);
+    }
+    return aoo_node_scheduler;
+}
 
+// runs on one of the scheduler's worker threads
+static void aoo_node_send(void *y)
+{
+    t_aoo_node *x = (t_aoo_node *)y;
+    if (!x->x_quit){
         aoo_node_dosend(x);
     }
-    pthread_mutex_unlock(&x->x_mutex);
-
-    return 0;
 }
 
 static void* aoo_node_receive(void *y)
 {
     t_aoo_node *x = (t_aoo_node *)y;
+    int affinity = 0;
 
     lower_thread_priority();
 
     while (!x->x_quit){
+        aoo_node_update_affinity(&affinity);
         aoo_node_doreceive(x);
     }
 
@@ -487,7 +667,11 @@ t_aoo_node* aoo_node_add(int port, t_pd *obj, int32_t id)
 
         x->x_socket = sock;
         x->x_port = port;
+        // large enough for jumbo packets, see aoo_opt_packetsize
+        x->x_recvbuf = (char *)getbytes(AOO_MAXUDPPACKETSIZE);
         x->x_endpoints = 0;
+        x->x_bundler = 0;
+        x->x_bundlesize = 0;
 
         // start threads
         x->x_quit = 0;
@@ -495,10 +679,12 @@ t_aoo_node* aoo_node_add(int port, t_pd *obj, int32_t id)
     #if AOO_NODE_POLL
         pthread_create(&x->x_thread, 0, aoo_node_thread, x);
     #else
-        pthread_mutex_init(&x->x_mutex, 0);
-        pthread_cond_init(&x->x_condition, 0);
-
-        pthread_create(&x->x_sendthread, 0, aoo_node_send, x);
+        x->x_sendtask = aoo_scheduler_add_task(aoo_node_get_scheduler(),
+                                               aoo_node_send, x);
+        if (x->x_sendtask < 0){
+            pd_error(obj, "%s: couldn't add send task for port %d",
+                     classname(obj), port);
+        }
         pthread_create(&x->x_receivethread, 0, aoo_node_receive, x);
     #endif
 
@@ -543,12 +729,12 @@ void aoo_node_release(t_aoo_node *x, t_pd *obj, int32_t id)
 
         socket_close(x->x_socket);
     #else
-        pthread_mutex_lock(&x->x_mutex);
         x->x_quit = 1;
-        pthread_mutex_unlock(&x->x_mutex);
 
-        // notify send thread
-        pthread_cond_signal(&x->x_condition);
+        // remove send task (waits until it has finished)
+        if (x->x_sendtask >= 0){
+            aoo_scheduler_remove_task(aoo_node_scheduler, x->x_sendtask);
+        }
 
         // try to wake up receive thread
         aoo_lock_lock(&x->x_clientlock);
@@ -561,8 +747,7 @@ void aoo_node_release(t_aoo_node *x, t_pd *obj, int32_t id)
         }
         aoo_lock_unlock(&x->x_clientlock);
 
-        // wait for threads
-        pthread_join(x->x_sendthread, 0);
+        // wait for receive thread
         pthread_join(x->x_receivethread, 0);
 
         if (didit){
@@ -580,12 +765,11 @@ void aoo_node_release(t_aoo_node *x, t_pd *obj, int32_t id)
             freebytes(x->x_clients, sizeof(t_client) * x->x_numclients);
         if (x->x_peers)
             freebytes(x->x_peers, sizeof(t_peer) * x->x_numpeers);
+        freebytes(x->x_recvbuf, AOO_MAXUDPPACKETSIZE);
+        if (x->x_bundler)
+            bundler_free(x->x_bundler);
 
         aoo_lock_destroy(&x->x_clientlock);
-    #if !AOO_NODE_POLL
-        pthread_mutex_destroy(&x->x_mutex);
-        pthread_cond_destroy(&x->x_condition);
-    #endif
         verbose(0, "released aoo node on port %d", x->x_port);
 
         freebytes(x, sizeof(*x));
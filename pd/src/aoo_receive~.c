@@ -29,6 +29,7 @@ typedef struct _aoo_receive
     aoo_sink *x_aoo_sink;
     int32_t x_samplerate;
     int32_t x_blocksize;
+    int x_numa_auto; // -numa auto, see aoo_receive_dsp()
     int32_t x_nchannels;
     int32_t x_port;
     int32_t x_id;
@@ -145,6 +146,46 @@ static void aoo_receive_uninvite(t_aoo_receive *x, t_symbol *s, int argc, t_atom
     }
 }
 
+static void aoo_receive_dogroup(t_aoo_receive *x, t_symbol *host, int join)
+{
+    if (!x->x_node){
+        pd_error(x, "%s: can't %s multicast group - no socket!",
+                 classname(x), join ? "join" : "leave");
+        return;
+    }
+    struct sockaddr_storage sa;
+    socklen_t len;
+    if (!socket_getaddr(host->s_name, 0, &sa, &len)){
+        pd_error(x, "%s: couldn't resolve hostname '%s'", classname(x), host->s_name);
+        return;
+    }
+    if (join){
+        if (aoo_node_joingroup(x->x_node, &sa)){
+            verbose(0, "joined multicast group %s", host->s_name);
+        } else {
+            pd_error(x, "%s: couldn't join multicast group %s",
+                     classname(x), host->s_name);
+        }
+    } else {
+        if (aoo_node_leavegroup(x->x_node, &sa)){
+            verbose(0, "left multicast group %s", host->s_name);
+        } else {
+            pd_error(x, "%s: couldn't leave multicast group %s",
+                     classname(x), host->s_name);
+        }
+    }
+}
+
+static void aoo_receive_join(t_aoo_receive *x, t_symbol *host)
+{
+    aoo_receive_dogroup(x, host, 1);
+}
+
+static void aoo_receive_leave(t_aoo_receive *x, t_symbol *host)
+{
+    aoo_receive_dogroup(x, host, 0);
+}
+
 static void aoo_receive_buffersize(t_aoo_receive *x, t_floatarg f)
 {
     aoo_sink_set_buffersize(x->x_aoo_sink, f);
@@ -381,6 +422,14 @@ static void aoo_receive_dsp(t_aoo_receive *x, t_signal **sp)
 
     aoo_lock_unlock(&x->x_lock);
 
+    // the "dsp" method runs on the audio thread
+    if (x->x_numa_auto){
+        int32_t node = aoo_get_numa_node();
+        if (node >= 0){
+            aoo_sink_set_numa_node(x->x_aoo_sink, node);
+        }
+    }
+
     dsp_add(aoo_receive_perform, 2, (t_int)x, (t_int)x->x_blocksize);
 }
 
@@ -440,6 +489,10 @@ static void * aoo_receive_new(t_symbol *s, int argc, t_atom *argv)
 
     aoo_lock_init(&x->x_lock);
 
+    // flags: -cpu <n...>, -rt, -numa <n>|auto
+    int32_t numa;
+    aoo_parseflags(x, &argc, &argv, &numa);
+
     // arg #1: port number
     x->x_port = atom_getfloatarg(0, argc, argv);
 
@@ -473,6 +526,11 @@ static void * aoo_receive_new(t_symbol *s, int argc, t_atom *argv)
     // create and initialize aoo_sink object
     x->x_aoo_sink = aoo_sink_new(x->x_id);
 
+    x->x_numa_auto = numa == AOO_NUMA_AUTO;
+    if (numa >= 0){
+        aoo_sink_set_numa_node(x->x_aoo_sink, numa);
+    }
+
     aoo_receive_buffersize(x, buffersize);
 
     // finally we're ready to receive messages
@@ -513,6 +571,10 @@ void aoo_receive_tilde_setup(void)
                     gensym("invite"), A_GIMME, A_NULL);
     class_addmethod(aoo_receive_class, (t_method)aoo_receive_uninvite,
                     gensym("uninvite"), A_GIMME, A_NULL);
+    class_addmethod(aoo_receive_class, (t_method)aoo_receive_join,
+                    gensym("join"), A_SYMBOL, A_NULL);
+    class_addmethod(aoo_receive_class, (t_method)aoo_receive_leave,
+                    gensym("leave"), A_SYMBOL, A_NULL);
     class_addmethod(aoo_receive_class, (t_method)aoo_receive_buffersize,
                     gensym("bufsize"), A_FLOAT, A_NULL);
     class_addmethod(aoo_receive_class, (t_method)aoo_receive_timefilter,
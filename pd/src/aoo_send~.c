@@ -39,6 +39,7 @@ typedef struct _aoo_send
     aoo_source *x_aoo_source;
     int32_t x_samplerate;
     int32_t x_blocksize;
+    int x_numa_auto; // -numa auto, see aoo_send_dsp()
     int32_t x_nchannels;
     int32_t x_port;
     int32_t x_id;
@@ -322,6 +323,94 @@ static t_sink *aoo_send_findsink(t_aoo_send *x,
     return 0;
 }
 
+static void aoo_send_tier(t_aoo_send *x, t_symbol *s, int argc, t_atom *argv)
+{
+    if (!argc){
+        pd_error(x, "%s: too few arguments for 'tier' message", classname(x));
+        return;
+    }
+    int32_t tier = atom_getfloat(argv);
+    if (argc > 1){
+        aoo_format_storage f;
+        f.header.nchannels = x->x_nchannels;
+        if (aoo_format_parse(x, &f, argc - 1, argv + 1)){
+            aoo_source_set_tier_format(x->x_aoo_source, tier, &f.header);
+        }
+    } else {
+        // remove tier
+        aoo_source_set_tier_format(x->x_aoo_source, tier, 0);
+    }
+}
+
+static void aoo_send_sink_tier(t_aoo_send *x, t_symbol *s, int argc, t_atom *argv)
+{
+    struct sockaddr_storage sa;
+    socklen_t len;
+    int32_t id;
+    if (argc < 4){
+        pd_error(x, "%s: too few arguments for 'sink_tier' message", classname(x));
+        return;
+    }
+    if (aoo_getsinkarg(x, x->x_node, argc, argv, &sa, &len, &id)){
+        t_sink *sink = aoo_send_findsink(x, &sa, id);
+        if (!sink){
+            pd_error(x, "%s: couldn't find sink!", classname(x));
+            return;
+        }
+        int32_t tier = atom_getfloat(argv + 3);
+
+        aoo_source_set_sink_tier(x->x_aoo_source, sink->s_endpoint, sink->s_id, tier);
+    }
+}
+
+static void aoo_send_multicast(t_aoo_send *x, t_symbol *s, int argc, t_atom *argv)
+{
+    if (!argc){
+        // disable multicast
+        aoo_source_set_multicast(x->x_aoo_source, 0, 0);
+        return;
+    }
+    if (!x->x_node){
+        pd_error(x, "%s: can't set multicast group - no socket!", classname(x));
+        return;
+    }
+    if (argc < 2){
+        pd_error(x, "%s: too few arguments for 'multicast' message", classname(x));
+        return;
+    }
+    t_symbol *host = atom_getsymbol(argv);
+    int port = atom_getfloat(argv + 1);
+    struct sockaddr_storage sa;
+    socklen_t len;
+    if (!socket_getaddr(host->s_name, port, &sa, &len)){
+        pd_error(x, "%s: couldn't resolve hostname '%s'", classname(x), host->s_name);
+        return;
+    }
+    t_endpoint *e = aoo_node_endpoint(x->x_node, &sa, len);
+    aoo_source_set_multicast(x->x_aoo_source, e, (aoo_replyfn)endpoint_send);
+}
+
+static void aoo_send_sink_multicast(t_aoo_send *x, t_symbol *s, int argc, t_atom *argv)
+{
+    struct sockaddr_storage sa;
+    socklen_t len;
+    int32_t id;
+    if (argc < 4){
+        pd_error(x, "%s: too few arguments for 'sink_multicast' message", classname(x));
+        return;
+    }
+    if (aoo_getsinkarg(x, x->x_node, argc, argv, &sa, &len, &id)){
+        t_sink *sink = aoo_send_findsink(x, &sa, id);
+        if (!sink){
+            pd_error(x, "%s: couldn't find sink!", classname(x));
+            return;
+        }
+        int32_t b = atom_getfloat(argv + 3);
+
+        aoo_source_set_sink_multicast(x->x_aoo_source, sink->s_endpoint, sink->s_id, b);
+    }
+}
+
 static void aoo_send_accept(t_aoo_send *x, t_floatarg f)
 {
     x->x_accept = f != 0;
@@ -353,6 +442,23 @@ static void aoo_send_packetsize(t_aoo_send *x, t_floatarg f)
     aoo_source_set_packetsize(x->x_aoo_source, f);
 }
 
+static void aoo_send_probe(t_aoo_send *x, t_floatarg f)
+{
+    // probes must not be fragmented
+    if (x->x_node){
+        aoo_node_set_dontfragment(x->x_node, f > 0);
+    }
+    aoo_source_set_probe_packetsize(x->x_aoo_source, f);
+}
+
+static void aoo_send_bundle(t_aoo_send *x, t_floatarg f)
+{
+    // collect the messages of all objects on this port
+    if (x->x_node){
+        aoo_node_set_bundling(x->x_node, f);
+    }
+}
+
 static void aoo_send_ping(t_aoo_send *x, t_floatarg f)
 {
     aoo_source_set_ping_interval(x->x_aoo_source, f);
@@ -566,6 +672,14 @@ static void aoo_send_dsp(t_aoo_send *x, t_signal **sp)
 
     aoo_lock_unlock(&x->x_lock);
 
+    // the "dsp" method runs on the audio thread
+    if (x->x_numa_auto){
+        int32_t node = aoo_get_numa_node();
+        if (node >= 0){
+            aoo_source_set_numa_node(x->x_aoo_source, node);
+        }
+    }
+
     dsp_add(aoo_send_perform, 2, (t_int)x, (t_int)x->x_blocksize);
 }
 
@@ -585,6 +699,11 @@ static void aoo_send_port(t_aoo_send *x, t_floatarg f)
 
     x->x_node = port ? aoo_node_add(port, (t_pd *)x, x->x_id) : 0;
     x->x_port = port;
+    if (x->x_node){
+        // aoo_source_process() coalesces notifications, so make sure
+        // that we pick up blocks which have been processed without a node.
+        aoo_node_notify(x->x_node);
+    }
 }
 
 static void aoo_send_id(t_aoo_send *x, t_floatarg f)
@@ -608,6 +727,9 @@ static void aoo_send_id(t_aoo_send *x, t_floatarg f)
 
     x->x_node = x->x_port ? aoo_node_add(x->x_port, (t_pd *)x, id) : 0;
     x->x_id = id;
+    if (x->x_node){
+        aoo_node_notify(x->x_node); // see aoo_send_port()
+    }
 }
 
 static void * aoo_send_new(t_symbol *s, int argc, t_atom *argv)
@@ -625,6 +747,10 @@ static void * aoo_send_new(t_symbol *s, int argc, t_atom *argv)
 
     aoo_lock_init(&x->x_lock);
 
+    // flags: -cpu <n...>, -rt, -numa <n>|auto
+    int32_t numa;
+    aoo_parseflags(x, &argc, &argv, &numa);
+
     // arg #1: port number
     x->x_port = atom_getfloatarg(0, argc, argv);
 
@@ -664,6 +790,11 @@ static void * aoo_send_new(t_symbol *s, int argc, t_atom *argv)
 
     aoo_source_set_buffersize(x->x_aoo_source, DEFBUFSIZE);
 
+    x->x_numa_auto = numa == AOO_NUMA_AUTO;
+    if (numa >= 0){
+        aoo_source_set_numa_node(x->x_aoo_source, numa);
+    }
+
     // finally we're ready to receive messages
     aoo_send_port(x, x->x_port);
 
@@ -714,8 +845,20 @@ void aoo_send_tilde_setup(void)
                     gensym("format"), A_GIMME, A_NULL);
     class_addmethod(aoo_send_class, (t_method)aoo_send_channel,
                     gensym("channel"), A_GIMME, A_NULL);
+    class_addmethod(aoo_send_class, (t_method)aoo_send_tier,
+                    gensym("tier"), A_GIMME, A_NULL);
+    class_addmethod(aoo_send_class, (t_method)aoo_send_sink_tier,
+                    gensym("sink_tier"), A_GIMME, A_NULL);
+    class_addmethod(aoo_send_class, (t_method)aoo_send_multicast,
+                    gensym("multicast"), A_GIMME, A_NULL);
+    class_addmethod(aoo_send_class, (t_method)aoo_send_sink_multicast,
+                    gensym("sink_multicast"), A_GIMME, A_NULL);
     class_addmethod(aoo_send_class, (t_method)aoo_send_packetsize,
                     gensym("packetsize"), A_FLOAT, A_NULL);
+    class_addmethod(aoo_send_class, (t_method)aoo_send_probe,
+                    gensym("probe"), A_FLOAT, A_NULL);
+    class_addmethod(aoo_send_class, (t_method)aoo_send_bundle,
+                    gensym("bundle"), A_FLOAT, A_NULL);
     class_addmethod(aoo_send_class, (t_method)aoo_send_ping,
                     gensym("ping"), A_FLOAT, A_NULL);
     class_addmethod(aoo_send_class, (t_method)aoo_send_resend,